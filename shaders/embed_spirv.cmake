@@ -0,0 +1,35 @@
+# Writes the .spv files in SPIRV_FILES, a list of paths under SPIRV_DIR, into
+# OUTPUT as constexpr arrays of words with a table keyed by the hashed shader
+# name, e.g. "pbr.frag". Stale .spv files left in SPIRV_DIR are not embedded.
+# Included by src/function/render/shader/embedded_shaders.cpp
+list(SORT SPIRV_FILES)
+
+set(ARRAYS  "")
+set(ENTRIES "")
+foreach(SPIRV_FILE ${SPIRV_FILES})
+  file(RELATIVE_PATH NAME ${SPIRV_DIR} ${SPIRV_FILE})
+  string(REGEX REPLACE "\\.spv$" "" NAME ${NAME})
+  string(MAKE_C_IDENTIFIER ${NAME} IDENT)
+
+  ## little endian bytes to words, 8 words per line
+  file(READ ${SPIRV_FILE} HEX HEX)
+  string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1, " WORDS "${HEX}")
+  set(W "0x[0-9a-f]+, ")
+  string(REGEX REPLACE "(${W}${W}${W}${W}${W}${W}${W}${W})" "\\1\n    "
+         WORDS "${WORDS}")
+
+  string(APPEND ARRAYS
+         "constexpr uint32_t kSpirv_${IDENT}[] = {\n    ${WORDS}\n};\n\n")
+  string(APPEND ENTRIES
+         "    {StringHash(\"${NAME}\"), kSpirv_${IDENT}, "
+         "sizeof(kSpirv_${IDENT})},\n")
+endforeach()
+
+## only touch the output if it changed, so the engine is not rebuilt
+file(WRITE ${OUTPUT}.tmp
+     "// Generated by shaders/embed_spirv.cmake, do not edit\n\n"
+     "${ARRAYS}"
+     "constexpr EmbeddedShader kEmbeddedShaders[] = {\n${ENTRIES}};\n")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different
+                ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)
@@ -0,0 +1,6 @@
+#version 460
+
+layout(location = 0) out vec4 out_color;
+
+// Drawn while the pipeline of a material is compiling
+void main() { out_color = vec4(0.5, 0.5, 0.5, 1.0); }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #version 460
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
@@ -8,21 +9,22 @@ layout(location = 4) in vec2 in_texcoord1;
 
 layout(location = 0) out vec4 out_color;
 
-layout(set = 0, binding = 0) uniform sampler2D base_color_tex;
-layout(set = 0, binding = 1) uniform sampler2D metallic_roughness_tex;
-layout(set = 0, binding = 2) uniform sampler2D normal_tex;
-layout(set = 0, binding = 3) uniform sampler2D occlusion_tex;
-layout(set = 0, binding = 4) uniform sampler2D emissive_tex;
+// Pipeline variant, see PBRMaterial::SpecConstant
+layout(constant_id = 0) const int  kDebugView       = 0;
+layout(constant_id = 1) const int  kAlphaMode       = 0;
+layout(constant_id = 2) const bool kHasNormalTex    = true;
+layout(constant_id = 3) const int  kTexcoordSetMask = 0;
+layout(constant_id = 4) const int  kShadowPCFRange  = 3;
 
-layout(set = 0, binding = 5) uniform _unused_name_material {
+struct MaterialParams {
     int texcoord_set_base_color;
-    int texcoord_set_metallic_roughness;
+    int texcoord_set_occlusion_roughness_metallic;
     int texcoord_set_normal;
-    int texcoord_set_occlusion;
     int texcoord_set_emissive;
-    int _padding_texcoord_set_0;
-    int _padding_texcoord_set_1;
-    int _padding_texcoord_set_2;
+    int tex_index_base_color;
+    int tex_index_occlusion_roughness_metallic;
+    int tex_index_normal;
+    int tex_index_emissive;
 
     int   alpha_mode;
     float alpha_cutoff;
@@ -32,6 +34,15 @@ layout(set = 0, binding = 5) uniform _unused_name_material {
     vec4  emissive_factor;
 };
 
+// Params of all PBR materials, indexed by material_id
+layout(set = 0, binding = 0) readonly buffer _unused_name_material {
+    MaterialParams materials[];
+};
+
+layout(push_constant) uniform _unused_name_constants {
+    uint material_id;
+};
+
 layout(set = 1, binding = 0) readonly buffer _unused_name_camera {
     mat4 view;
     mat4 proj;
@@ -50,15 +61,20 @@ layout(set = 1, binding = 1) readonly buffer _unused_name_environment {
     float _padding_1;
 
     mat4 sunlight_world_to_clip;
+
+    // Irradiance / pi in 9 SH coefficients, w is unused
+    vec4 sh_irradiance[9];
 };
 
 // IBL
-layout(set = 1, binding = 2) uniform samplerCube skybox_irradiance;
-layout(set = 1, binding = 3) uniform samplerCube skybox_specular;
-layout(set = 1, binding = 4) uniform sampler2D lut_brdf;
+layout(set = 1, binding = 2) uniform samplerCube skybox_specular;
+layout(set = 1, binding = 3) uniform sampler2D lut_brdf;
 
 // Shadow maps
-layout(set = 1, binding = 5) uniform sampler2D sunlight_shadow_map;
+layout(set = 1, binding = 4) uniform sampler2D sunlight_shadow_map;
+
+// Textures of all materials, indexed by the tex_index_* params
+layout(set = 3, binding = 0) uniform sampler2D textures[];
 
 const float kPi           = 3.141592653589793;
 const float kTwoPi        = kPi * 2.0;
@@ -101,9 +117,36 @@ vec3 Tonemap(vec3 color) {
     return outcol;
 }
 
+// Order 2 SH in the real basis, see
+// "An Efficient Representation for Irradiance Environment Maps"
+vec3 EvaluateSHIrradiance(vec3 n) {
+    return sh_irradiance[0].rgb * 0.282095 +
+           sh_irradiance[1].rgb * 0.488603 * n.y +
+           sh_irradiance[2].rgb * 0.488603 * n.z +
+           sh_irradiance[3].rgb * 0.488603 * n.x +
+           sh_irradiance[4].rgb * 1.092548 * n.x * n.y +
+           sh_irradiance[5].rgb * 1.092548 * n.y * n.z +
+           sh_irradiance[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0) +
+           sh_irradiance[7].rgb * 1.092548 * n.x * n.z +
+           sh_irradiance[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+// Bit i of kTexcoordSetMask selects texcoord1 for the texture in slot i
+vec2 Texcoord(int slot) {
+    return (kTexcoordSetMask & (1 << slot)) != 0 ? in_texcoord1
+                                                 : in_texcoord0;
+}
+
+// Slot is the PBRMaterial::TextureSlot of the texture
+vec4 SampleTexture(int index, int slot) {
+    return texture(textures[nonuniformEXT(index)], Texcoord(slot));
+}
+
 // Find the normal for this fragment, pulling either from a predefined normal map
 // or from the interpolated mesh normal and tangent attributes.
 vec3 UnpackNormal(vec3 packed_normal) {
+    if (!kHasNormalTex) return normalize(in_normal);
+
     // Perturb normal, see http://www.thetenthplanet.de/archives/1180
     vec3 tangent_normal;
     tangent_normal.xy = (packed_normal.xy * 2.0 - 1.0);
@@ -168,7 +211,7 @@ float ShadowMapping() {
     int   count      = 0;
 
     // Simple PCF
-    const int range = 3;
+    const int range = kShadowPCFRange;
     for (int x = -range; x <= range; x++) {
         for (int y = -range; y <= range; y++) {
             vec2  cur_uv    = uv + vec2(dx * x, dy * y);
@@ -184,48 +227,38 @@ float ShadowMapping() {
 }
 
 void main() {
+    MaterialParams material = materials[material_id];
+
     // --- Get texture values ---
-    vec4 base_color_tex_value =
-        texture(base_color_tex,
-                texcoord_set_base_color <= 0 ? in_texcoord0 : in_texcoord1)
-            .rgba;
-    // Roughness is stored in the 'g' channel, metallic is stored in the 'b' channel.
-    // This layout intentionally reserves the 'r' channel for (optional) occlusion map data
-    float metallic_tex_value =
-        texture(metallic_roughness_tex, texcoord_set_metallic_roughness <= 0
-                                            ? in_texcoord0
-                                            : in_texcoord1)
-            .b;
-    float roughness_tex_value =
-        texture(metallic_roughness_tex, texcoord_set_metallic_roughness <= 0
-                                            ? in_texcoord0
-                                            : in_texcoord1)
-            .g;
-    vec3 normal_tex_value =
-        texture(normal_tex,
-                texcoord_set_normal <= 0 ? in_texcoord0 : in_texcoord1)
-            .rgb;
-    float occlusion_tex_value =
-        texture(occlusion_tex,
-                texcoord_set_occlusion <= 0 ? in_texcoord0 : in_texcoord1)
-            .r;
+    vec4 base_color_tex_value = SampleTexture(material.tex_index_base_color, 0);
+    // Occlusion, roughness and metallic are packed into 'r', 'g' and 'b'
+    // at import, so one sample serves all three
+    vec3 orm_tex_value =
+        SampleTexture(material.tex_index_occlusion_roughness_metallic, 1).rgb;
+    float occlusion_tex_value = orm_tex_value.r;
+    float roughness_tex_value = orm_tex_value.g;
+    float metallic_tex_value  = orm_tex_value.b;
+    vec3  normal_tex_value    = vec3(0.5, 0.5, 1.0);
+    if (kHasNormalTex) {
+        normal_tex_value = SampleTexture(material.tex_index_normal, 2).rgb;
+    }
     vec3 emissive_tex_value =
-        texture(emissive_tex,
-                texcoord_set_emissive <= 0 ? in_texcoord0 : in_texcoord1)
-            .rgb;
+        SampleTexture(material.tex_index_emissive, 3).rgb;
 
     // --- Prepare PBR infos ---
-    vec4 base_color = base_color_factor * base_color_tex_value;
-    if (alpha_mode == 1 && base_color.a < alpha_cutoff) {
+    vec4 base_color = material.base_color_factor * base_color_tex_value;
+    // Only the mask variant may discard, others keep early depth testing
+    if (kAlphaMode == 1 && base_color.a < material.alpha_cutoff) {
         discard;
     }
     base_color.rgb *= in_color;
 
     // Roughness is authored as perceptual roughness; as is convention,
     // convert to material roughness by squaring the perceptual roughness.
-    float metallic = clamp(metallic_factor * metallic_tex_value, 0.0, 1.0);
-    float perceptual_roughness =
-        clamp(roughness_factor * roughness_tex_value, kMinRoughness, 1.0);
+    float metallic =
+        clamp(material.metallic_factor * metallic_tex_value, 0.0, 1.0);
+    float perceptual_roughness = clamp(
+        material.roughness_factor * roughness_tex_value, kMinRoughness, 1.0);
     float alpha_roughness = perceptual_roughness * perceptual_roughness;
 
     vec3 f0            = vec3(0.04);
@@ -283,9 +316,10 @@ void main() {
 
     // --- Environment illumination (IBL) ---
     // Calculation of the lighting contribution from an optional Image Based Light source.
-    float lod = (perceptual_roughness * mip_levels);
+    // Level i of the specular cubemap is prefiltered for roughness i / (n - 1)
+    float lod = perceptual_roughness * (mip_levels - 1.0);
 
-    vec3 ibl_diffuse_light = Tonemap(texture(skybox_irradiance, n).rgb);
+    vec3 ibl_diffuse_light = Tonemap(max(EvaluateSHIrradiance(n), 0.0));
     vec3 ibl_diffuse = ibl_intensity * ibl_diffuse_light * diffuse_color;
 
     vec2 ibl_brdf =
@@ -303,14 +337,14 @@ void main() {
     color *= ao;
 
     // Apply emission
-    vec3 emissive = emissive_factor.rgb * emissive_tex_value;
+    vec3 emissive = material.emissive_factor.rgb * emissive_tex_value;
     color += emissive;
     
     // Finally output
     out_color = vec4(color, base_color.a);
 
-    // Debug
-    switch (debug_idx) {
+    // Debug views are separate variants, production pipelines skip them
+    switch (kDebugView) {
         case 0:
             break;
         case 1:
@@ -1,7 +1,22 @@
 #version 460
 
-layout(set = 0, binding = 0) uniform samplerCube skybox_irradiance;
-layout(set = 0, binding = 1) uniform samplerCube skybox_specular;
+layout(set = 0, binding = 0) uniform samplerCube skybox_specular;
+
+layout(set = 1, binding = 1) readonly buffer _unused_name_environment {
+    vec3  sunlight_color;
+    float sunlight_intensity;
+    vec3  sunlight_dir;
+    float ibl_intensity;
+    float mip_levels;
+    int   debug_idx;
+    float _padding_0;
+    float _padding_1;
+
+    mat4 sunlight_world_to_clip;
+
+    // Irradiance / pi in 9 SH coefficients, w is unused
+    vec4 sh_irradiance[9];
+};
 
 layout(location = 0) in vec3 sample_position;
 
@@ -33,6 +48,19 @@ vec3 Tonemap(vec3 color) {
     return outcol;
 }
 
+// Order 2 SH in the real basis, same as in pbr.frag
+vec3 EvaluateSHIrradiance(vec3 n) {
+    return sh_irradiance[0].rgb * 0.282095 +
+           sh_irradiance[1].rgb * 0.488603 * n.y +
+           sh_irradiance[2].rgb * 0.488603 * n.z +
+           sh_irradiance[3].rgb * 0.488603 * n.x +
+           sh_irradiance[4].rgb * 1.092548 * n.x * n.y +
+           sh_irradiance[5].rgb * 1.092548 * n.y * n.z +
+           sh_irradiance[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0) +
+           sh_irradiance[7].rgb * 1.092548 * n.x * n.z +
+           sh_irradiance[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
 void main() {
     vec3 color;
     switch (option) {
@@ -43,7 +71,7 @@ void main() {
             break;
         case 0:
         default:
-            color = textureLod(skybox_irradiance, sample_position, 0.0).rgb;
+            color = max(EvaluateSHIrradiance(normalize(sample_position)), 0.0);
             break;
     }
 
@@ -39,11 +39,14 @@ void Engine::Run() {
 }
 
 void Engine::Tick(float dt) {
-    TickLogic(dt);
-    TickRender();
+    // Input is sampled as late as the frame pacer allows
+    render_system_->BeginFrame();
 
     // handle window messages
     window_->Tick();
+
+    TickLogic(dt);
+    TickRender();
 }
 
 void Engine::TickLogic(float dt) {
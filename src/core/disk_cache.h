@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include "json.h"
+
+namespace lumi {
+
+// Binary blobs built from assets, stored under LUMI_CACHE_DIR.
+// The key hashes all inputs of a blob, a blob with another key is treated as
+// missing and gets overwritten by the next save.
+struct CacheHeader {
+    constexpr static uint32_t kMagic   = 0x4843554c;  // "LUCH"
+    constexpr static uint32_t kVersion = 1;
+
+    uint32_t magic   = kMagic;
+    uint32_t version = kVersion;
+    uint64_t key{};
+    uint64_t size{};
+};
+
+inline fs::path CachePath(const std::string& name) {
+    return fs::path(LUMI_CACHE_DIR) / name;
+}
+
+inline bool LoadCache(const std::string& name, uint64_t key,
+                      std::vector<uint8_t>& data) {
+    auto in = std::ifstream(CachePath(name), std::ios::binary);
+    if (!in) return false;
+
+    CacheHeader header{};
+    in.read((char*)&header, sizeof(header));
+    if (!in || header.magic != CacheHeader::kMagic ||
+        header.version != CacheHeader::kVersion || header.key != key) {
+        return false;
+    }
+
+    data.resize(header.size);
+    in.read((char*)data.data(), header.size);
+    return (bool)in;
+}
+
+inline bool SaveCache(const std::string& name, uint64_t key, const void* data,
+                      size_t size) {
+    std::error_code ec{};
+    fs::create_directories(LUMI_CACHE_DIR, ec);
+
+    auto out = std::ofstream(CachePath(name), std::ios::binary);
+    if (!out) {
+        LOG_WARNING("Failed to write cache file {}", CachePath(name));
+        return false;
+    }
+
+    CacheHeader header{};
+    header.key  = key;
+    header.size = size;
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)data, size);
+    return (bool)out;
+}
+
+}  // namespace lumi
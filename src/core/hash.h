@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
 #include <string>
 
 namespace lumi {
@@ -39,6 +40,43 @@ struct StringHash {
     constexpr operator uint32_t() noexcept { return value; }
 };
 
+// FNV-1a 64bit hashing of a byte buffer, e.g. the content of a file
+inline uint64_t HashBytes(const void* data, size_t size,
+                          uint64_t seed = 14695981039346656037ull) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t       hash  = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// MurmurHash64A style hashing of large buffers such as texture content,
+// reads 8 bytes per step which is much faster than HashBytes
+inline uint64_t HashContent(const void* data, size_t size,
+                            uint64_t seed = 14695981039346656037ull) {
+    constexpr uint64_t kMul = 0xc6a4a7935bd1e995ull;
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t       hash  = seed ^ (size * kMul);
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t)) {
+        uint64_t k{};
+        memcpy(&k, bytes, sizeof(k));
+        bytes += sizeof(k);
+
+        k *= kMul;
+        k ^= k >> 47;
+        k *= kMul;
+        hash = (hash ^ k) * kMul;
+    }
+    hash = HashBytes(bytes, size, hash);
+
+    hash ^= hash >> 47;
+    hash *= kMul;
+    hash ^= hash >> 47;
+    return hash;
+}
+
 template <class T>
 inline void HashCombine(std::size_t& s, const T& v) {
     std::hash<T> h;
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "singleton.h"
+
+namespace lumi {
+
+class ThreadPool : public ISingleton<ThreadPool> {
+private:
+    std::vector<std::thread>          workers_{};
+    std::queue<std::function<void()>> tasks_{};
+    std::mutex                        mutex_{};
+    std::condition_variable           cv_{};
+    bool                              quit_ = false;
+
+public:
+    ThreadPool() : ThreadPool(DefaultThreadCount()) {}
+
+    explicit ThreadPool(uint32_t num_threads) {
+        for (uint32_t i = 0; i < num_threads; i++) {
+            workers_.emplace_back([this]() { WorkerLoop(); });
+        }
+    }
+
+    ~ThreadPool() noexcept {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    static uint32_t DefaultThreadCount() {
+        // Leave one core for the main thread
+        uint32_t hw = std::thread::hardware_concurrency();
+        return std::max(hw, 2u) - 1;
+    }
+
+    uint32_t size() const { return (uint32_t)workers_.size(); }
+
+    template <class Func>
+    auto Submit(Func&& func) -> std::future<decltype(func())> {
+        using Result = decltype(func());
+        auto task    = std::make_shared<std::packaged_task<Result()>>(
+            std::forward<Func>(func));
+        std::future<Result> future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace([task]() { (*task)(); });
+        }
+        cv_.notify_one();
+        return future;
+    }
+
+    // Calls func(idx) for idx in [0, count). The calling thread works as well,
+    // so it must not be called from inside a task of the same pool.
+    void ParallelFor(uint32_t                             count,
+                     const std::function<void(uint32_t)>& func) {
+        if (count == 0) return;
+
+        std::atomic<uint32_t> next{0};
+        auto                  run = [&next, count, &func]() {
+            for (uint32_t i = next++; i < count; i = next++) {
+                func(i);
+            }
+        };
+
+        uint32_t helpers = std::min(size(), count - 1);
+        std::vector<std::future<void>> futures{};
+        futures.reserve(helpers);
+        for (uint32_t i = 0; i < helpers; i++) {
+            futures.emplace_back(Submit(run));
+        }
+        run();
+        for (auto& future : futures) {
+            future.wait();
+        }
+    }
+
+private:
+    void WorkerLoop() {
+        while (true) {
+            std::function<void()> task{};
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return quit_ || !tasks_.empty(); });
+                if (quit_ && tasks_.empty()) return;
+
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+};
+
+}  // namespace lumi
@@ -0,0 +1,335 @@
+#include "software_occlusion_culler.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "core/scope_guard.h"
+#include "core/thread_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define LUMI_OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace lumi {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t kTrianglesPerJob = 1024;
+
+float ElapsedMs(Clock::time_point start) {
+    return std::chrono::duration<float, std::milli>(Clock::now() - start)
+        .count();
+}
+
+}  // namespace
+
+void SoftwareOcclusionCuller::Init() {
+    depth_.assign(kWidth * kHeight, 1.0f);
+    hiz_.assign(kTilesX * kTilesY, 1.0f);
+}
+
+void SoftwareOcclusionCuller::BeginFrame(const Mat4x4f& world_to_clip,
+                                         float near, float far) {
+    world_to_clip_ = world_to_clip;
+    near_          = near;
+    far_           = far;
+    stats_         = {};
+
+    occluders_.clear();
+    std::fill(depth_.begin(), depth_.end(), 1.0f);
+    std::fill(hiz_.begin(), hiz_.end(), 1.0f);
+}
+
+void SoftwareOcclusionCuller::AddOccluder(
+    const Mat4x4f& object_to_world, const std::vector<vk::Vertex>& vertices,
+    const std::vector<uint32_t>& indices) {
+    auto& occluder          = occluders_.emplace_back();
+    occluder.object_to_clip = world_to_clip_ * object_to_world;
+    occluder.vertices       = &vertices;
+    occluder.indices        = &indices;
+    occluder.first_triangle = stats_.occluder_triangles;
+
+    stats_.occluders++;
+    stats_.occluder_triangles += (uint32_t)(indices.size() / 3);
+}
+
+void SoftwareOcclusionCuller::RasterizeOccluders() {
+    auto start = Clock::now();
+
+    uint32_t triangle_count = stats_.occluder_triangles;
+    triangles_.resize(triangle_count);
+
+    auto& pool = ThreadPool::Instance();
+
+    // Transform and setup triangles
+    uint32_t jobs = (triangle_count + kTrianglesPerJob - 1) / kTrianglesPerJob;
+    pool.ParallelFor(jobs, [this, triangle_count](uint32_t job) {
+        uint32_t begin = job * kTrianglesPerJob;
+        uint32_t end   = std::min(begin + kTrianglesPerJob, triangle_count);
+        SetupTriangles(begin, end);
+    });
+
+    // Each band owns a range of tile rows, so no synchronization is needed
+    uint32_t bands = std::min(pool.size() + 1, kMaxBands);
+    pool.ParallelFor(bands, [this, bands](uint32_t band) {
+        RasterizeBand(band * kTilesY / bands, (band + 1) * kTilesY / bands);
+    });
+
+    for (auto& tri : triangles_) {
+        if (tri.valid) stats_.rasterized_triangles++;
+    }
+    stats_.raster_ms = ElapsedMs(start);
+}
+
+bool SoftwareOcclusionCuller::IsVisible(const Mat4x4f&     object_to_world,
+                                        const BoundingBox& bbox) {
+    auto       start = Clock::now();
+    ScopeGuard guard = [this, start]() { stats_.test_ms += ElapsedMs(start); };
+
+    stats_.occludees++;
+
+    constexpr int   kCorners        = 8;
+    constexpr Vec3f units[kCorners] = {
+        Vec3f(-1.0f, -1.0f, 1.0f),  Vec3f(1.0f, -1.0f, 1.0f),
+        Vec3f(1.0f, 1.0f, 1.0f),    Vec3f(-1.0f, 1.0f, 1.0f),
+        Vec3f(-1.0f, -1.0f, -1.0f), Vec3f(1.0f, -1.0f, -1.0f),
+        Vec3f(1.0f, 1.0f, -1.0f),   Vec3f(-1.0f, 1.0f, -1.0f),
+    };
+
+    Mat4x4f object_to_clip = world_to_clip_ * object_to_world;
+
+    Vec3f min_screen = Vec3f(kPosInf, kPosInf, kPosInf);
+    Vec3f max_screen = Vec3f(kNegInf, kNegInf, kNegInf);
+    int   behind_near = 0;
+    for (int i = 0; i < kCorners; i++) {
+        Vec3f corner = bbox.extent() * units[i] + bbox.center();
+        Vec4f clip   = object_to_clip * Vec4f(corner, 1.0f);
+        if (clip.w < near_) {
+            behind_near++;
+            continue;
+        }
+
+        float inv_w  = 1.0f / clip.w;
+        Vec3f screen = Vec3f((clip.x * inv_w * 0.5f + 0.5f) * kWidth,
+                             (0.5f - clip.y * inv_w * 0.5f) * kHeight,
+                             clip.z * inv_w);
+        min_screen   = glm::min(glm::vec3(min_screen), glm::vec3(screen));
+        max_screen   = glm::max(glm::vec3(max_screen), glm::vec3(screen));
+    }
+
+    if (behind_near == kCorners) {
+        stats_.frustum_culled++;
+        return false;
+    }
+    // The box intersects the near plane, the projected bounds are unreliable
+    if (behind_near > 0) return true;
+
+    if (max_screen.x < 0 || min_screen.x >= kWidth ||  //
+        max_screen.y < 0 || min_screen.y >= kHeight || min_screen.z > 1.0f) {
+        stats_.frustum_culled++;
+        return false;
+    }
+
+    constexpr int32_t kW    = kWidth;
+    constexpr int32_t kH    = kHeight;
+    constexpr int32_t kTile = kTileSize;
+
+    int32_t x0 = std::max((int32_t)std::floor(min_screen.x), 0);
+    int32_t y0 = std::max((int32_t)std::floor(min_screen.y), 0);
+    int32_t x1 = std::min((int32_t)std::floor(max_screen.x), kW - 1);
+    int32_t y1 = std::min((int32_t)std::floor(max_screen.y), kH - 1);
+    float   z  = std::max(min_screen.z, 0.0f);
+
+    for (int32_t ty = y0 / kTile; ty <= y1 / kTile; ty++) {
+        for (int32_t tx = x0 / kTile; tx <= x1 / kTile; tx++) {
+            // The whole tile is nearer than the box
+            if (z > hiz_[ty * kTilesX + tx]) continue;
+
+            // Refine on the pixels covered by both the tile and the box
+            int32_t py0 = std::max(y0, ty * kTile);
+            int32_t py1 = std::min(y1, (ty + 1) * kTile - 1);
+            int32_t px0 = std::max(x0, tx * kTile);
+            int32_t px1 = std::min(x1, (tx + 1) * kTile - 1);
+            for (int32_t y = py0; y <= py1; y++) {
+                for (int32_t x = px0; x <= px1; x++) {
+                    if (z <= depth_[y * kWidth + x]) return true;
+                }
+            }
+        }
+    }
+
+    stats_.occluded++;
+    return false;
+}
+
+void SoftwareOcclusionCuller::SetupTriangles(uint32_t begin, uint32_t end) {
+    // Find the occluder of the first triangle
+    auto it = std::upper_bound(
+        occluders_.begin(), occluders_.end(), begin,
+        [](uint32_t idx, const Occluder& o) { return idx < o.first_triangle; });
+    size_t occluder_idx = (it - occluders_.begin()) - 1;
+
+    for (uint32_t t = begin; t < end; t++) {
+        while (occluder_idx + 1 < occluders_.size() &&
+               t >= occluders_[occluder_idx + 1].first_triangle) {
+            occluder_idx++;
+        }
+        const Occluder& occluder = occluders_[occluder_idx];
+        const uint32_t* indices =
+            occluder.indices->data() + (t - occluder.first_triangle) * 3;
+
+        ScreenTriangle& tri = triangles_[t];
+        tri.valid           = false;
+
+        Vec3f v[3]{};
+        bool  clipped = false;
+        for (int k = 0; k < 3; k++) {
+            const Vec3f& position = (*occluder.vertices)[indices[k]].position;
+            Vec4f clip = occluder.object_to_clip * Vec4f(position, 1.0f);
+            // Skipping triangles which cross the near plane only loses
+            // occlusion, never causes false culling
+            if (clip.w < near_) {
+                clipped = true;
+                break;
+            }
+            float inv_w = 1.0f / clip.w;
+            v[k]        = Vec3f((clip.x * inv_w * 0.5f + 0.5f) * kWidth,
+                                (0.5f - clip.y * inv_w * 0.5f) * kHeight,
+                                clip.z * inv_w);
+        }
+        if (clipped) continue;
+
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) -
+                     (v[1].y - v[0].y) * (v[2].x - v[0].x);
+        if (std::abs(area) < kEps) continue;
+        // Occluders are rasterized double-sided
+        if (area < 0) {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+
+        Vec3f min_v = glm::min(glm::min(glm::vec3(v[0]), glm::vec3(v[1])),
+                               glm::vec3(v[2]));
+        Vec3f max_v = glm::max(glm::max(glm::vec3(v[0]), glm::vec3(v[1])),
+                               glm::vec3(v[2]));
+        if (min_v.z > 1.0f) continue;
+
+        tri.min_x = std::max((int32_t)std::floor(min_v.x), 0);
+        tri.min_y = std::max((int32_t)std::floor(min_v.y), 0);
+        tri.max_x = std::min((int32_t)std::floor(max_v.x), (int32_t)kWidth - 1);
+        tri.max_y =
+            std::min((int32_t)std::floor(max_v.y), (int32_t)kHeight - 1);
+        if (tri.min_x > tri.max_x || tri.min_y > tri.max_y) continue;
+
+        // Edge k goes from v[k] to v[k + 1], positive inside
+        for (int k = 0; k < 3; k++) {
+            const Vec3f& a = v[k];
+            const Vec3f& b = v[(k + 1) % 3];
+            tri.edge_a[k]  = a.y - b.y;
+            tri.edge_b[k]  = b.x - a.x;
+            tri.edge_c[k]  = -(tri.edge_a[k] * a.x + tri.edge_b[k] * a.y);
+        }
+
+        // Barycentric weight of v[k] is the edge opposite to it over the area
+        float inv_area = 1.0f / area;
+        float z0 = v[0].z * inv_area, z1 = v[1].z * inv_area,
+              z2 = v[2].z * inv_area;
+        tri.depth_a =
+            tri.edge_a[1] * z0 + tri.edge_a[2] * z1 + tri.edge_a[0] * z2;
+        tri.depth_b =
+            tri.edge_b[1] * z0 + tri.edge_b[2] * z1 + tri.edge_b[0] * z2;
+        tri.depth_c =
+            tri.edge_c[1] * z0 + tri.edge_c[2] * z1 + tri.edge_c[0] * z2;
+
+        tri.valid = true;
+    }
+}
+
+void SoftwareOcclusionCuller::RasterizeBand(uint32_t tile_row_begin,
+                                            uint32_t tile_row_end) {
+    int32_t row_begin = tile_row_begin * kTileSize;
+    int32_t row_end   = tile_row_end * kTileSize;
+
+    for (auto& tri : triangles_) {
+        if (!tri.valid || tri.max_y < row_begin || tri.min_y >= row_end) {
+            continue;
+        }
+        RasterizeTriangle(tri, std::max(tri.min_y, row_begin),
+                          std::min(tri.max_y + 1, row_end));
+    }
+
+    // Build hierarchical depth of the band
+    for (uint32_t ty = tile_row_begin; ty < tile_row_end; ty++) {
+        for (uint32_t tx = 0; tx < kTilesX; tx++) {
+            float max_depth = 0.0f;
+            for (uint32_t y = ty * kTileSize; y < (ty + 1) * kTileSize; y++) {
+                const float* row = &depth_[y * kWidth + tx * kTileSize];
+                for (uint32_t x = 0; x < kTileSize; x++) {
+                    max_depth = std::max(max_depth, row[x]);
+                }
+            }
+            hiz_[ty * kTilesX + tx] = max_depth;
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::RasterizeTriangle(const ScreenTriangle& tri,
+                                                int32_t               row_begin,
+                                                int32_t               row_end) {
+    // Start at a multiple of 4 so that the SIMD loop never leaves the row
+    int32_t x_begin = tri.min_x & ~3;
+
+    for (int32_t y = row_begin; y < row_end; y++) {
+        float  py  = y + 0.5f;
+        float* row = &depth_[y * kWidth];
+
+#ifdef LUMI_OCCLUSION_SSE2
+        const __m128 zero    = _mm_setzero_ps();
+        const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+        __m128 edge_a[3], edge_row[3];
+        for (int k = 0; k < 3; k++) {
+            edge_a[k]   = _mm_set1_ps(tri.edge_a[k]);
+            edge_row[k] = _mm_set1_ps(tri.edge_b[k] * py + tri.edge_c[k]);
+        }
+        __m128 depth_a   = _mm_set1_ps(tri.depth_a);
+        __m128 depth_row = _mm_set1_ps(tri.depth_b * py + tri.depth_c);
+
+        for (int32_t x = x_begin; x <= tri.max_x; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(edge_a[0], px), edge_row[0]);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(edge_a[1], px), edge_row[1]);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(edge_a[2], px), edge_row[2]);
+            __m128 inside =
+                _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero),
+                                      _mm_cmpge_ps(e1, zero)),
+                           _mm_cmpge_ps(e2, zero));
+
+            __m128 depth  = _mm_add_ps(_mm_mul_ps(depth_a, px), depth_row);
+            __m128 old    = _mm_loadu_ps(row + x);
+            __m128 nearer = _mm_min_ps(old, depth);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer),
+                                             _mm_andnot_ps(inside, old)));
+        }
+#else
+        for (int32_t x = x_begin; x <= tri.max_x; x++) {
+            float px = x + 0.5f;
+            bool  inside = true;
+            for (int k = 0; k < 3; k++) {
+                inside &= tri.edge_a[k] * px + tri.edge_b[k] * py +
+                              tri.edge_c[k] >= 0;
+            }
+            if (!inside) continue;
+
+            float depth = tri.depth_a * px + tri.depth_b * py + tri.depth_c;
+            row[x]      = std::min(row[x], depth);
+        }
+#endif
+    }
+}
+
+}  // namespace lumi
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "core/math.h"
+#include "function/render/rhi/vulkan_types.h"
+
+namespace lumi {
+
+// Rasterizes occluder triangles into a low resolution depth buffer on the
+// CPU and tests occludee bounding boxes against it.
+// Depth convention follows the camera projection: [0, 1], cleared to 1.
+class SoftwareOcclusionCuller {
+public:
+    constexpr static uint32_t kWidth     = 256;
+    constexpr static uint32_t kHeight    = 128;
+    constexpr static uint32_t kTileSize  = 8;
+    constexpr static uint32_t kTilesX    = kWidth / kTileSize;
+    constexpr static uint32_t kTilesY    = kHeight / kTileSize;
+    constexpr static uint32_t kMaxBands  = kTilesY;
+
+    struct Stats {
+        uint32_t occluders{};
+        uint32_t occluder_triangles{};
+        uint32_t rasterized_triangles{};
+        uint32_t occludees{};
+        uint32_t frustum_culled{};
+        uint32_t occluded{};
+        float    raster_ms{};
+        float    test_ms{};
+    };
+
+private:
+    struct Occluder {
+        Mat4x4f                        object_to_clip{};
+        const std::vector<vk::Vertex>* vertices{};
+        const std::vector<uint32_t>*   indices{};
+        uint32_t                       first_triangle{};
+    };
+
+    // Triangle after setup, edge functions and depth are planes in screen space
+    struct ScreenTriangle {
+        int32_t min_x{}, min_y{}, max_x{}, max_y{};
+        float   edge_a[3]{}, edge_b[3]{}, edge_c[3]{};
+        float   depth_a{}, depth_b{}, depth_c{};
+        bool    valid{};
+    };
+
+    std::vector<Occluder>       occluders_{};
+    std::vector<ScreenTriangle> triangles_{};
+
+    std::vector<float> depth_{};  // kWidth * kHeight
+    std::vector<float> hiz_{};    // kTilesX * kTilesY, max depth of each tile
+
+    Mat4x4f world_to_clip_{};
+    float   near_{};
+    float   far_{};
+
+    Stats stats_{};
+
+public:
+    void Init();
+
+    // Clears the depth buffer and the occluder list
+    void BeginFrame(const Mat4x4f& world_to_clip, float near, float far);
+
+    void AddOccluder(const Mat4x4f&                 object_to_world,
+                     const std::vector<vk::Vertex>& vertices,
+                     const std::vector<uint32_t>&   indices);
+
+    // Rasterizes all added occluders on worker threads and builds the
+    // hierarchical depth buffer
+    void RasterizeOccluders();
+
+    // Conservative test, returns false only if the box is outside the
+    // frustum or fully hidden behind the occluders
+    bool IsVisible(const Mat4x4f& object_to_world, const BoundingBox& bbox);
+
+    const Stats& stats() const { return stats_; }
+
+    const float* depth() const { return depth_.data(); }
+
+    float LinearizeDepth(float depth) const {
+        return near_ * far_ / (far_ - depth * (far_ - near_));
+    }
+
+private:
+    void SetupTriangles(uint32_t begin, uint32_t end);
+
+    void RasterizeBand(uint32_t tile_row_begin, uint32_t tile_row_end);
+
+    void RasterizeTriangle(const ScreenTriangle& tri, int32_t row_begin,
+                           int32_t row_end);
+};
+
+}  // namespace lumi
@@ -0,0 +1,86 @@
+#include "frame_context.h"
+
+namespace lumi {
+
+void FrameLinearAllocator::Init(VulkanRHI* rhi, size_t slice_size,
+                                VkBufferUsageFlags usage,
+                                VmaMemoryUsage memory_usage, size_t alignment) {
+    rhi_        = rhi;
+    alignment_  = alignment;
+    slice_size_ = rhi->PaddedSizeOf(slice_size, alignment);
+    begin_      = 0;
+    head_       = 0;
+
+    buffer_ = rhi->AllocateBuffer(
+        VulkanRHI::kMaxFramesInFlight * slice_size_, usage, memory_usage);
+    data_ = (uint8_t*)rhi->MapMemory(&buffer_);
+}
+
+void FrameLinearAllocator::Finalize() {
+    rhi_->UnmapMemory(&buffer_);
+    rhi_->DestroyBuffer(&buffer_);
+    data_ = nullptr;
+}
+
+void FrameLinearAllocator::Reset(int frame_idx) {
+    begin_ = (size_t)frame_idx * slice_size_;
+    head_  = begin_;
+}
+
+FrameLinearAllocator::Allocation FrameLinearAllocator::Allocate(size_t size) {
+    size_t offset = begin_ + rhi_->PaddedSizeOf(head_ - begin_, alignment_);
+    if (offset + size > begin_ + slice_size_) {
+        return {};
+    }
+    head_ = offset + size;
+
+    return {data_ + offset, buffer_.buffer, (uint32_t)offset};
+}
+
+void FrameLinearAllocator::Flush() {
+    if (head_ == begin_) return;
+    rhi_->FlushMemory(&buffer_, begin_, head_ - begin_);
+}
+
+void FrameContext::Init(VulkanRHI* rhi, size_t uniforms_size,
+                        size_t instances_size) {
+    rhi_ = rhi;
+
+    // Read in place by shaders, small enough to stay in host visible memory
+    uniforms.Init(rhi, uniforms_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                  VMA_MEMORY_USAGE_CPU_TO_GPU, rhi->PaddedSizeOfSSBO(1));
+    instances.Init(rhi, instances_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                   VMA_MEMORY_USAGE_CPU_TO_GPU, rhi->PaddedSizeOfSSBO(1));
+    upload.Init(rhi, kUploadSliceSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VMA_MEMORY_USAGE_CPU_ONLY, 16);
+}
+
+void FrameContext::Finalize() {
+    upload.Finalize();
+    instances.Finalize();
+    uniforms.Finalize();
+}
+
+void FrameContext::Acquire() {
+    // Usually signalled already, the frame pacer waits for it
+    rhi_->WaitForCurrentFrame();
+
+    int frame_idx = rhi_->frame_idx();
+    uniforms.Reset(frame_idx);
+    instances.Reset(frame_idx);
+    upload.Reset(frame_idx);
+
+    acquired_ = true;
+}
+
+void FrameContext::Release() {
+    LOG_ASSERT(acquired_, "Frame context released without being acquired");
+
+    uniforms.Flush();
+    instances.Flush();
+    upload.Flush();
+
+    acquired_ = false;
+}
+
+}  // namespace lumi
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "function/render/rhi/vulkan_rhi.h"
+
+namespace lumi {
+
+// Bump allocator over a persistently mapped buffer holding one slice per
+// frame in flight. Allocations are valid until the slice is reset.
+class FrameLinearAllocator {
+public:
+    struct Allocation {
+        void*    data{};  // Null when the slice is full
+        VkBuffer buffer{};
+        // From the start of the buffer, usable as a dynamic offset
+        uint32_t offset{};
+    };
+
+private:
+    VulkanRHI*          rhi_{};
+    vk::AllocatedBuffer buffer_{};
+    uint8_t*            data_{};
+
+    size_t slice_size_{};
+    size_t alignment_{};
+    size_t begin_{};  // Slice of the current frame
+    size_t head_{};
+
+public:
+    void Init(VulkanRHI* rhi, size_t slice_size, VkBufferUsageFlags usage,
+              VmaMemoryUsage memory_usage, size_t alignment);
+
+    void Finalize();
+
+    // Starts over at the beginning of the slice of the frame
+    void Reset(int frame_idx);
+
+    Allocation Allocate(size_t size);
+
+    // Makes the writes of the frame visible to the device
+    void Flush();
+
+    VkBuffer buffer() const { return buffer_.buffer; }
+
+    size_t used() const { return head_ - begin_; }
+};
+
+// Data the CPU writes for one frame, in slices that no other frame in flight
+// uses. Acquire waits for the fence of the frame, so nothing the GPU may
+// still read is overwritten and the frames before it keep running.
+class FrameContext {
+public:
+    constexpr static size_t kUploadSliceSize = 1 << 20;
+
+    // Storage buffers read by shaders with dynamic offsets
+    FrameLinearAllocator uniforms{};
+    FrameLinearAllocator instances{};
+    // Sources of copies into GPU only buffers, recorded into the frame
+    FrameLinearAllocator upload{};
+
+private:
+    VulkanRHI* rhi_{};
+    bool       acquired_{};
+
+public:
+    void Init(VulkanRHI* rhi, size_t uniforms_size, size_t instances_size);
+
+    void Finalize();
+
+    // Waits for the fence of the current frame, then resets the allocators
+    void Acquire();
+
+    // Flushes the writes, the frame is submitted next
+    void Release();
+
+    bool acquired() const { return acquired_; }
+};
+
+}  // namespace lumi
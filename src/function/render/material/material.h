@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/meta.h"
+#include "function/render/material/material_params_arena.h"
 #include "function/render/rhi/vulkan_utils.h"
 
 namespace lumi {
@@ -11,6 +12,7 @@ enum DescriptorSetSlot {
     kDescriptorSetSlotMaterial = 0,
     kDescriptorSetSlotGlobal,
     kDescriptorSetSlotMeshInstance,
+    kDescriptorSetSlotBindless,
 
     kDescriptorSetSlotsCount
 };
@@ -20,6 +22,12 @@ struct Material {
     VkPipeline        pipeline{};
     VkPipelineLayout  pipeline_layout{};
     bool              double_sided = false;
+    // Samples the bindless texture array, bound once per pipeline
+    bool              bindless     = false;
+
+    // Slot in the params arena of the material type, pushed as a constant to
+    // the fragment stage when the material is bound
+    uint32_t params_index = MaterialParamsArena::kInvalidIndex;
 
     virtual void CreateDescriptorSet(RenderResource* resource) = 0;
 
@@ -29,6 +37,14 @@ struct Material {
     
     virtual void Upload(RenderResource* resource) = 0;
 
+    // Recreates the pipeline if the variant it was built for is outdated,
+    // called once per frame
+    virtual void UpdatePipeline(RenderResource* resource) {}
+
+    // Returns what the material holds in shared resources, called once no
+    // frame in flight may use the material
+    virtual void Release(RenderResource* resource) {}
+
 protected:
     virtual void EditDescriptorSet(RenderResource* resource,
                                    bool            update_only) = 0;
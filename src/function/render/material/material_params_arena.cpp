@@ -0,0 +1,103 @@
+#include "material_params_arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lumi {
+
+void MaterialParamsArena::Init(VulkanRHI* rhi, uint32_t stride,
+                               uint32_t capacity) {
+    rhi_      = rhi;
+    stride_   = stride;
+    capacity_ = capacity;
+    count_    = 0;
+
+    buffer_ = rhi->AllocateBuffer(
+        size(),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY);
+    data_.assign(size(), 0);
+
+    dirty_indices_.clear();
+    dirty_flags_.assign(capacity, false);
+    free_indices_.clear();
+}
+
+void MaterialParamsArena::Finalize() {
+    rhi_->DestroyBuffer(&buffer_);
+    data_.clear();
+}
+
+uint32_t MaterialParamsArena::Allocate() {
+    if (!free_indices_.empty()) {
+        uint32_t index = free_indices_.back();
+        free_indices_.pop_back();
+        return index;
+    }
+    if (count_ >= capacity_) return kInvalidIndex;
+    return count_++;
+}
+
+void MaterialParamsArena::Free(uint32_t index) {
+    if (index >= count_) return;
+    free_indices_.push_back(index);
+}
+
+void MaterialParamsArena::MarkDirty(uint32_t index) {
+    if (index >= count_ || dirty_flags_[index]) return;
+    dirty_flags_[index] = true;
+    dirty_indices_.push_back(index);
+}
+
+uint32_t MaterialParamsArena::CmdFlush(VkCommandBuffer       cmd,
+                                       FrameLinearAllocator& upload) {
+    if (dirty_indices_.empty()) return 0;
+
+    // Adjacent slots are copied as one range
+    std::sort(dirty_indices_.begin(), dirty_indices_.end());
+
+    std::vector<VkBufferCopy> copies{};
+    VkBuffer                  src_buffer = VK_NULL_HANDLE;
+    size_t                    flushed    = 0;
+    for (; flushed < dirty_indices_.size(); flushed++) {
+        uint32_t     index  = dirty_indices_[flushed];
+        VkDeviceSize offset = (VkDeviceSize)index * stride_;
+
+        auto staging = upload.Allocate(stride_);
+        if (staging.data == nullptr) break;
+        memcpy(staging.data, data_.data() + offset, stride_);
+        src_buffer = staging.buffer;
+
+        // Adjacent in both buffers, the last range grows
+        if (!copies.empty() &&
+            copies.back().srcOffset + copies.back().size == staging.offset &&
+            copies.back().dstOffset + copies.back().size == offset) {
+            copies.back().size += stride_;
+        } else {
+            copies.push_back({staging.offset, offset, stride_});
+        }
+        dirty_flags_[index] = false;
+    }
+    dirty_indices_.erase(dirty_indices_.begin(),
+                         dirty_indices_.begin() + flushed);
+    if (copies.empty()) return 0;
+
+    // Frames still in flight read the old params, the copy waits for them
+    VkPipelineStageFlags shader_stages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    vkCmdPipelineBarrier(cmd, shader_stages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, 0, nullptr);
+
+    vkCmdCopyBuffer(cmd, src_buffer, buffer_.buffer, (uint32_t)copies.size(),
+                    copies.data());
+
+    VkMemoryBarrier barrier{};
+    barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, shader_stages, 0,
+                         1, &barrier, 0, nullptr, 0, nullptr);
+    return (uint32_t)copies.size();
+}
+
+}  // namespace lumi
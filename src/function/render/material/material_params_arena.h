@@ -0,0 +1,61 @@
+#pragma once
+
+#include "function/render/frame/frame_context.h"
+
+namespace lumi {
+
+// Parameters of all materials of one type, packed into a single storage
+// buffer and indexed by the material ID in shaders.
+// Slots are written in a CPU copy. Dirty slots are merged into ranges, staged
+// in the upload slice of the frame and copied by the frame's commands.
+class MaterialParamsArena {
+public:
+    constexpr static uint32_t kInvalidIndex = ~0u;
+
+    // Set holding only the buffer, shared by the materials of the type when
+    // their textures are bindless
+    vk::DescriptorSet descriptor_set{};
+
+private:
+    VulkanRHI*           rhi_{};
+    vk::AllocatedBuffer  buffer_{};
+    std::vector<uint8_t> data_{};
+
+    uint32_t stride_{};
+    uint32_t capacity_{};
+    uint32_t count_{};
+
+    std::vector<uint32_t> dirty_indices_{};
+    std::vector<bool>     dirty_flags_{};
+    std::vector<uint32_t> free_indices_{};
+
+public:
+    void Init(VulkanRHI* rhi, uint32_t stride, uint32_t capacity);
+
+    void Finalize();
+
+    // Returns kInvalidIndex if the arena is full
+    uint32_t Allocate();
+
+    // The slot is reused by a later Allocate, frames that may still read it
+    // must be complete
+    void Free(uint32_t index);
+
+    template <class T>
+    T* Get(uint32_t index) {
+        return (T*)(data_.data() + (size_t)index * stride_);
+    }
+
+    void MarkDirty(uint32_t index);
+
+    // Records the copies before the render passes of the frame. Ranges that
+    // do not fit in the upload slice stay dirty for the next frame.
+    // Returns the number of copied ranges.
+    uint32_t CmdFlush(VkCommandBuffer cmd, FrameLinearAllocator& upload);
+
+    VkBuffer buffer() const { return buffer_.buffer; }
+
+    size_t size() const { return (size_t)stride_ * capacity_; }
+};
+
+}  // namespace lumi
@@ -1,28 +1,39 @@
 #include "pbr_material.h"
 
+#include "function/cvars/cvar_system.h"
 #include "function/render/render_resource.h"
 
 namespace lumi {
 
 void PBRMaterial::CreateDescriptorSet(RenderResource* resource) {
-    auto rhi = resource->rhi;
-
-    params.buffer = rhi->AllocateBuffer(
-        sizeof(Params),
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VMA_MEMORY_USAGE_GPU_ONLY);
-    params.staging_buffer =
-        rhi->AllocateBuffer(sizeof(Params), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                            VMA_MEMORY_USAGE_CPU_ONLY);
-    params.data = (Params*)rhi->MapMemory(&params.staging_buffer);
-    resource->PushDestructor([this, rhi]() {
-        rhi->UnmapMemory(&params.staging_buffer);
-        rhi->DestroyBuffer(&params.staging_buffer);
-        rhi->DestroyBuffer(&params.buffer);
-    });
-
-    // init entire staging buffer
-    (*params.data) = {};
+    params_arena_ = resource->GetMaterialParamsArena(
+        kShaderName, sizeof(Params), kMaxMaterials);
+
+    params_index      = params_arena_->Allocate();
+    owns_params_slot_ = params_index != MaterialParamsArena::kInvalidIndex;
+    if (!owns_params_slot_) {
+        LOG_ERROR("More than {} PBR materials, params are shared",
+                  kMaxMaterials);
+        params_index = 0;
+    }
+    params = params_arena_->Get<Params>(params_index);
+
+    // init the slot, copied to GPU by the next flush
+    (*params) = {};
+    params_arena_->MarkDirty(params_index);
+
+    // Textures are bindless, the params are the only per type binding
+    bindless = true;
+    if (params_arena_->descriptor_set.set == VK_NULL_HANDLE) {
+        auto editor =
+            resource->BeginEditDescriptorSet(&params_arena_->descriptor_set);
+        editor.BindBuffer(kBindingParameters,
+                          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                          VK_SHADER_STAGE_FRAGMENT_BIT,
+                          params_arena_->buffer(), 0, params_arena_->size());
+        editor.Execute(false);
+    }
+    descriptor_set = params_arena_->descriptor_set;
 
     EditDescriptorSet(resource, false);
 }
@@ -30,9 +41,13 @@ void PBRMaterial::CreateDescriptorSet(RenderResource* resource) {
 void PBRMaterial::CreatePipeline(RenderResource* resource,
                                  VkRenderPass    render_pass,
                                  uint32_t        subpass_idx) {
-    VkDevice device = resource->rhi->device();
+    render_pass_ = render_pass;
+    subpass_idx_ = subpass_idx;
+    permutation_ = ComputePermutation();
 
     vk::PipelineBuilder pipeline_builder{};
+    pipeline_builder.specialization_constants.assign(permutation_.begin(),
+                                                     permutation_.end());
 
     VkShaderModule vert =
         resource->CreateShaderModule(kShaderName, kShaderTypeVertex);
@@ -49,14 +64,23 @@ void PBRMaterial::CreatePipeline(RenderResource* resource,
         this->descriptor_set.layout,
         resource->global.descriptor_set.layout,
         resource->mesh_instances.descriptor_set.layout,
+        resource->bindless_textures.descriptor_set.layout,
     };
 
+    // params_index
+    VkPushConstantRange push_constant;
+    push_constant.offset     = 0;
+    push_constant.size       = sizeof(uint32_t);
+    push_constant.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
     auto pipeline_layout_info           = vk::BuildPipelineLayoutCreateInfo();
     pipeline_layout_info.setLayoutCount = (uint32_t)set_layouts.size();
     pipeline_layout_info.pSetLayouts    = set_layouts.data();
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges    = &push_constant;
 
-    VK_CHECK(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
-                                    &this->pipeline_layout));
+    this->pipeline_layout =
+        resource->CreatePipelineLayout(pipeline_layout_info);
     pipeline_builder.pipeline_layout = this->pipeline_layout;
 
     pipeline_builder.vertex_input_info = vk::BuildVertexInputStateCreateInfo();
@@ -92,89 +116,77 @@ void PBRMaterial::CreatePipeline(RenderResource* resource,
         (uint32_t)vertexDescription.bindings.size();
 
     // Finally build pipeline
-    this->pipeline = pipeline_builder.Build(device, render_pass, subpass_idx);
-
-    resource->PushDestructor([this, device]() {
-        vkDestroyPipeline(device, this->pipeline, nullptr);
-        vkDestroyPipelineLayout(device, this->pipeline_layout, nullptr);
-    });
+    resource->CreatePipeline(pipeline_builder, render_pass, subpass_idx,
+                             &this->pipeline);
 }
 
 void PBRMaterial::Upload(RenderResource* resource) {
     EditDescriptorSet(resource, true);
+    UpdatePipeline(resource);
 }
 
-void PBRMaterial::EditDescriptorSet(RenderResource* resource,
-                                    bool            update_only) {
-    auto editor = resource->BeginEditDescriptorSet(&descriptor_set);
-    auto rhi    = resource->rhi;
-
-    // Update textures
-    {
-        vk::Texture* texture = resource->GetTexture(base_color_tex_name);
-        if (texture == nullptr) {
-            texture = resource->GetTexture(kDefaultBaseColorTexName);
-        }
-        VkSampler sampler = resource->GetSampler(texture->sampler_name);
-        editor.BindImage(
-            kBindingBaseColor, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            VK_SHADER_STAGE_FRAGMENT_BIT, sampler, texture->image.image_view,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+void PBRMaterial::UpdatePipeline(RenderResource* resource) {
+    if (ComputePermutation() != permutation_) {
+        CreatePipeline(resource, render_pass_, subpass_idx_);
     }
-    {
-        vk::Texture* texture =
-            resource->GetTexture(metallic_roughness_tex_name);
-        if (texture == nullptr) {
-            texture = resource->GetTexture(kDefaultMetallicRoughnessTexName);
-        }
-        VkSampler sampler = resource->GetSampler(texture->sampler_name);
-        editor.BindImage(kBindingMetallicRoughness,
-                         VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                         VK_SHADER_STAGE_FRAGMENT_BIT, sampler,
-                         texture->image.image_view,
-                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    }
-    {
-        vk::Texture* texture = resource->GetTexture(normal_tex_name);
-        if (texture == nullptr) {
-            texture = resource->GetTexture(kDefaultNormalTexName);
-        }
-        VkSampler sampler = resource->GetSampler(texture->sampler_name);
-        editor.BindImage(
-            kBindingNormal, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            VK_SHADER_STAGE_FRAGMENT_BIT, sampler, texture->image.image_view,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+void PBRMaterial::Release(RenderResource* resource) {
+    if (owns_params_slot_) {
+        params_arena_->Free(params_index);
+        owns_params_slot_ = false;
     }
-    {
-        vk::Texture* texture = resource->GetTexture(occlusion_tex_name);
-        if (texture == nullptr) {
-            texture = resource->GetTexture(kDefaultOcclusionTexName);
+    params       = nullptr;
+    params_index = MaterialParamsArena::kInvalidIndex;
+}
+
+PBRMaterial::Permutation PBRMaterial::ComputePermutation() const {
+    static CVarInt debug_view       = cvars::GetInt("debug.shading");
+    static CVarInt shadow_pcf_range = cvars::GetInt("shadow.pcf_range");
+
+    Permutation res{};
+    res[kSpecConstantDebugView]      = (uint32_t)debug_view.value();
+    res[kSpecConstantAlphaMode]      = (uint32_t)params->alpha_mode;
+    res[kSpecConstantHasNormalTex]   = normal_tex_name != kDefaultNormalTexName;
+    res[kSpecConstantShadowPCFRange] = (uint32_t)shadow_pcf_range.value();
+
+    const int32_t texcoord_sets[] = {
+        params->texcoord_set_base_color,
+        params->texcoord_set_occlusion_roughness_metallic,
+        params->texcoord_set_normal,
+        params->texcoord_set_emissive,
+    };
+    for (uint32_t i = 0; i < kTextureSlotCount; i++) {
+        if (texcoord_sets[i] > 0) {
+            res[kSpecConstantTexcoordSetMask] |= 1u << i;
         }
-        VkSampler sampler = resource->GetSampler(texture->sampler_name);
-        editor.BindImage(
-            kBindingOcclusion, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            VK_SHADER_STAGE_FRAGMENT_BIT, sampler, texture->image.image_view,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     }
-    {
-        vk::Texture* texture = resource->GetTexture(emissive_tex_name);
+    return res;
+}
+
+void PBRMaterial::EditDescriptorSet(RenderResource* resource,
+                                    bool            update_only) {
+    // Resolve the textures to their slots in the bindless array
+    auto get_index = [resource](const std::string& name,
+                                const char*        default_name) {
+        vk::Texture* texture = resource->GetTexture(name);
         if (texture == nullptr) {
-            texture = resource->GetTexture(kDefaultEmissiveTexName);
+            texture = resource->GetTexture(default_name);
         }
-        VkSampler sampler = resource->GetSampler(texture->sampler_name);
-        editor.BindImage(
-            kBindingEmissive, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            VK_SHADER_STAGE_FRAGMENT_BIT, sampler, texture->image.image_view,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    }
-
-    // Update buffer
-    rhi->CopyBuffer(&params.staging_buffer, &params.buffer, sizeof(Params));
-    editor.BindBuffer(kBindingParameters, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                      VK_SHADER_STAGE_FRAGMENT_BIT, params.buffer.buffer, 0,
-                      sizeof(Params));
+        return (int32_t)resource->GetBindlessTextureIndex(texture);
+    };
 
-    editor.Execute(update_only);
+    params->tex_index_base_color =
+        get_index(base_color_tex_name, kDefaultBaseColorTexName);
+    params->tex_index_occlusion_roughness_metallic =
+        get_index(occlusion_roughness_metallic_tex_name,
+                  kDefaultOcclusionRoughnessMetallicTexName);
+    params->tex_index_normal =
+        get_index(normal_tex_name, kDefaultNormalTexName);
+    params->tex_index_emissive =
+        get_index(emissive_tex_name, kDefaultEmissiveTexName);
+
+    params_arena_->MarkDirty(params_index);
 }
 
 }  // namespace lumi
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include "material.h"
 
 namespace lumi {
@@ -12,31 +14,54 @@ struct PBRMaterial : public Material {
     };
 
     enum BindingSlot {
-        kBindingBaseColor = 0,
-        kBindingMetallicRoughness,
-        kBindingNormal,
-        kBindingOcclusion,
-        kBindingEmissive,
-        kBindingTexturesCount,
-
-        kBindingParameters = kBindingTexturesCount,
+        kBindingParameters = 0,
+
         kBindingSlotCount
     };
 
-    constexpr static const char* kDefaultBaseColorTexName         = "white";
-    constexpr static const char* kDefaultMetallicRoughnessTexName = "green";
+    // Textures are indices into the bindless array, stored in the params
+    enum TextureSlot {
+        kTextureBaseColor = 0,
+        kTextureOcclusionRoughnessMetallic,
+        kTextureNormal,
+        kTextureEmissive,
+
+        kTextureSlotCount
+    };
+
+    // Specialization constants of pbr.frag, the value is the constant_id
+    enum SpecConstant {
+        kSpecConstantDebugView = 0,
+        kSpecConstantAlphaMode,
+        kSpecConstantHasNormalTex,
+        kSpecConstantTexcoordSetMask,  // bit i set: texture i uses texcoord1
+        kSpecConstantShadowPCFRange,
+
+        kSpecConstantCount
+    };
+    using Permutation = std::array<uint32_t, kSpecConstantCount>;
+
+    constexpr static const char* kDefaultBaseColorTexName = "white";
     constexpr static const char* kDefaultNormalTexName    = "normal_default";
-    constexpr static const char* kDefaultOcclusionTexName = "white";
     constexpr static const char* kDefaultEmissiveTexName  = "black";
     constexpr static const char* kShaderName              = "pbr";
 
+    // Capacity of the params arena shared by all PBR materials
+    constexpr static uint32_t kMaxMaterials = 4096;
+
+    // Occlusion in R, roughness in G and metallic in B, packed at import
+    constexpr static const char* kDefaultOcclusionRoughnessMetallicTexName =
+        "orm_default";
+
     struct Params {
-        int32_t texcoord_set_base_color         = 0;
-        int32_t texcoord_set_metallic_roughness = 0;
-        int32_t texcoord_set_normal             = 0;
-        int32_t texcoord_set_occlusion          = 0;
-        int32_t texcoord_set_emissive           = 0;
-        int32_t _padding_texcoord_set[3];
+        int32_t texcoord_set_base_color                   = 0;
+        int32_t texcoord_set_occlusion_roughness_metallic = 0;
+        int32_t texcoord_set_normal                       = 0;
+        int32_t texcoord_set_emissive                     = 0;
+        int32_t tex_index_base_color                      = 0;
+        int32_t tex_index_occlusion_roughness_metallic    = 0;
+        int32_t tex_index_normal                          = 0;
+        int32_t tex_index_emissive                        = 0;
 
         int32_t alpha_mode        = kAlphaModeOpaque;
         float   alpha_cutoff      = 1.0f;
@@ -46,17 +71,14 @@ struct PBRMaterial : public Material {
         Vec4f   emissive_factor   = Vec4f(1.0f);
     };
 
-    struct ParamsPack {
-        Params*             data{};
-        vk::AllocatedBuffer staging_buffer{};
-        vk::AllocatedBuffer buffer{};
-    } params{};
+    // Mapped slot in the params arena, call Upload after writing
+    Params* params{};
 
-    std::string base_color_tex_name         = kDefaultBaseColorTexName;
-    std::string metallic_roughness_tex_name = kDefaultMetallicRoughnessTexName;
-    std::string normal_tex_name             = kDefaultNormalTexName;
-    std::string occlusion_tex_name          = kDefaultOcclusionTexName;
-    std::string emissive_tex_name           = kDefaultEmissiveTexName;
+    std::string base_color_tex_name = kDefaultBaseColorTexName;
+    std::string occlusion_roughness_metallic_tex_name =
+        kDefaultOcclusionRoughnessMetallicTexName;
+    std::string normal_tex_name   = kDefaultNormalTexName;
+    std::string emissive_tex_name = kDefaultEmissiveTexName;
 
     virtual void CreateDescriptorSet(RenderResource* resource) override;
 
@@ -66,9 +88,25 @@ struct PBRMaterial : public Material {
 
     virtual void Upload(RenderResource* resource) override;
 
+    virtual void UpdatePipeline(RenderResource* resource) override;
+
+    virtual void Release(RenderResource* resource) override;
+
 protected:
     virtual void EditDescriptorSet(RenderResource* resource,
                                    bool            update_only) override;
+
+private:
+    MaterialParamsArena* params_arena_{};
+    // False when the arena was full and slot 0 is shared
+    bool                 owns_params_slot_{};
+
+    // Variant of the current pipeline, from params and debug cvars
+    Permutation  permutation_{};
+    VkRenderPass render_pass_{};
+    uint32_t     subpass_idx_{};
+
+    Permutation ComputePermutation() const;
 };
 
 META(PBRMaterial) {
@@ -11,8 +11,6 @@ void SkyboxMaterial::CreateDescriptorSet(RenderResource* resource) {
 void SkyboxMaterial::CreatePipeline(RenderResource* resource,
                                     VkRenderPass    render_pass,
                                     uint32_t        subpass_idx) {
-    VkDevice device = resource->rhi->device();
-
     vk::PipelineBuilder pipeline_builder{};
 
     // Shaders
@@ -47,8 +45,8 @@ void SkyboxMaterial::CreatePipeline(RenderResource* resource,
     pipeline_layout_info.pPushConstantRanges    = &push_constant;
     pipeline_layout_info.pushConstantRangeCount = 1;
 
-    VK_CHECK(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
-                                    &this->pipeline_layout));
+    this->pipeline_layout =
+        resource->CreatePipelineLayout(pipeline_layout_info);
     pipeline_builder.pipeline_layout = this->pipeline_layout;
 
     pipeline_builder.vertex_input_info = vk::BuildVertexInputStateCreateInfo();
@@ -84,12 +82,8 @@ void SkyboxMaterial::CreatePipeline(RenderResource* resource,
         (uint32_t)vertexDescription.bindings.size();
 
     // Finally build pipeline
-    this->pipeline = pipeline_builder.Build(device, render_pass, subpass_idx);
-
-    resource->PushDestructor([this, device]() {
-        vkDestroyPipeline(device, this->pipeline, nullptr);
-        vkDestroyPipelineLayout(device, this->pipeline_layout, nullptr);
-    });
+    resource->CreatePipeline(pipeline_builder, render_pass, subpass_idx,
+                             &this->pipeline);
 }
 
 void SkyboxMaterial::Upload(RenderResource* resource) {
@@ -102,17 +96,6 @@ void SkyboxMaterial::EditDescriptorSet(RenderResource* resource,
     auto rhi    = resource->rhi;
 
     // Update textures
-    {
-        vk::Texture* texture = resource->GetTexture(irradiance_cubemap_name);
-        if (texture == nullptr) {
-            texture = resource->GetTexture(kDefaultSkyboxTexName);
-        }
-        VkSampler sampler = resource->GetSampler(texture->sampler_name);
-        editor.BindImage(
-            kBindingSkyboxIrradiance, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            VK_SHADER_STAGE_FRAGMENT_BIT, sampler, texture->image.image_view,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    }
     {
         vk::Texture* texture = resource->GetTexture(specular_cubemap_name);
         if (texture == nullptr) {
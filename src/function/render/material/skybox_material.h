@@ -6,8 +6,7 @@ namespace lumi {
 
 struct SkyboxMaterial : public Material {
     enum BindingSlot {
-        kBindingSkyboxIrradiance = 0,
-        kBindingSkyboxSpecular,
+        kBindingSkyboxSpecular = 0,
 
         kBindingSlotCount
     };
@@ -15,8 +14,7 @@ struct SkyboxMaterial : public Material {
     constexpr static const char* kDefaultSkyboxTexName = "skybox_empty";
     constexpr static const char* kShaderName           = "skybox";
 
-    std::string irradiance_cubemap_name = kDefaultSkyboxTexName;
-    std::string specular_cubemap_name   = kDefaultSkyboxTexName;
+    std::string specular_cubemap_name = kDefaultSkyboxTexName;
 
     virtual void CreateDescriptorSet(RenderResource* resource) override;
 
@@ -11,8 +11,6 @@ void UnlitMaterial::CreateDescriptorSet(RenderResource* resource) {
 void UnlitMaterial::CreatePipeline(RenderResource* resource,
                                    VkRenderPass    render_pass,
                                    uint32_t        subpass_idx) {
-    VkDevice device = resource->rhi->device();
-
     vk::PipelineBuilder pipeline_builder{};
 
     VkShaderModule vert =
@@ -36,8 +34,8 @@ void UnlitMaterial::CreatePipeline(RenderResource* resource,
     pipeline_layout_info.setLayoutCount = (uint32_t)set_layouts.size();
     pipeline_layout_info.pSetLayouts    = set_layouts.data();
 
-    VK_CHECK(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
-                                    &this->pipeline_layout));
+    this->pipeline_layout =
+        resource->CreatePipelineLayout(pipeline_layout_info);
     pipeline_builder.pipeline_layout = this->pipeline_layout;
 
     pipeline_builder.vertex_input_info = vk::BuildVertexInputStateCreateInfo();
@@ -73,12 +71,8 @@ void UnlitMaterial::CreatePipeline(RenderResource* resource,
         (uint32_t)vertexDescription.bindings.size();
 
     // Finally build pipeline
-    this->pipeline = pipeline_builder.Build(device, render_pass, subpass_idx);
-
-    resource->PushDestructor([this, device]() {
-        vkDestroyPipeline(device, this->pipeline, nullptr);
-        vkDestroyPipelineLayout(device, this->pipeline_layout, nullptr);
-    });
+    resource->CreatePipeline(pipeline_builder, render_pass, subpass_idx,
+                             &this->pipeline);
 }
 
 void UnlitMaterial::Upload(RenderResource* resource) {
@@ -0,0 +1,84 @@
+#include "frame_pacer.h"
+
+#include <thread>
+
+#include "function/cvars/cvar_system.h"
+
+namespace lumi {
+
+namespace {
+
+constexpr float kSmoothing = 0.1f;
+
+float ToMilliseconds(FramePacer::Clock::duration duration) {
+    return std::chrono::duration<float, std::milli>(duration).count();
+}
+
+void Smooth(float& average, float value) {
+    average = average == 0.f ? value : average + (value - average) * kSmoothing;
+}
+
+}  // namespace
+
+void FramePacer::Init(std::shared_ptr<VulkanRHI> rhi) {
+    rhi_        = rhi;
+    last_begin_ = Clock::now();
+}
+
+void FramePacer::BeginFrame() {
+    static CVarInt  fps_limit   = cvars::GetInt("pacing.fps_limit");
+    static CVarBool low_latency = cvars::GetBool("pacing.low_latency");
+
+    Clock::time_point wait_begin = Clock::now();
+
+    // Waiting for the frame here keeps it out of the CPU time, the RHI finds
+    // the fence signalled. Latency mode waits for the newest frame instead,
+    // nothing is queued when input is sampled.
+    if (low_latency.value()) {
+        rhi_->WaitForLastSubmittedFrame();
+    } else {
+        rhi_->WaitForCurrentFrame();
+    }
+
+    // Before the limiter sleeps, the fence was just seen signalled
+    MeasureLatency();
+
+    if (fps_limit.value() > 0) {
+        auto interval = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / fps_limit.value()));
+        std::this_thread::sleep_until(last_begin_ + interval);
+    }
+
+    begin_ = Clock::now();
+    Smooth(timings_.wait, ToMilliseconds(begin_ - wait_begin));
+    Smooth(timings_.frame, ToMilliseconds(begin_ - last_begin_));
+    last_begin_ = begin_;
+
+    frame_idx_        = rhi_->frame_idx();
+    submitted_frames_ = rhi_->submitted_frames();
+}
+
+void FramePacer::EndFrame() {
+    Smooth(timings_.cpu, ToMilliseconds(Clock::now() - begin_));
+    Smooth(timings_.gpu, rhi_->gpu_frame_time());
+
+    // Nothing is submitted when the swapchain has to be recreated
+    if (rhi_->submitted_frames() != submitted_frames_) {
+        frames_[frame_idx_].input_time = begin_;
+        frames_[frame_idx_].pending    = true;
+    }
+    MeasureLatency();
+}
+
+void FramePacer::MeasureLatency() {
+    Clock::time_point now = Clock::now();
+    for (int i = 0; i < VulkanRHI::kMaxFramesInFlight; i++) {
+        auto& frame = frames_[i];
+        if (!frame.pending || !rhi_->IsFrameComplete(i)) continue;
+
+        Smooth(timings_.latency, ToMilliseconds(now - frame.input_time));
+        frame.pending = false;
+    }
+}
+
+}  // namespace lumi
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+
+#include "function/render/rhi/vulkan_rhi.h"
+
+namespace lumi {
+
+// Paces the main loop around the frames in flight.
+// BeginFrame waits until the next frame may start and runs before input is
+// polled. In latency mode it waits for the GPU to finish the last submitted
+// frame, so input is sampled as late as possible at the cost of CPU/GPU
+// overlap. pacing.fps_limit caps the frame rate in both modes.
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Averaged over recent frames, in milliseconds
+    struct Timings {
+        float frame{};    // Begin to begin
+        float wait{};     // Spent in BeginFrame, mostly waiting for the GPU
+        float cpu{};      // Input sampled to the frame submitted
+        float gpu{};      // Timestamps around the frame's commands
+        float latency{};  // Input sampled to the frame's fence signalled
+    };
+
+private:
+    std::shared_ptr<VulkanRHI> rhi_{};
+
+    struct {
+        Clock::time_point input_time{};
+        bool              pending{};  // Submitted, latency not measured yet
+    } frames_[VulkanRHI::kMaxFramesInFlight] = {};
+
+    Clock::time_point last_begin_{};
+    Clock::time_point begin_{};
+    int               frame_idx_{};
+    uint64_t          submitted_frames_{};
+
+    Timings timings_{};
+
+public:
+    void Init(std::shared_ptr<VulkanRHI> rhi);
+
+    void BeginFrame();
+
+    // Call after the frame is submitted
+    void EndFrame();
+
+    const Timings& timings() const { return timings_; }
+
+private:
+    // Fences are only polled, the latency is exact when BeginFrame waited
+    // on the fence and an upper bound otherwise
+    void MeasureLatency();
+};
+
+}  // namespace lumi
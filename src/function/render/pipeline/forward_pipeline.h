@@ -2,45 +2,36 @@
 
 #include "pass/present_pass.h"
 #include "pass/shadow_pass.h"
+#include "render_graph.h"
 #include "render_pipeline.h"
 
 namespace lumi {
 
 class ForwardPipeline : public RenderPipeline {
 private:
-    std::shared_ptr<ShadowPass>  shadow_pass_{};
-    std::shared_ptr<PresentPass> present_pass_{};
+    std::shared_ptr<RenderGraph> graph_{};
 
 public:
     using RenderPipeline::RenderPipeline;
 
     virtual void Init() override {
-        shadow_pass_ = std::make_shared<ShadowPass>(rhi, resource);
-        shadow_pass_->Init();
+        graph_ = std::make_shared<RenderGraph>(rhi, resource);
 
-        present_pass_ = std::make_shared<PresentPass>(rhi, resource);
-        present_pass_->Init();
-    }
+        graph_->AddPass("Shadow", std::make_shared<ShadowPass>(rhi, resource));
 
-    virtual void Finalize() override { 
-        shadow_pass_->Finalize(); 
+        graph_->AddPass("Present",
+                        std::make_shared<PresentPass>(rhi, resource));
 
-        present_pass_->Finalize(); 
+        graph_->Compile();
     }
 
-    virtual void CmdRender(VkCommandBuffer cmd) override {
-        shadow_pass_->CmdBeginRenderPass(cmd);
-        shadow_pass_->CmdRender(cmd);
-        shadow_pass_->CmdEndRenderPass(cmd);
+    virtual void Finalize() override { graph_->Finalize(); }
 
-        present_pass_->CmdBeginRenderPass(cmd);
-        present_pass_->CmdRender(cmd);
-        present_pass_->CmdEndRenderPass(cmd);
+    virtual void CmdRender(vk::CommandRecorder& recorder) override {
+        graph_->CmdExecute(recorder);
     }
 
-    virtual void RecreateSwapchain() override {
-        present_pass_->RecreateSwapchain();
-    }
+    virtual void RecreateSwapchain() override { graph_->RecreateSwapchain(); }
 };
 
 }  // namespace lumi
\ No newline at end of file
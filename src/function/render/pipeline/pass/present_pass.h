@@ -10,15 +10,6 @@ namespace lumi {
 
 class PresentPass : public RenderPass {
 private:
-    enum AttachmentIndex {
-        kAttachmentSwapchain = 0,
-        kAttachmentDepth,
-
-        kAttachmentCount
-    };
-
-    std::shared_ptr<vk::Texture> depth_attachment_{};
-
     enum SubpassIndex {
         kSubpassMeshLighting = 0,
         kSubpassSkybox,
@@ -31,43 +22,25 @@ private:
     std::shared_ptr<SkyboxSubpass>       skybox_pass_{};
     std::shared_ptr<ImGuiSubpass>        imgui_pass_{};
 
-    std::vector<VkFramebuffer> framebuffers_{};
-    vk::DestructorQueue        dtor_queue_swapchain_{};
-    vk::DestructorQueue        dtor_queue_present_{};
-
 public:
     using RenderPass::RenderPass;
 
-    virtual void CmdRender(VkCommandBuffer cmd) {
-        mesh_lighting_pass_->CmdRender(cmd);
+    virtual void CmdRender(vk::CommandRecorder& recorder) {
+        mesh_lighting_pass_->CmdRender(recorder);
 
-        vkCmdNextSubpass(cmd, VK_SUBPASS_CONTENTS_INLINE);
-        skybox_pass_->CmdRender(cmd);
+        vkCmdNextSubpass(recorder.cmd(), VK_SUBPASS_CONTENTS_INLINE);
+        skybox_pass_->CmdRender(recorder);
 
-        vkCmdNextSubpass(cmd, VK_SUBPASS_CONTENTS_INLINE);
-        imgui_pass_->CmdRender(cmd);
+        vkCmdNextSubpass(recorder.cmd(), VK_SUBPASS_CONTENTS_INLINE);
+        imgui_pass_->CmdRender(recorder);
     }
 
     virtual void Finalize() override;
 
-    virtual VkExtent2D GetExtent() override;
-
-    void RecreateSwapchain();
-
 protected:
-    virtual void PreInit() override;
-
-    virtual void PostInit() override;
-
-    virtual void CreateAttachmentImages() override;
-
-    virtual void CreateRenderPass() override;
-
-    virtual void CreateFrameBuffers() override;
-
-    virtual void SetClearValues() override;
+    virtual void Setup(RenderGraph::PassBuilder& builder) override;
 
-    virtual VkFramebuffer GetFramebuffer() override;
+    virtual void Init() override;
 };
 
 }  // namespace lumi
\ No newline at end of file
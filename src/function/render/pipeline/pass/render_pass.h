@@ -1,5 +1,6 @@
 #pragma once
 
+#include "function/render/pipeline/render_graph.h"
 #include "function/render/pipeline/subpass/render_subpass.h"
 
 namespace lumi {
@@ -7,14 +8,18 @@ namespace lumi {
 class VulkanRHI;
 class RenderResource;
 
+// Node of the render graph. The VkRenderPass, attachments and framebuffers
+// are created by the graph from what Setup declares.
 class RenderPass {
+    friend class RenderGraph;
+
 public:
     std::shared_ptr<VulkanRHI> rhi{};
     std::shared_ptr<RenderResource> resource{};
 
 protected:
-    std::vector<VkClearValue>  clear_values_{};
-    VkRenderPass               vk_render_pass_{};
+    VkRenderPass vk_render_pass_{};
+    VkExtent2D   extent_{};
 
 public:
     RenderPass(std::shared_ptr<VulkanRHI>      rhi,
@@ -23,55 +28,19 @@ public:
 
     VkRenderPass vk_render_pass() const { return vk_render_pass_; }
 
-    void Init() {
-        PreInit();
-        SetClearValues();
-
-        CreateAttachmentImages();
-        CreateRenderPass();
-        CreateFrameBuffers();
-
-        PostInit();
-    }
+    const VkExtent2D& GetExtent() const { return extent_; }
 
-    void CmdBeginRenderPass(VkCommandBuffer cmd) {
-        VkRenderPassBeginInfo info{};
-        info.sType               = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        info.pNext               = nullptr;
-        info.renderPass          = vk_render_pass_;
-        info.renderArea.offset.x = 0;
-        info.renderArea.offset.y = 0;
-        info.renderArea.extent   = GetExtent();
-        info.framebuffer         = GetFramebuffer();
-        info.clearValueCount     = (uint32_t)clear_values_.size();
-        info.pClearValues        = clear_values_.data();
-        vkCmdBeginRenderPass(cmd, &info, VK_SUBPASS_CONTENTS_INLINE);
-    }
-
-    void CmdEndRenderPass(VkCommandBuffer cmd) {
-        vkCmdEndRenderPass(cmd);
-    }
-
-    virtual void CmdRender(VkCommandBuffer cmd) = 0;
+    // Called by the graph inside the render pass
+    virtual void CmdRender(vk::CommandRecorder& recorder) = 0;
 
     virtual void Finalize() = 0;
 
-    virtual VkExtent2D GetExtent() = 0;
-
 protected:
-    virtual void PreInit() = 0;
-
-    virtual void PostInit() = 0;
-
-    virtual void CreateAttachmentImages() = 0;
-
-    virtual void CreateRenderPass() = 0;
-
-    virtual void CreateFrameBuffers() = 0;
-
-    virtual void SetClearValues() = 0;
+    // Declares the textures and subpasses of the pass
+    virtual void Setup(RenderGraph::PassBuilder& builder) = 0;
 
-    virtual VkFramebuffer GetFramebuffer() = 0;
+    // The render pass is created, subpasses can create their pipelines
+    virtual void Init() = 0;
 };
 
 }  // namespace lumi
\ No newline at end of file
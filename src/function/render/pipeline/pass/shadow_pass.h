@@ -8,18 +8,6 @@ namespace lumi {
 
 class ShadowPass : public RenderPass {
 private:
-    enum AttachmentIndex {
-        kAttachmentDirectional = 0,
-        //kAttachmentPoint,
-
-        kAttachmentCount
-    };
-
-    struct {
-        std::shared_ptr<vk::Texture> directional_shadow_map_{};
-    } attachments_;
-
-
     enum SubpassIndex {
         kSubpassDirectional = 0,
         //kSubpassPoint,
@@ -31,38 +19,22 @@ private:
 
     std::shared_ptr<DirectionalShadowSubpass> directional_shadow_pass_{};
 
-    VkFramebuffer framebuffer_{};
-
-    vk::DestructorQueue dtor_queue_shadow_{};
-
 public:
     constexpr static const char* kDirectionalShadowMapName =
         "_shadow_map_directional";
 
     using RenderPass::RenderPass;
 
-    virtual void CmdRender(VkCommandBuffer cmd) {
-        directional_shadow_pass_->CmdRender(cmd);
+    virtual void CmdRender(vk::CommandRecorder& recorder) {
+        directional_shadow_pass_->CmdRender(recorder);
     }
 
-    virtual void Finalize() override;
-
-    virtual VkExtent2D GetExtent() override;
+    virtual void Finalize() override {}
 
 protected:
-    virtual void PreInit() override;
-
-    virtual void PostInit() override;
-
-    virtual void CreateAttachmentImages() override;
-
-    virtual void CreateRenderPass() override;
-
-    virtual void CreateFrameBuffers() override;
-
-    virtual void SetClearValues() override;
+    virtual void Setup(RenderGraph::PassBuilder& builder) override;
 
-    virtual VkFramebuffer GetFramebuffer() override;
+    virtual void Init() override;
 };
 
 }  // namespace lumi
\ No newline at end of file
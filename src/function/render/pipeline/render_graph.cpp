@@ -0,0 +1,622 @@
+#include "render_graph.h"
+
+#include <algorithm>
+
+#include "function/render/pipeline/pass/render_pass.h"
+#include "function/render/render_resource.h"
+
+namespace lumi {
+
+namespace {
+
+// Stages and accesses that later commands have to wait for
+void GetSrcScope(bool is_depth, bool is_sampled, VkPipelineStageFlags* stage,
+                 VkAccessFlags* access) {
+    if (is_sampled) {
+        // Reads only need an execution dependency
+        *stage  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        *access = 0;
+    } else if (is_depth) {
+        *stage  = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        *access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    } else {
+        *stage  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        *access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    }
+}
+
+void AddDependency(std::vector<VkSubpassDependency>& dependencies,
+                   uint32_t src_subpass, uint32_t dst_subpass,
+                   VkPipelineStageFlags src_stage, VkAccessFlags src_access,
+                   VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+    auto it = std::find_if(dependencies.begin(), dependencies.end(),
+                           [=](const VkSubpassDependency& dependency) {
+                               return dependency.srcSubpass == src_subpass &&
+                                      dependency.dstSubpass == dst_subpass;
+                           });
+    if (it == dependencies.end()) {
+        auto& dependency      = dependencies.emplace_back();
+        dependency.srcSubpass = src_subpass;
+        dependency.dstSubpass = dst_subpass;
+        if (src_subpass != VK_SUBPASS_EXTERNAL &&
+            dst_subpass != VK_SUBPASS_EXTERNAL) {
+            dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        }
+        it = dependencies.end() - 1;
+    }
+    it->srcStageMask |= src_stage;
+    it->srcAccessMask |= src_access;
+    it->dstStageMask |= dst_stage;
+    it->dstAccessMask |= dst_access;
+}
+
+}  // namespace
+
+RenderGraph::TextureHandle RenderGraph::PassBuilder::CreateTexture(
+    const std::string& name, const TextureDesc& desc) {
+    LOG_ASSERT(FindTexture(name) == kInvalidTexture,
+               "Render graph texture {} already exists", name);
+
+    auto& texture   = graph_->textures_.emplace_back();
+    texture.name    = name;
+    texture.desc    = desc;
+    texture.texture = std::make_shared<vk::Texture>();
+    graph_->resource_->RegisterTexture(name, texture.texture);
+    return (TextureHandle)graph_->textures_.size() - 1;
+}
+
+RenderGraph::TextureHandle RenderGraph::PassBuilder::FindTexture(
+    const std::string& name) const {
+    const auto& textures = graph_->textures_;
+    for (TextureHandle i = 0; i < (TextureHandle)textures.size(); i++) {
+        if (textures[i].name == name) return i;
+    }
+    return kInvalidTexture;
+}
+
+void RenderGraph::PassBuilder::Write(TextureHandle       texture,
+                                     const VkClearValue& clear_value) {
+    LOG_ASSERT(texture < graph_->textures_.size(), "Invalid texture {}",
+               texture);
+
+    auto& pass = graph_->passes_[pass_idx_];
+    LOG_ASSERT(std::find(pass.reads.begin(), pass.reads.end(), texture) ==
+                   pass.reads.end(),
+               "Pass {} reads and writes {}", pass.name,
+               graph_->textures_[texture].name);
+
+    auto& attachment       = pass.attachments.emplace_back();
+    attachment.texture     = texture;
+    attachment.clear_value = clear_value;
+}
+
+void RenderGraph::PassBuilder::Read(TextureHandle texture) {
+    LOG_ASSERT(texture < graph_->textures_.size(), "Invalid texture {}",
+               texture);
+
+    auto& pass = graph_->passes_[pass_idx_];
+    LOG_ASSERT(std::none_of(pass.attachments.begin(), pass.attachments.end(),
+                            [texture](const Attachment& attachment) {
+                                return attachment.texture == texture;
+                            }),
+               "Pass {} reads and writes {}", pass.name,
+               graph_->textures_[texture].name);
+
+    pass.reads.emplace_back(texture);
+}
+
+uint32_t RenderGraph::PassBuilder::AddSubpass(const SubpassDesc& desc) {
+    auto& pass     = graph_->passes_[pass_idx_];
+    auto  declared = [&pass](TextureHandle texture) {
+        return std::any_of(pass.attachments.begin(), pass.attachments.end(),
+                           [texture](const Attachment& attachment) {
+                               return attachment.texture == texture;
+                           });
+    };
+    for (TextureHandle texture : desc.color_attachments) {
+        LOG_ASSERT(declared(texture), "Pass {} does not write {}", pass.name,
+                   texture);
+    }
+    LOG_ASSERT(desc.depth_attachment == kInvalidTexture ||
+                   declared(desc.depth_attachment),
+               "Pass {} does not write {}", pass.name, desc.depth_attachment);
+
+    pass.subpasses.emplace_back(desc);
+    return (uint32_t)pass.subpasses.size() - 1;
+}
+
+RenderGraph::RenderGraph(std::shared_ptr<VulkanRHI>      rhi,
+                         std::shared_ptr<RenderResource> resource)
+    : rhi_(rhi), resource_(resource) {
+    auto& swapchain             = textures_.emplace_back();
+    swapchain.name              = "_swapchain";
+    swapchain.desc.aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+void RenderGraph::AddPass(const std::string&          name,
+                          std::shared_ptr<RenderPass> render_pass) {
+    auto& pass       = passes_.emplace_back();
+    pass.name        = name;
+    pass.render_pass = render_pass;
+
+    PassBuilder builder(this, (uint32_t)passes_.size() - 1);
+    render_pass->Setup(builder);
+}
+
+void RenderGraph::Compile() {
+    CullPasses();
+    CollectUses();
+
+    AllocateTextures(false);
+    AllocateTextures(true);
+
+    for (uint32_t i = 0; i < (uint32_t)passes_.size(); i++) {
+        if (IsLive(passes_[i])) CreateRenderPass(i);
+    }
+    CreateFramebuffers();
+
+    for (auto& pass : passes_) {
+        if (IsLive(pass)) pass.render_pass->Init();
+    }
+}
+
+void RenderGraph::Finalize() {
+    for (auto& pass : passes_) {
+        if (IsLive(pass)) pass.render_pass->Finalize();
+    }
+
+    dtor_queue_swapchain_.Flush();
+    dtor_queue_graph_.Flush();
+}
+
+void RenderGraph::CmdExecute(vk::CommandRecorder& recorder) {
+    VkCommandBuffer cmd = recorder.cmd();
+
+    for (auto& pass : passes_) {
+        if (!IsLive(pass)) continue;
+
+        VkFramebuffer framebuffer =
+            pass.writes_swapchain
+                ? pass.framebuffers[rhi_->swapchain_image_idx()]
+                : pass.framebuffers[0];
+
+        VkRenderPassBeginInfo info{};
+        info.sType               = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        info.pNext               = nullptr;
+        info.renderPass          = pass.render_pass->vk_render_pass();
+        info.renderArea.offset.x = 0;
+        info.renderArea.offset.y = 0;
+        info.renderArea.extent   = pass.render_pass->GetExtent();
+        info.framebuffer         = framebuffer;
+        info.clearValueCount     = (uint32_t)pass.clear_values.size();
+        info.pClearValues        = pass.clear_values.data();
+        vkCmdBeginRenderPass(cmd, &info, pass.subpasses[0].contents);
+
+        pass.render_pass->CmdRender(recorder);
+
+        vkCmdEndRenderPass(cmd);
+    }
+}
+
+void RenderGraph::RecreateSwapchain() {
+    rhi_->WaitForAllFrames();
+
+    VkExtent2D extent = rhi_->GetWindowExtent();
+    if (extent.width == 0 || extent.height == 0) return;
+
+    dtor_queue_swapchain_.Flush();
+
+    rhi_->RecreateSwapchain();
+    AllocateTextures(true);
+    CreateFramebuffers();
+}
+
+bool RenderGraph::FollowsSwapchain(TextureHandle texture) const {
+    const auto& desc = textures_[texture].desc;
+    return texture == kSwapchainTexture || desc.width == 0 || desc.height == 0;
+}
+
+VkExtent2D RenderGraph::GetTextureExtent(TextureHandle texture) const {
+    if (FollowsSwapchain(texture)) return rhi_->extent();
+
+    const auto& desc = textures_[texture].desc;
+    return {desc.width, desc.height};
+}
+
+void RenderGraph::CullPasses() {
+    // Walk back from the swapchain, a pass is needed if a needed texture is
+    // one of its attachments
+    std::vector<bool> needed(textures_.size());
+    needed[kSwapchainTexture] = true;
+
+    for (auto it = passes_.rbegin(); it != passes_.rend(); it++) {
+        auto& pass  = *it;
+        pass.culled = std::none_of(pass.attachments.begin(),
+                                   pass.attachments.end(),
+                                   [&needed](const Attachment& attachment) {
+                                       return needed[attachment.texture];
+                                   });
+        if (pass.culled) {
+            LOG_INFO("Render graph culled pass {}", pass.name);
+            continue;
+        }
+
+        for (const auto& attachment : pass.attachments) {
+            needed[attachment.texture] = true;
+        }
+        for (TextureHandle texture : pass.reads) {
+            needed[texture] = true;
+        }
+    }
+}
+
+void RenderGraph::CollectUses() {
+    for (uint32_t i = 0; i < (uint32_t)passes_.size(); i++) {
+        auto& pass = passes_[i];
+        if (!IsLive(pass)) continue;
+
+        for (const auto& attachment : pass.attachments) {
+            auto& texture = textures_[attachment.texture];
+            if (texture.desc.aspect_flags & VK_IMAGE_ASPECT_DEPTH_BIT) {
+                texture.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                texture.uses.push_back({i, Access::kDepthAttachment});
+            } else {
+                texture.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+                texture.uses.push_back({i, Access::kColorAttachment});
+            }
+        }
+        for (TextureHandle handle : pass.reads) {
+            auto& texture = textures_[handle];
+            texture.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+            texture.uses.push_back({i, Access::kSampled});
+        }
+    }
+
+    for (auto& texture : textures_) {
+        if (texture.uses.empty()) continue;
+        LOG_ASSERT(texture.uses[0].access != Access::kSampled,
+                   "Render graph texture {} is read before it is written",
+                   texture.name);
+
+        // Contents never leave the pass, tile based GPUs can keep them in
+        // tile memory
+        if (texture.uses.size() == 1) {
+            texture.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+        }
+    }
+}
+
+void RenderGraph::AllocateTextures(bool follows_swapchain) {
+    struct Memory {
+        VkMemoryRequirements       requirements{};
+        uint32_t                   last_pass_idx{};
+        std::vector<TextureHandle> textures{};
+    };
+
+    std::vector<TextureHandle> handles{};
+    for (TextureHandle i = kSwapchainTexture + 1;
+         i < (TextureHandle)textures_.size(); i++) {
+        if (!textures_[i].uses.empty() &&
+            FollowsSwapchain(i) == follows_swapchain) {
+            handles.emplace_back(i);
+        }
+    }
+    std::stable_sort(handles.begin(), handles.end(),
+                     [this](TextureHandle lhs, TextureHandle rhs) {
+                         return textures_[lhs].uses.front().pass_idx <
+                                textures_[rhs].uses.front().pass_idx;
+                     });
+
+    std::vector<vk::TextureCreateInfo> infos(textures_.size());
+    std::vector<Memory>                memories{};
+    VkDeviceSize                       unaliased_size = 0;
+    for (TextureHandle handle : handles) {
+        const auto& texture = textures_[handle];
+        VkExtent2D  extent  = GetTextureExtent(handle);
+
+        auto& info        = infos[handle];
+        info.width        = extent.width;
+        info.height       = extent.height;
+        info.format       = texture.desc.format;
+        info.image_usage  = texture.usage;
+        info.memory_usage = VMA_MEMORY_USAGE_GPU_ONLY;
+        info.aspect_flags = texture.desc.aspect_flags;
+        info.sampler_name = texture.desc.sampler_name;
+
+        VkMemoryRequirements requirements =
+            rhi_->GetTextureMemoryRequirements(&info);
+        unaliased_size += requirements.size;
+
+        uint32_t first_pass_idx = texture.uses.front().pass_idx;
+        auto     it = std::find_if(
+            memories.begin(), memories.end(),
+            [&requirements, first_pass_idx](const Memory& memory) {
+                return memory.last_pass_idx < first_pass_idx &&
+                       (memory.requirements.memoryTypeBits &
+                        requirements.memoryTypeBits) != 0;
+            });
+        if (it == memories.end()) {
+            memories.push_back({requirements});
+            it = memories.end() - 1;
+        } else {
+            auto& merged = it->requirements;
+            merged.size  = std::max(merged.size, requirements.size);
+            merged.alignment =
+                std::max(merged.alignment, requirements.alignment);
+            merged.memoryTypeBits &= requirements.memoryTypeBits;
+        }
+        it->last_pass_idx = texture.uses.back().pass_idx;
+        it->textures.emplace_back(handle);
+    }
+
+    auto& dtor_queue =
+        follows_swapchain ? dtor_queue_swapchain_ : dtor_queue_graph_;
+
+    VkDeviceSize aliased_size = 0;
+    for (const auto& memory : memories) {
+        VmaAllocation allocation =
+            rhi_->AllocateAliasedMemory(memory.requirements);
+        aliased_size += memory.requirements.size;
+        dtor_queue.Push(
+            [this, allocation]() { rhi_->FreeAliasedMemory(allocation); });
+
+        for (TextureHandle handle : memory.textures) {
+            vk::Texture* texture = textures_[handle].texture.get();
+            rhi_->AllocateAliasedTexture2D(texture, allocation,
+                                           &infos[handle]);
+            dtor_queue.Push(
+                [this, texture]() { rhi_->DestroyAliasedTexture(texture); });
+        }
+    }
+
+    if (!handles.empty()) {
+        LOG_INFO("Render graph textures: {} KB in {} allocations, {} KB "
+                 "without aliasing",
+                 aliased_size / 1024, memories.size(), unaliased_size / 1024);
+    }
+}
+
+void RenderGraph::CreateRenderPass(uint32_t pass_idx) {
+    auto& pass = passes_[pass_idx];
+
+    auto attachment_layout = [](Access access) {
+        return access == Access::kDepthAttachment
+                   ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                   : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    };
+    // Layout that an attachment use leaves the texture in for its next use
+    auto final_layout = [this, &attachment_layout](TextureHandle handle,
+                                                   size_t        use_idx) {
+        const auto& texture = textures_[handle];
+        const Use&  use     = texture.uses[use_idx];
+        if (use_idx + 1 == texture.uses.size()) {
+            return handle == kSwapchainTexture
+                       ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+                       : attachment_layout(use.access);
+        }
+        if (texture.uses[use_idx + 1].access == Access::kSampled) {
+            return use.access == Access::kDepthAttachment
+                       ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                       : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        }
+        return attachment_layout(use.access);
+    };
+    auto find_use = [this, pass_idx](TextureHandle handle) {
+        const auto& uses = textures_[handle].uses;
+        for (size_t i = 0; i < uses.size(); i++) {
+            if (uses[i].pass_idx == pass_idx) return i;
+        }
+        LOG_ASSERT(false, "Pass {} does not use {}", pass_idx, handle);
+        return uses.size();
+    };
+
+    const uint32_t attachment_count = (uint32_t)pass.attachments.size();
+    auto attachment_descs =
+        std::vector<VkAttachmentDescription>(attachment_count);
+    auto use_indices = std::vector<size_t>(attachment_count);
+    pass.clear_values.resize(attachment_count);
+    for (uint32_t i = 0; i < attachment_count; i++) {
+        TextureHandle handle  = pass.attachments[i].texture;
+        const auto&   texture = textures_[handle];
+        const size_t  use_idx = find_use(handle);
+        use_indices[i]        = use_idx;
+
+        // The layout is only changed by attachment uses
+        VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        for (size_t j = use_idx; j-- > 0;) {
+            if (texture.uses[j].access != Access::kSampled) {
+                initial_layout = final_layout(handle, j);
+                break;
+            }
+        }
+        bool is_last = use_idx + 1 == texture.uses.size();
+
+        auto& desc   = attachment_descs[i];
+        desc.flags   = 0;
+        desc.format  = handle == kSwapchainTexture
+                           ? rhi_->swapchain_image_format()
+                           : texture.desc.format;
+        desc.samples = VK_SAMPLE_COUNT_1_BIT;
+        desc.loadOp  = use_idx == 0 ? VK_ATTACHMENT_LOAD_OP_CLEAR
+                                    : VK_ATTACHMENT_LOAD_OP_LOAD;
+        desc.storeOp = is_last && handle != kSwapchainTexture
+                           ? VK_ATTACHMENT_STORE_OP_DONT_CARE
+                           : VK_ATTACHMENT_STORE_OP_STORE;
+        desc.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        desc.initialLayout  = initial_layout;
+        desc.finalLayout    = final_layout(handle, use_idx);
+
+        pass.clear_values[i] = pass.attachments[i].clear_value;
+    }
+
+    auto attachment_index = [&pass](TextureHandle handle) {
+        for (uint32_t i = 0; i < (uint32_t)pass.attachments.size(); i++) {
+            if (pass.attachments[i].texture == handle) return i;
+        }
+        return VK_ATTACHMENT_UNUSED;
+    };
+
+    const uint32_t subpass_count = (uint32_t)pass.subpasses.size();
+    auto subpass_descs = std::vector<VkSubpassDescription>(subpass_count);
+    auto color_refs =
+        std::vector<std::vector<VkAttachmentReference>>(subpass_count);
+    auto depth_refs = std::vector<VkAttachmentReference>(subpass_count);
+    auto subpass_dependencies = std::vector<VkSubpassDependency>();
+    // Last subpass that used each attachment
+    auto last_subpass =
+        std::vector<uint32_t>(attachment_count, VK_SUBPASS_EXTERNAL);
+
+    auto add_use = [&](uint32_t subpass_idx, uint32_t attachment_idx) {
+        TextureHandle handle  = pass.attachments[attachment_idx].texture;
+        const auto&   texture = textures_[handle];
+        const size_t  use_idx = use_indices[attachment_idx];
+        const bool   is_depth =
+            texture.uses[use_idx].access == Access::kDepthAttachment;
+
+        VkPipelineStageFlags dst_stage =
+            is_depth ? VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                           VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+                     : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        VkAccessFlags dst_access =
+            is_depth ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+                     : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                           VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+        VkPipelineStageFlags src_stage{};
+        VkAccessFlags        src_access{};
+        uint32_t             src_subpass = last_subpass[attachment_idx];
+        if (src_subpass != VK_SUBPASS_EXTERNAL) {
+            GetSrcScope(is_depth, false, &src_stage, &src_access);
+        } else if (use_idx > 0) {
+            const Use& prev = texture.uses[use_idx - 1];
+            GetSrcScope(prev.access == Access::kDepthAttachment,
+                        prev.access == Access::kSampled, &src_stage,
+                        &src_access);
+        } else {
+            // Earlier frames, or textures aliasing the same memory
+            src_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            src_access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        }
+        AddDependency(subpass_dependencies, src_subpass, subpass_idx,
+                      src_stage, src_access, dst_stage, dst_access);
+        last_subpass[attachment_idx] = subpass_idx;
+    };
+
+    for (uint32_t s = 0; s < subpass_count; s++) {
+        const auto& subpass = pass.subpasses[s];
+
+        for (TextureHandle handle : subpass.color_attachments) {
+            uint32_t attachment_idx = attachment_index(handle);
+            color_refs[s].push_back(
+                {attachment_idx, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+            add_use(s, attachment_idx);
+        }
+        if (subpass.depth_attachment != kInvalidTexture) {
+            uint32_t attachment_idx =
+                attachment_index(subpass.depth_attachment);
+            depth_refs[s] = {attachment_idx,
+                             VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+            add_use(s, attachment_idx);
+        }
+
+        auto& desc                = subpass_descs[s];
+        desc.pipelineBindPoint    = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        desc.colorAttachmentCount = (uint32_t)color_refs[s].size();
+        desc.pColorAttachments    = color_refs[s].data();
+        desc.pDepthStencilAttachment =
+            subpass.depth_attachment != kInvalidTexture ? &depth_refs[s]
+                                                        : nullptr;
+    }
+
+    // Later passes sample what this pass wrote
+    for (uint32_t i = 0; i < attachment_count; i++) {
+        const auto&  texture = textures_[pass.attachments[i].texture];
+        const size_t use_idx = use_indices[i];
+        if (use_idx + 1 == texture.uses.size() ||
+            texture.uses[use_idx + 1].access != Access::kSampled ||
+            last_subpass[i] == VK_SUBPASS_EXTERNAL) {
+            continue;
+        }
+
+        VkPipelineStageFlags src_stage{};
+        VkAccessFlags        src_access{};
+        GetSrcScope(texture.uses[use_idx].access == Access::kDepthAttachment,
+                    false, &src_stage, &src_access);
+        AddDependency(subpass_dependencies, last_subpass[i],
+                      VK_SUBPASS_EXTERNAL, src_stage, src_access,
+                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                      VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    // create render pass
+    VkRenderPassCreateInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = (uint32_t)attachment_descs.size();
+    render_pass_info.pAttachments    = attachment_descs.data();
+    render_pass_info.subpassCount    = (uint32_t)subpass_descs.size();
+    render_pass_info.pSubpasses      = subpass_descs.data();
+    render_pass_info.dependencyCount = (uint32_t)subpass_dependencies.size();
+    render_pass_info.pDependencies   = subpass_dependencies.data();
+
+    VkRenderPass vk_render_pass{};
+    VK_CHECK(vkCreateRenderPass(rhi_->device(), &render_pass_info, nullptr,
+                                &vk_render_pass));
+    pass.render_pass->vk_render_pass_ = vk_render_pass;
+
+    dtor_queue_graph_.Push([this, vk_render_pass]() {
+        vkDestroyRenderPass(rhi_->device(), vk_render_pass, nullptr);
+    });
+}
+
+void RenderGraph::CreateFramebuffers() {
+    for (auto& pass : passes_) {
+        if (!IsLive(pass)) continue;
+
+        VkExtent2D extent     = GetTextureExtent(pass.attachments[0].texture);
+        pass.writes_swapchain = false;
+        for (const auto& attachment : pass.attachments) {
+            VkExtent2D attachment_extent = GetTextureExtent(attachment.texture);
+            LOG_ASSERT(attachment_extent.width == extent.width &&
+                           attachment_extent.height == extent.height,
+                       "Attachments of pass {} differ in size", pass.name);
+            pass.writes_swapchain |= attachment.texture == kSwapchainTexture;
+        }
+        pass.render_pass->extent_ = extent;
+
+        auto fb_info = vk::BuildFramebufferCreateInfo(
+            pass.render_pass->vk_render_pass(), extent);
+
+        const size_t framebuffer_count =
+            pass.writes_swapchain ? rhi_->swapchain_image_views().size() : 1;
+        pass.framebuffers.resize(framebuffer_count);
+
+        for (size_t i = 0; i < framebuffer_count; i++) {
+            std::vector<VkImageView> attachments{};
+            for (const auto& attachment : pass.attachments) {
+                attachments.emplace_back(
+                    attachment.texture == kSwapchainTexture
+                        ? rhi_->swapchain_image_views()[i]
+                        : textures_[attachment.texture]
+                              .texture->image.image_view);
+            }
+            fb_info.attachmentCount = (uint32_t)attachments.size();
+            fb_info.pAttachments    = attachments.data();
+
+            VkFramebuffer& framebuffer = pass.framebuffers[i];
+            VK_CHECK(vkCreateFramebuffer(rhi_->device(), &fb_info, nullptr,
+                                         &framebuffer));
+
+            dtor_queue_swapchain_.Push([this, framebuffer]() {
+                vkDestroyFramebuffer(rhi_->device(), framebuffer, nullptr);
+            });
+        }
+    }
+}
+
+}  // namespace lumi
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "function/render/rhi/vulkan_command_recorder.h"
+#include "function/render/rhi/vulkan_rhi.h"
+
+namespace lumi {
+
+class RenderPass;
+class RenderResource;
+
+// Builds the render passes of a frame from the textures each pass declares
+// to read and write. Passes run in the order they are added. Passes whose
+// results are never used are culled, the VkRenderPass objects, layouts,
+// load/store ops and dependencies are derived from the order of use, and
+// textures owned by the graph share memory when their lifetimes allow.
+class RenderGraph {
+public:
+    using TextureHandle = uint32_t;
+
+    constexpr static TextureHandle kInvalidTexture = ~0u;
+    // Imported, the frame is done when it is presented
+    constexpr static TextureHandle kSwapchainTexture = 0;
+
+    struct TextureDesc {
+        VkFormat           format{};
+        VkImageAspectFlags aspect_flags{};
+        // Follows the swapchain extent when zero
+        uint32_t           width{};
+        uint32_t           height{};
+        std::string        sampler_name{};
+    };
+
+    struct SubpassDesc {
+        std::vector<TextureHandle> color_attachments{};
+        TextureHandle              depth_attachment{kInvalidTexture};
+        // Only used by the first subpass, the pass calls vkCmdNextSubpass
+        VkSubpassContents contents{VK_SUBPASS_CONTENTS_INLINE};
+    };
+
+    // Collects the declarations of one pass in RenderPass::Setup
+    class PassBuilder {
+        friend class RenderGraph;
+
+    private:
+        RenderGraph* graph_{};
+        uint32_t     pass_idx_{};
+
+        PassBuilder(RenderGraph* graph, uint32_t pass_idx)
+            : graph_(graph), pass_idx_(pass_idx) {}
+
+    public:
+        // Also registered to the resource, so materials can sample it
+        TextureHandle CreateTexture(const std::string& name,
+                                    const TextureDesc& desc);
+
+        // Texture created by an earlier pass
+        TextureHandle FindTexture(const std::string& name) const;
+
+        // Used as an attachment. The first writer of the frame clears it,
+        // later writers load it.
+        void Write(TextureHandle texture, const VkClearValue& clear_value);
+
+        // Sampled in fragment shaders, written by an earlier pass
+        void Read(TextureHandle texture);
+
+        // Attachments must be declared with Write, returns the subpass index
+        uint32_t AddSubpass(const SubpassDesc& desc);
+    };
+
+private:
+    enum class Access {
+        kColorAttachment,
+        kDepthAttachment,
+        kSampled,
+    };
+
+    struct Use {
+        uint32_t pass_idx{};
+        Access   access{};
+    };
+
+    struct Texture {
+        std::string                  name{};
+        TextureDesc                  desc{};
+        std::shared_ptr<vk::Texture> texture{};  // Empty for the swapchain
+        VkImageUsageFlags            usage{};
+        std::vector<Use>             uses{};  // Live passes only
+    };
+
+    struct Attachment {
+        TextureHandle texture{};
+        VkClearValue  clear_value{};
+    };
+
+    struct Pass {
+        std::string                 name{};
+        std::shared_ptr<RenderPass> render_pass{};
+        std::vector<Attachment>     attachments{};
+        std::vector<TextureHandle>  reads{};
+        std::vector<SubpassDesc>    subpasses{};
+        bool                        culled{};
+
+        std::vector<VkClearValue>  clear_values{};
+        bool                       writes_swapchain{};
+        // One per swapchain image if the pass writes the swapchain
+        std::vector<VkFramebuffer> framebuffers{};
+    };
+
+    std::shared_ptr<VulkanRHI>      rhi_{};
+    std::shared_ptr<RenderResource> resource_{};
+
+    std::vector<Texture> textures_{};
+    std::vector<Pass>    passes_{};
+
+    vk::DestructorQueue dtor_queue_graph_{};
+    vk::DestructorQueue dtor_queue_swapchain_{};
+
+public:
+    RenderGraph(std::shared_ptr<VulkanRHI>      rhi,
+                std::shared_ptr<RenderResource> resource);
+
+    void AddPass(const std::string&          name,
+                 std::shared_ptr<RenderPass> render_pass);
+
+    // Creates everything the live passes need, then initializes them
+    void Compile();
+
+    void Finalize();
+
+    void CmdExecute(vk::CommandRecorder& recorder);
+
+    void RecreateSwapchain();
+
+private:
+    bool IsLive(const Pass& pass) const { return !pass.culled; }
+
+    bool FollowsSwapchain(TextureHandle texture) const;
+
+    VkExtent2D GetTextureExtent(TextureHandle texture) const;
+
+    void CullPasses();
+
+    void CollectUses();
+
+    // Textures sorted by first use are packed into the first memory whose
+    // last user is done before they start
+    void AllocateTextures(bool follows_swapchain);
+
+    void CreateRenderPass(uint32_t pass_idx);
+
+    void CreateFramebuffers();
+};
+
+}  // namespace lumi
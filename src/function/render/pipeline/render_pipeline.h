@@ -10,6 +10,9 @@ public:
     std::shared_ptr<VulkanRHI>      rhi{};
     std::shared_ptr<RenderResource> resource{};
 
+protected:
+    vk::CommandRecorder recorder_{};
+
 public:
     RenderPipeline(std::shared_ptr<VulkanRHI>      rhi,
                    std::shared_ptr<RenderResource> resource)
@@ -19,7 +22,7 @@ public:
 
     virtual void Finalize() = 0;
 
-    virtual void CmdRender(VkCommandBuffer cmd) = 0;
+    virtual void CmdRender(vk::CommandRecorder& recorder) = 0;
 
     virtual void RecreateSwapchain() = 0;
 
@@ -30,8 +33,11 @@ public:
             return;
         }
 
-        VkCommandBuffer cmd = rhi->GetCurrentCommandBuffer();
-        CmdRender(cmd);
+        // Uploads are recorded before the render passes that read them
+        resource->CmdReleaseFrameContext(rhi->GetCurrentCommandBuffer());
+
+        recorder_.Begin(rhi->GetCurrentCommandBuffer());
+        CmdRender(recorder_);
 
         success = rhi->EndRenderCommand();
         if (!success) {
@@ -13,8 +13,6 @@ void DirectionalShadowMaterial::CreateDescriptorSet(RenderResource* resource) {
 void DirectionalShadowMaterial::CreatePipeline(RenderResource* resource,
                                                VkRenderPass    render_pass,
                                                uint32_t        subpass_idx) {
-    VkDevice device = resource->rhi->device();
-
     vk::PipelineBuilder pipeline_builder{};
 
     // Shaders
@@ -40,8 +38,8 @@ void DirectionalShadowMaterial::CreatePipeline(RenderResource* resource,
     pipeline_layout_info.setLayoutCount = (uint32_t)set_layouts.size();
     pipeline_layout_info.pSetLayouts    = set_layouts.data();
 
-    VK_CHECK(vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
-                                    &this->pipeline_layout));
+    this->pipeline_layout =
+        resource->CreatePipelineLayout(pipeline_layout_info);
     pipeline_builder.pipeline_layout = this->pipeline_layout;
 
     pipeline_builder.vertex_input_info = vk::BuildVertexInputStateCreateInfo();
@@ -77,12 +75,8 @@ void DirectionalShadowMaterial::CreatePipeline(RenderResource* resource,
         (uint32_t)vertexDescription.bindings.size();
 
     // Finally build pipeline
-    this->pipeline = pipeline_builder.Build(device, render_pass, subpass_idx);
-
-    resource->PushDestructor([this, device]() {
-        vkDestroyPipeline(device, this->pipeline, nullptr);
-        vkDestroyPipelineLayout(device, this->pipeline_layout, nullptr);
-    });
+    resource->CreatePipeline(pipeline_builder, render_pass, subpass_idx,
+                             &this->pipeline);
 }
 
 void DirectionalShadowMaterial::Upload(RenderResource* resource) {
@@ -101,33 +95,38 @@ void DirectionalShadowMaterial::EditDescriptorSet(RenderResource* resource,
 
 void DirectionalShadowSubpass::Init(uint32_t subpass_idx) {
     auto resource = render_pass_->resource;
+    subpass_idx_  = subpass_idx;
 
     material_ = (DirectionalShadowMaterial*)resource->CreateMaterial(
         "_directional_shadow", "DirectionalShadowMaterial",
         render_pass_->vk_render_pass(), subpass_idx);
 }
 
-void DirectionalShadowSubpass::CmdRender(VkCommandBuffer cmd) {
-    auto rhi      = render_pass_->rhi;
+void DirectionalShadowSubpass::CmdRender(vk::CommandRecorder& recorder) {
     auto resource = render_pass_->resource;
 
-    uint32_t first_instance_idx = 0;
-    for (auto& [_, mat_batch] : resource->visibles_drawcall_batchs) {
-        CmdBindMaterial(cmd, material_);
-        for (auto& [mesh, batch] : mat_batch) {
-            uint32_t batch_size = (uint32_t)batch.size();
-
-            VkDeviceSize offset = 0;
-            vkCmdBindVertexBuffers(cmd, 0, 1, &mesh->vertex_buffer.buffer,
-                                   &offset);
-            vkCmdBindIndexBuffer(cmd, mesh->index_buffer.buffer, 0,
-                                 Mesh::kVkIndexType);
-            vkCmdDrawIndexed(cmd, (uint32_t)mesh->indices.size(), batch_size, 0,
-                             0, first_instance_idx);
-
-            first_instance_idx += batch_size;
-        }
-    }
+    if (material_->pipeline == VK_NULL_HANDLE) return;  // still compiling
+
+    const auto& draws = resource->visible_draws;
+    CmdRecordParallel(
+        recorder, (uint32_t)draws.size(),
+        [this, &draws](vk::CommandRecorder& chunk_recorder, uint32_t begin,
+                       uint32_t end) {
+            // All casters share the shadow material
+            CmdBindMaterial(chunk_recorder, material_);
+
+            for (uint32_t i = begin; i < end; i++) {
+                const DrawCall& draw = draws[i];
+
+                Mesh* mesh = draw.mesh;
+                chunk_recorder.BindVertexBuffer(mesh->vertex_buffer.buffer);
+                chunk_recorder.BindIndexBuffer(mesh->index_buffer.buffer,
+                                               Mesh::kVkIndexType);
+                chunk_recorder.DrawIndexed((uint32_t)mesh->indices.size(),
+                                           draw.instance_count, 0, 0,
+                                           draw.first_instance);
+            }
+        });
 }
 
 }  // namespace lumi
\ No newline at end of file
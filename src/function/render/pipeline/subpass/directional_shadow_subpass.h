@@ -39,7 +39,7 @@ public:
 
     virtual void Init(uint32_t subpass_idx) override;
 
-    virtual void CmdRender(VkCommandBuffer cmd) override;
+    virtual void CmdRender(vk::CommandRecorder& recorder) override;
 };
 
 }  // namespace lumi
\ No newline at end of file
@@ -2,11 +2,71 @@
 
 #include "function/cvars/cvar_system.h"
 #include "function/render/pipeline/pass/render_pass.h"
+#include "function/render/render_resource.h"
 #include "imgui/backends/imgui_impl_vulkan.h"
 #include "imgui/imgui.h"
 
 namespace lumi {
 
+static void ImGuiShowOcclusionDepth(const SoftwareOcclusionCuller& culler) {
+    using Culler           = SoftwareOcclusionCuller;
+    constexpr float kScale = 2.0f;
+
+    ImGui::SetNextWindowSize(
+        ImVec2(Culler::kWidth * kScale + 20, Culler::kHeight * kScale + 100),
+        ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Occlusion Culling")) {
+        ImGui::End();
+        return;
+    }
+
+    const auto& stats = culler.stats();
+    ImGui::Text("Occluders: %u (%u / %u triangles rasterized)", stats.occluders,
+                stats.rasterized_triangles, stats.occluder_triangles);
+    ImGui::Text("Occludees: %u (frustum culled %u, occluded %u)",
+                stats.occludees, stats.frustum_culled, stats.occluded);
+    ImGui::Text("Rasterize %.3f ms, test %.3f ms", stats.raster_ms,
+                stats.test_ms);
+
+    const float* depth    = culler.depth();
+    float        max_dist = 0.0f;
+    for (uint32_t i = 0; i < Culler::kWidth * Culler::kHeight; i++) {
+        if (depth[i] < 1.0f) {
+            max_dist = std::max(max_dist, culler.LinearizeDepth(depth[i]));
+        }
+    }
+    // Nearer is brighter, empty pixels are black
+    auto shade = [&culler, max_dist](float d) {
+        if (d >= 1.0f || max_dist <= 0.0f) return IM_COL32(0, 0, 0, 255);
+        int level = (int)((1.0f - culler.LinearizeDepth(d) / max_dist) * 63);
+        int gray  = 32 + level * 3;
+        return IM_COL32(gray, gray, gray, 255);
+    };
+
+    // Merge runs of the same shade into one rect to keep the draw list small
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    ImVec2      origin    = ImGui::GetCursorScreenPos();
+    for (uint32_t y = 0; y < Culler::kHeight; y++) {
+        const float* row       = depth + y * Culler::kWidth;
+        uint32_t     run_begin = 0;
+        ImU32        run_color = shade(row[0]);
+        for (uint32_t x = 1; x <= Culler::kWidth; x++) {
+            ImU32 color = x < Culler::kWidth ? shade(row[x]) : 0;
+            if (color == run_color) continue;
+
+            draw_list->AddRectFilled(
+                ImVec2(origin.x + run_begin * kScale, origin.y + y * kScale),
+                ImVec2(origin.x + x * kScale, origin.y + (y + 1) * kScale),
+                run_color);
+            run_begin = x;
+            run_color = color;
+        }
+    }
+    ImGui::Dummy(ImVec2(Culler::kWidth * kScale, Culler::kHeight * kScale));
+
+    ImGui::End();
+}
+
 void ImGuiSubpass::Init(uint32_t subpass_idx) {
     render_pass_->rhi->CreateImGuiContext(render_pass_->vk_render_pass(),
                                           subpass_idx);
@@ -16,7 +76,7 @@ void ImGuiSubpass::DestroyImGuiContext() {
     render_pass_->rhi->DestroyImGuiContext();
 }
 
-void ImGuiSubpass::CmdRender(VkCommandBuffer cmd) {
+void ImGuiSubpass::CmdRender(vk::CommandRecorder& recorder) {
     ImGui_ImplVulkan_NewFrame();
     render_pass_->rhi->ImGuiWindowNewFrame();
     ImGui::NewFrame();
@@ -39,11 +99,30 @@ void ImGuiSubpass::CmdRender(VkCommandBuffer cmd) {
 
     cvars::ImGuiRender();
 
+    // Counted up to this subpass
+    const auto& cmd_stats = recorder.stats();
+    ImGui::Separator();
+    ImGui::Text("Commands: %u emitted, %u skipped, %u draws",
+                cmd_stats.emitted, cmd_stats.skipped, cmd_stats.draws);
+
+    const auto& timings = render_pass_->resource->frame_pacer.timings();
+    ImGui::Text("Frame %.2f ms: CPU %.2f ms, GPU %.2f ms, wait %.2f ms",
+                timings.frame, timings.cpu, timings.gpu, timings.wait);
+    ImGui::Text("Input latency, until the GPU is done: %.2f ms",
+                timings.latency);
+    ImGui::Text("Retired resources waiting for the GPU: %zu",
+                render_pass_->rhi->deferred_destructor_count());
+
     ImGui::End();
 #pragma endregion
 
+    if (cvars::GetBool("culling.occlusion.show_depth").value()) {
+        ImGuiShowOcclusionDepth(render_pass_->resource->occlusion_culler);
+    }
+
     ImGui::Render();
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), recorder.cmd());
+    recorder.Invalidate();
 }
 
 }  // namespace lumi
\ No newline at end of file
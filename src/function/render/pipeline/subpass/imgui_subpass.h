@@ -10,7 +10,7 @@ public:
 
     virtual void Init(uint32_t subpass_idx) override;
 
-    virtual void CmdRender(VkCommandBuffer cmd) override;
+    virtual void CmdRender(vk::CommandRecorder& recorder) override;
 
     void DestroyImGuiContext();
 };
@@ -6,28 +6,34 @@
 
 namespace lumi {
 
-void MeshLightingSubpass::CmdRender(VkCommandBuffer cmd) {
-    auto rhi      = render_pass_->rhi;
+void MeshLightingSubpass::CmdRender(vk::CommandRecorder& recorder) {
     auto resource = render_pass_->resource;
 
-    uint32_t first_instance_idx = 0;
-    for (auto& [material, mat_batch] : resource->visibles_drawcall_batchs) {
-        CmdBindMaterial(cmd, material);
-
-        for (auto& [mesh, batch] : mat_batch) {
-            uint32_t batch_size = (uint32_t)batch.size();
-
-            VkDeviceSize offset = 0;
-            vkCmdBindVertexBuffers(cmd, 0, 1, &mesh->vertex_buffer.buffer,
-                                   &offset);
-            vkCmdBindIndexBuffer(cmd, mesh->index_buffer.buffer, 0,
-                                 Mesh::kVkIndexType);
-            vkCmdDrawIndexed(cmd, (uint32_t)mesh->indices.size(), batch_size, 0,
-                             0, first_instance_idx);
-
-            first_instance_idx += batch_size;
-        }
-    }
+    const auto& draws = resource->visible_draws;
+    CmdRecordParallel(
+        recorder, (uint32_t)draws.size(),
+        [this, &draws](vk::CommandRecorder& chunk_recorder, uint32_t begin,
+                       uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                const DrawCall& draw = draws[i];
+
+                // Pipeline and fallback are both still compiling
+                Material* material = draw.material;
+                if (material->pipeline == VK_NULL_HANDLE) continue;
+
+                // Materials are sorted by pipeline, so the recorder binds
+                // each pipeline once per chunk
+                CmdBindMaterial(chunk_recorder, material);
+
+                Mesh* mesh = draw.mesh;
+                chunk_recorder.BindVertexBuffer(mesh->vertex_buffer.buffer);
+                chunk_recorder.BindIndexBuffer(mesh->index_buffer.buffer,
+                                               Mesh::kVkIndexType);
+                chunk_recorder.DrawIndexed((uint32_t)mesh->indices.size(),
+                                           draw.instance_count, 0, 0,
+                                           draw.first_instance);
+            }
+        });
 }
 
 }  // namespace lumi
\ No newline at end of file
@@ -8,9 +8,11 @@ class MeshLightingSubpass : public RenderSubpass {
 public:
     using RenderSubpass::RenderSubpass;
 
-    virtual void Init(uint32_t subpass_idx) override {}
+    virtual void Init(uint32_t subpass_idx) override {
+        subpass_idx_ = subpass_idx;
+    }
 
-    virtual void CmdRender(VkCommandBuffer cmd) override;
+    virtual void CmdRender(vk::CommandRecorder& recorder) override;
 };
 
 }  // namespace lumi
\ No newline at end of file
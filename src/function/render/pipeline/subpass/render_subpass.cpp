@@ -1,15 +1,21 @@
 #include "render_subpass.h"
 
+#include "core/thread_pool.h"
 #include "function/render/pipeline/pass/render_pass.h"
 #include "function/render/render_resource.h"
 
 namespace lumi {
 
-void RenderSubpass::CmdBindMaterial(VkCommandBuffer cmd, Material* material) {
+static_assert(kDescriptorSetSlotsCount <=
+                  vk::CommandRecorder::kMaxDescriptorSets,
+              "Descriptor set slots are not tracked by the recorder");
+
+void RenderSubpass::CmdBindMaterial(vk::CommandRecorder& recorder,
+                                    Material*            material) {
     auto  resource = render_pass_->resource;
     auto& extent   = render_pass_->GetExtent();
 
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, material->pipeline);
+    recorder.BindPipeline(material->pipeline);
 
     VkViewport viewport{};
     viewport.x        = 0.0f;
@@ -18,33 +24,82 @@ void RenderSubpass::CmdBindMaterial(VkCommandBuffer cmd, Material* material) {
     viewport.height   = -(float)extent.height;  // flip y
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    recorder.SetViewport(viewport);
 
     VkRect2D scissor{};
     scissor.offset = {0, 0};
     scissor.extent = extent;
-    vkCmdSetScissor(cmd, 0, 1, &scissor);
+    recorder.SetScissor(scissor);
 
-    vkCmdSetCullMode(cmd, material->double_sided ? VK_CULL_MODE_NONE
-                                                 : VK_CULL_MODE_BACK_BIT);
+    recorder.SetCullMode(material->double_sided ? VK_CULL_MODE_NONE
+                                                : VK_CULL_MODE_BACK_BIT);
 
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            material->pipeline_layout,
-                            kDescriptorSetSlotMaterial, 1,
-                            &material->descriptor_set.set, 0, nullptr);
+    VkPipelineLayout layout = material->pipeline_layout;
 
     auto global_offsets = resource->GlobalSSBODynamicOffsets();
-    vkCmdBindDescriptorSets(
-        cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, material->pipeline_layout,
-        kDescriptorSetSlotGlobal, 1, &resource->global.descriptor_set.set,
-        (uint32_t)global_offsets.size(), global_offsets.data());
+    recorder.BindDescriptorSet(layout, kDescriptorSetSlotGlobal,
+                               resource->global.descriptor_set.set,
+                               (uint32_t)global_offsets.size(),
+                               global_offsets.data());
 
     auto mesh_instance_offsets = resource->MeshInstanceSSBODynamicOffsets();
-    vkCmdBindDescriptorSets(
-        cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, material->pipeline_layout,
-        kDescriptorSetSlotMeshInstance, 1,
-        &resource->mesh_instances.descriptor_set.set,
-        (uint32_t)mesh_instance_offsets.size(), mesh_instance_offsets.data());
+    recorder.BindDescriptorSet(layout, kDescriptorSetSlotMeshInstance,
+                               resource->mesh_instances.descriptor_set.set,
+                               (uint32_t)mesh_instance_offsets.size(),
+                               mesh_instance_offsets.data());
+
+    if (material->bindless) {
+        recorder.BindDescriptorSet(
+            layout, kDescriptorSetSlotBindless,
+            resource->bindless_textures.descriptor_set.set);
+    }
+
+    if (material->params_index != MaterialParamsArena::kInvalidIndex) {
+        recorder.PushConstants(layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                               sizeof(material->params_index),
+                               &material->params_index);
+    }
+
+    recorder.BindDescriptorSet(layout, kDescriptorSetSlotMaterial,
+                               material->descriptor_set.set);
+}
+
+void RenderSubpass::CmdRecordParallel(vk::CommandRecorder&   recorder,
+                                      uint32_t               count,
+                                      const RecordChunkFunc& func) {
+    if (count == 0) return;
+
+    auto&    rhi    = render_pass_->rhi;
+    auto&    pool   = ThreadPool::Instance();
+    uint32_t chunks = (count + kMinDrawsPerChunk - 1) / kMinDrawsPerChunk;
+    chunks = std::min({chunks, pool.size() + 1, VulkanRHI::kMaxRecordSlots});
+
+    std::array<VkCommandBuffer, VulkanRHI::kMaxRecordSlots>            cmds{};
+    std::array<vk::CommandRecorder::Stats, VulkanRHI::kMaxRecordSlots> stats{};
+
+    // Chunk i records with slot i, so no pool is shared between threads
+    pool.ParallelFor(chunks, [&](uint32_t chunk) {
+        uint32_t begin = (uint32_t)((uint64_t)count * chunk / chunks);
+        uint32_t end   = (uint32_t)((uint64_t)count * (chunk + 1) / chunks);
+
+        VkCommandBuffer cmd = rhi->BeginSecondaryCommandBuffer(
+            chunk, render_pass_->vk_render_pass(), subpass_idx_);
+
+        vk::CommandRecorder chunk_recorder{};
+        chunk_recorder.Begin(cmd);
+        func(chunk_recorder, begin, end);
+        rhi->EndSecondaryCommandBuffer(cmd);
+
+        cmds[chunk]  = cmd;
+        stats[chunk] = chunk_recorder.stats();
+    });
+
+    vkCmdExecuteCommands(recorder.cmd(), chunks, cmds.data());
+    // The state of the primary command buffer is undefined after it
+    recorder.Invalidate();
+    for (uint32_t i = 0; i < chunks; i++) {
+        recorder.AddStats(stats[i]);
+    }
 }
 
 }  // namespace lumi
\ No newline at end of file
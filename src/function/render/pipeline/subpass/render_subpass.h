@@ -1,5 +1,6 @@
 #pragma once
 
+#include "function/render/rhi/vulkan_command_recorder.h"
 #include "function/render/rhi/vulkan_rhi.h"
 
 namespace lumi {
@@ -8,18 +9,34 @@ class RenderPass;
 struct Material;
 
 class RenderSubpass {
+public:
+    // Smaller draw lists are recorded by fewer threads
+    constexpr static uint32_t kMinDrawsPerChunk = 32;
+
+    using RecordChunkFunc = std::function<void(
+        vk::CommandRecorder& recorder, uint32_t begin, uint32_t end)>;
+
 protected:
     RenderPass* render_pass_{};
+    uint32_t    subpass_idx_{};
 
 public:
     RenderSubpass(RenderPass* render_pass) : render_pass_(render_pass) {}
 
-    virtual void CmdRender(VkCommandBuffer cmd) = 0;
+    virtual void CmdRender(vk::CommandRecorder& recorder) = 0;
 
     virtual void Init(uint32_t subpass_idx) = 0;
 
 protected:
-    void CmdBindMaterial(VkCommandBuffer cmd, Material* material);
+    // Binds the pipeline, dynamic state and descriptor sets of the material.
+    // State shared with the previous material is skipped by the recorder.
+    void CmdBindMaterial(vk::CommandRecorder& recorder, Material* material);
+
+    // Splits [0, count) into chunks that func records into secondary command
+    // buffers on worker threads, then executes them from recorder. The
+    // subpass must begin with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+    void CmdRecordParallel(vk::CommandRecorder& recorder, uint32_t count,
+                           const RecordChunkFunc& func);
 };
 
 }  // namespace lumi
\ No newline at end of file
@@ -17,16 +17,17 @@ void SkyboxSubpass::Init(uint32_t subpass_idx) {
             subpass_idx);
 }
 
-void SkyboxSubpass::CmdRender(VkCommandBuffer cmd) {
+void SkyboxSubpass::CmdRender(vk::CommandRecorder& recorder) {
     auto material = render_pass_->resource->global.skybox_material;
-    CmdBindMaterial(cmd, material);
+    if (material->pipeline == VK_NULL_HANDLE) return;  // still compiling
+    CmdBindMaterial(recorder, material);
 
-    vkCmdPushConstants(cmd, material->pipeline_layout,
-                       VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(int),
-                       cvars::GetInt("debug.skybox").ptr());
+    recorder.PushConstants(material->pipeline_layout,
+                           VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(int),
+                           cvars::GetInt("debug.skybox").ptr());
 
     // 2 triangles (6 vertex) each face, 6 faces
-    vkCmdDraw(cmd, 36, 1, 0, 0);
+    recorder.Draw(36, 1, 0, 0);
 }
 
 }  // namespace lumi
\ No newline at end of file
@@ -1,8 +1,21 @@
 #include "render_resource.h"
 
+#include <algorithm>
+#include <chrono>
+
+#include "core/disk_cache.h"
+#include "core/hash.h"
 #include "core/scope_guard.h"
+#include "core/thread_pool.h"
+#include "function/cvars/cvar_system.h"
 #include "material/pbr_material.h"
 #include "pipeline/pass/shadow_pass.h"
+#include "shader/embedded_shaders.h"
+#include "texture/equirect_converter.h"
+#include "texture/float_converter.h"
+#include "texture/hdr_file.h"
+#include "texture/ibl_baker.h"
+#include "texture/ktx2_file.h"
 
 #ifdef _WIN32
 #include <codeanalysis/warnings.h>
@@ -27,6 +40,147 @@
 
 namespace lumi {
 
+// Suffixes of the 6 face files of a cubemap, in layer order
+static const std::array<const char *, 6> kCubemapFaceSuffixes = {
+    "_X+.hdr", "_X-.hdr", "_Z+.hdr", "_Z-.hdr", "_Y+.hdr", "_Y-.hdr",
+};
+
+// Identifies a source file by its path, size and modification time
+static bool HashFileStamp(const fs::path &filepath, uint64_t *key) {
+    std::error_code ec{};
+    uint64_t        file_size = fs::file_size(filepath, ec);
+    if (ec) return false;
+    auto write_time = fs::last_write_time(filepath, ec).time_since_epoch();
+
+    std::string path_string = filepath.string();
+    int64_t     ticks       = (int64_t)write_time.count();
+    *key = HashBytes(path_string.data(), path_string.size(), *key);
+    *key = HashBytes(&file_size, sizeof(file_size), *key);
+    *key = HashBytes(&ticks, sizeof(ticks), *key);
+    return true;
+}
+
+// Loads the radiance of a cubemap as 6 RGBA32F faces in layer order, from
+// either an equirectangular .hdr file or 6 face files
+static bool LoadCubemapFacesHDR(const fs::path &filepath,
+                                std::vector<float> &faces,
+                                uint32_t *face_size) {
+    if (filepath.extension() == ".hdr") {
+        HDRFile file{};
+        if (!HDRFile::Load(filepath, &file)) return false;
+
+        std::vector<float> rgba((size_t)file.width() * file.height() * 4);
+        if (!file.Decode(VK_FORMAT_R32G32B32A32_SFLOAT, rgba.data())) {
+            return false;
+        }
+        *face_size = EquirectConverter::FaceSize(file.width());
+        faces.resize((size_t)*face_size * *face_size * 4 * 6);
+        return EquirectConverter::ToCubemap(
+            rgba.data(), file.width(), file.height(), *face_size,
+            VK_FORMAT_R32G32B32A32_SFLOAT, faces.data());
+    }
+
+    std::array<HDRFile, 6> files{};
+    std::array<bool, 6>    loaded{};
+    ThreadPool::Instance().ParallelFor(6, [&](uint32_t i) {
+        loaded[i] = HDRFile::Load(filepath.string() + kCubemapFaceSuffixes[i],
+                                  &files[i]);
+    });
+    for (int i = 0; i < 6; i++) {
+        if (!loaded[i]) return false;
+        if (files[i].width() != files[0].width() ||
+            files[i].height() != files[0].width()) {
+            LOG_ERROR("Cubemap face {}{} is not square or has a different size",
+                      filepath.string(), kCubemapFaceSuffixes[i]);
+            return false;
+        }
+    }
+
+    *face_size = files[0].width();
+    size_t face_floats = (size_t)*face_size * *face_size * 4;
+    faces.resize(face_floats * 6);
+
+    std::array<bool, 6> decoded{};
+    ThreadPool::Instance().ParallelFor(6, [&](uint32_t i) {
+        decoded[i] = files[i].Decode(VK_FORMAT_R32G32B32A32_SFLOAT,
+                                     faces.data() + i * face_floats);
+    });
+    for (int i = 0; i < 6; i++) {
+        if (!decoded[i]) {
+            LOG_ERROR("Failed to decode cubemap face {}{}", filepath.string(),
+                      kCubemapFaceSuffixes[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Covers everything that ends up in the created texture
+static uint64_t HashTextureContent(const vk::TextureCreateInfo &info,
+                                   const void *data, size_t size) {
+    uint64_t key = HashContent(data, size);
+    key          = HashBytes(&info.width, sizeof(info.width), key);
+    key          = HashBytes(&info.height, sizeof(info.height), key);
+    key          = HashBytes(&info.mip_levels, sizeof(info.mip_levels), key);
+    key          = HashBytes(&info.format, sizeof(info.format), key);
+    key = HashBytes(info.sampler_name.data(), info.sampler_name.size(), key);
+    return key;
+}
+
+static VkFormat GetBlockVkFormat(BlockFormat format, bool is_srgb) {
+    switch (format) {
+        case BlockFormat::kBC1:
+            return is_srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK
+                           : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case BlockFormat::kBC3:
+            return is_srgb ? VK_FORMAT_BC3_SRGB_BLOCK
+                           : VK_FORMAT_BC3_UNORM_BLOCK;
+        case BlockFormat::kBC4:
+            return VK_FORMAT_BC4_UNORM_BLOCK;
+        case BlockFormat::kBC5:
+            return VK_FORMAT_BC5_UNORM_BLOCK;
+        case BlockFormat::kBC7:
+            return is_srgb ? VK_FORMAT_BC7_SRGB_BLOCK
+                           : VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+static bool GetBlockFormat(VkFormat vk_format, BlockFormat *format,
+                           bool *is_srgb) {
+    *is_srgb = false;
+    switch (vk_format) {
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            *is_srgb = true;
+            [[fallthrough]];
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+            *format = BlockFormat::kBC1;
+            return true;
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            *is_srgb = true;
+            [[fallthrough]];
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+            *format = BlockFormat::kBC3;
+            return true;
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            *format = BlockFormat::kBC4;
+            return true;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            *format = BlockFormat::kBC5;
+            return true;
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            *is_srgb = true;
+            [[fallthrough]];
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+            *format = BlockFormat::kBC7;
+            return true;
+        default:
+            return false;
+    }
+}
+
 void RenderResource::Init() {
     // Create descriptor allocator
     descriptor_allocator_.Init(rhi->device());
@@ -41,16 +195,29 @@ void RenderResource::Init() {
     InitGlobalResource();
 
     InitMeshInstancesResource();
+
+    InitBindlessTexturesResource();
+
+    occlusion_culler.Init();
+
+    frame_pacer.Init(rhi);
+
+    pipeline_compile_pool_ =
+        std::make_unique<ThreadPool>(kPipelineCompileThreads);
 }
 
 void RenderResource::InitDefaultTextures() {
     // Samplers
     VkSamplerCreateInfo info_nearest =
         vk::BuildSamplerCreateInfo(VK_FILTER_NEAREST);
+    info_nearest.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    info_nearest.maxLod     = VK_LOD_CLAMP_NONE;
     CreateSampler("nearest", &info_nearest);
 
     VkSamplerCreateInfo info_linear =
         vk::BuildSamplerCreateInfo(VK_FILTER_LINEAR);
+    info_linear.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    info_linear.maxLod     = VK_LOD_CLAMP_NONE;
     CreateSampler("linear", &info_linear);
 
     VkSamplerCreateInfo info_hdr = vk::BuildSamplerCreateInfo(
@@ -95,8 +262,11 @@ void RenderResource::InitDefaultTextures() {
     Color4u8 normal_default = Color4u8(128, 128, 255, 255);
     CreateTexture2D("normal_default", &tex_info, &normal_default);
 
+    // no occlusion, roughness 1 and metallic 0
+    CreateTexture2D("orm_default", &tex_info, &Color4u8::kYellow);
+
     // lut
-    CreateTextureHDRFromFile("lut_brdf", "textures/lut/brdf.hdr");
+    CreateBRDFLut("lut_brdf");
 
     // Cubemaps
     tex_info.format       = VK_FORMAT_R32G32B32A32_SFLOAT;
@@ -118,25 +288,15 @@ void RenderResource::InitDefaultTextures() {
 
 void RenderResource::InitGlobalResource() {
     // --- Resource buffer ---
-    size_t cam_size   = rhi->PaddedSizeOfSSBO<CamDataSSBO>();
-    size_t env_size   = rhi->PaddedSizeOfSSBO<EnvDataSSBO>();
-    size_t alloc_size = rhi->kFramesInFlight * (cam_size + env_size);
-    global.buffer     = rhi->AllocateBuffer(
-        alloc_size,
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VMA_MEMORY_USAGE_GPU_ONLY);
-
-    // Map resource staging buffer memory to pointer
-    global.staging_buffer =
-        rhi->AllocateBuffer(alloc_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                            VMA_MEMORY_USAGE_CPU_ONLY);
-    global.data.begin = rhi->MapMemory(&global.staging_buffer);
+    // Written each frame in the uniforms of the frame context
+    size_t cam_size = rhi->PaddedSizeOfSSBO<CamDataSSBO>();
+    size_t env_size = rhi->PaddedSizeOfSSBO<EnvDataSSBO>();
 
-    dtor_queue_resource_.Push([this]() {
-        rhi->UnmapMemory(&global.staging_buffer);
-        rhi->DestroyBuffer(&global.staging_buffer);
-        rhi->DestroyBuffer(&global.buffer);
-    });
+    size_t instances_size =
+        rhi->PaddedSizeOfSSBO(sizeof(MeshInstanceSSBO) * kMaxVisibleObjects);
+
+    frame_context.Init(rhi.get(), cam_size + env_size, instances_size);
+    dtor_queue_resource_.Push([this]() { frame_context.Finalize(); });
 
     // --- Build descriptor set ---
     EditGlobalDescriptorSet(false);
@@ -148,28 +308,13 @@ void RenderResource::EditGlobalDescriptorSet(bool update_only) {
     editor.BindBuffer(kGlobalBindingCamera,  //
                       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
                       VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                      global.buffer.buffer, 0, sizeof(CamDataSSBO));
+                      frame_context.uniforms.buffer(), 0, sizeof(CamDataSSBO));
     editor.BindBuffer(kGlobalBindingEnvironment,  //
                       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
                       VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-                      global.buffer.buffer, 0, sizeof(EnvDataSSBO));
+                      frame_context.uniforms.buffer(), 0, sizeof(EnvDataSSBO));
 
-    // IBL textures
-    {
-        vk::Texture *texture =
-            GetTexture(SkyboxMaterial::kDefaultSkyboxTexName);
-        if (global.skybox_material != nullptr) {
-            vk::Texture *temp =
-                GetTexture(global.skybox_material->irradiance_cubemap_name);
-            if (temp != nullptr) texture = temp;
-        }
-        VkSampler sampler = GetSampler(texture->sampler_name);
-        editor.BindImage(kGlobalBindingSkyboxIrradiance,
-                         VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                         VK_SHADER_STAGE_FRAGMENT_BIT, sampler,
-                         texture->image.image_view,
-                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    }
+    // IBL textures, diffuse lighting is in the environment buffer
     {
         vk::Texture *texture =
             GetTexture(SkyboxMaterial::kDefaultSkyboxTexName);
@@ -216,97 +361,369 @@ void RenderResource::EditGlobalDescriptorSet(bool update_only) {
 }
 
 void RenderResource::InitMeshInstancesResource() {
-    // --- Resource buffer ---
-    size_t size =
-        rhi->PaddedSizeOfSSBO(sizeof(MeshInstanceSSBO) * kMaxVisibleObjects);
-    size_t alloc_size     = rhi->kFramesInFlight * size;
-    mesh_instances.buffer = rhi->AllocateBuffer(
-        alloc_size,
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        VMA_MEMORY_USAGE_GPU_ONLY);
-
-    // Map resource staging buffer memory to pointer
-    mesh_instances.staging_buffer =
-        rhi->AllocateBuffer(alloc_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                            VMA_MEMORY_USAGE_CPU_ONLY);
-    mesh_instances.data.begin = rhi->MapMemory(&mesh_instances.staging_buffer);
-
-    dtor_queue_resource_.Push([this]() {
-        rhi->UnmapMemory(&mesh_instances.staging_buffer);
-        rhi->DestroyBuffer(&mesh_instances.staging_buffer);
-        rhi->DestroyBuffer(&mesh_instances.buffer);
-    });
-
-    // --- Build descriptor set ---
+    // Written each frame in the instances of the frame context, which is
+    // created with the global resource
     auto editor = BeginEditDescriptorSet(&mesh_instances.descriptor_set);
 
     editor.BindBuffer(kMeshInstanceBinding,
                       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
-                      VK_SHADER_STAGE_VERTEX_BIT, mesh_instances.buffer.buffer,
-                      0, sizeof(MeshInstanceSSBO) * kMaxVisibleObjects);
+                      VK_SHADER_STAGE_VERTEX_BIT,
+                      frame_context.instances.buffer(), 0,
+                      sizeof(MeshInstanceSSBO) * kMaxVisibleObjects);
 
     editor.Execute(false);
 }
 
-void RenderResource::Finalize() { dtor_queue_resource_.Flush(); }
+void RenderResource::InitBindlessTexturesResource() {
+    VkDevice device = rhi->device();
+
+    // The layout flags are not part of the layout cache key, so the set gets
+    // its own layout and pool
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding         = kBindlessBindingTextures;
+    binding.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = kMaxBindlessTextures;
+    binding.stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorBindingFlags binding_flags =
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info{};
+    binding_flags_info.sType =
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_info.bindingCount  = 1;
+    binding_flags_info.pBindingFlags = &binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext = &binding_flags_info;
+    layout_info.flags =
+        VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = 1;
+    layout_info.pBindings    = &binding;
+    VK_CHECK(vkCreateDescriptorSetLayout(
+        device, &layout_info, nullptr,
+        &bindless_textures.descriptor_set.layout));
+
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_size.descriptorCount = kMaxBindlessTextures;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets       = 1;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes    = &pool_size;
+    VK_CHECK(vkCreateDescriptorPool(device, &pool_info, nullptr,
+                                    &bindless_textures.pool));
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool     = bindless_textures.pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts        = &bindless_textures.descriptor_set.layout;
+    VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info,
+                                      &bindless_textures.descriptor_set.set));
+
+    dtor_queue_resource_.Push([this, device]() {
+        vkDestroyDescriptorPool(device, bindless_textures.pool, nullptr);
+        vkDestroyDescriptorSetLayout(
+            device, bindless_textures.descriptor_set.layout, nullptr);
+    });
+}
+
+uint32_t RenderResource::GetBindlessTextureIndex(vk::Texture *texture) {
+    auto it = bindless_textures.indices.find(texture);
+    if (it != bindless_textures.indices.end()) {
+        return it->second;
+    }
+
+    uint32_t index = bindless_textures.next_index;
+    if (!bindless_textures.free_indices.empty()) {
+        index = bindless_textures.free_indices.back();
+        bindless_textures.free_indices.pop_back();
+    } else if (index >= kMaxBindlessTextures) {
+        LOG_ERROR("More than {} bindless textures, slot 0 is used instead",
+                  kMaxBindlessTextures);
+        return 0;
+    } else {
+        bindless_textures.next_index++;
+    }
+    bindless_textures.indices[texture] = index;
+
+    VkDescriptorImageInfo image_info{};
+    image_info.sampler     = GetSampler(texture->sampler_name);
+    image_info.imageView   = texture->image.image_view;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write{};
+    write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet          = bindless_textures.descriptor_set.set;
+    write.dstBinding      = kBindlessBindingTextures;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo      = &image_info;
+    vkUpdateDescriptorSets(rhi->device(), 1, &write, 0, nullptr);
+
+    return index;
+}
+
+void RenderResource::Finalize() {
+    // Workers may still be building, they use the shader modules
+    for (auto &[key, pending] : pending_pipelines_) {
+        FinishPipeline(key, pending);
+    }
+    pending_pipelines_.clear();
+    pipeline_compile_pool_.reset();
+
+    // Runtime destroyed ones went through the deferred queue of the RHI
+    for (auto &[name, mesh] : meshes_) {
+        rhi->DestroyBuffer(&mesh.vertex_buffer);
+        rhi->DestroyBuffer(&mesh.index_buffer);
+    }
+    for (vk::Texture *texture : owned_textures_) {
+        rhi->DestroyTexture(texture);
+    }
+    owned_textures_.clear();
+
+    dtor_queue_resource_.Flush();
+}
 
 void RenderResource::PushDestructor(std::function<void()> &&destructor) {
     dtor_queue_resource_.Push(std::move(destructor));
 }
 
-void RenderResource::ResetMappedPointers() {
-    int idx = rhi->frame_idx();
+MaterialParamsArena *RenderResource::GetMaterialParamsArena(
+    const std::string &type, uint32_t stride, uint32_t capacity) {
+    auto &arena = material_params_arenas_[type];
+    if (!arena) {
+        arena = std::make_unique<MaterialParamsArena>();
+        arena->Init(rhi.get(), stride, capacity);
+
+        MaterialParamsArena *p_arena = arena.get();
+        dtor_queue_resource_.Push([p_arena]() { p_arena->Finalize(); });
+    }
+    return arena.get();
+}
+
+VkPipelineLayout RenderResource::CreatePipelineLayout(
+    const VkPipelineLayoutCreateInfo &info) {
+    uint64_t key = HashBytes(&info.flags, sizeof(info.flags));
+    key = HashBytes(info.pSetLayouts,
+                    info.setLayoutCount * sizeof(VkDescriptorSetLayout), key);
+    key = HashBytes(info.pPushConstantRanges,
+                    info.pushConstantRangeCount * sizeof(VkPushConstantRange),
+                    key);
+
+    auto it = pipeline_layouts_.find(key);
+    if (it != pipeline_layouts_.end()) {
+        return it->second;
+    }
+
+    VkDevice         device = rhi->device();
+    VkPipelineLayout layout{};
+    VK_CHECK(vkCreatePipelineLayout(device, &info, nullptr, &layout));
+    pipeline_layouts_[key] = layout;
+
+    dtor_queue_resource_.Push([device, layout]() {
+        vkDestroyPipelineLayout(device, layout, nullptr);
+    });
+    return layout;
+}
+
+void RenderResource::CreatePipeline(vk::PipelineBuilder &builder,
+                                    VkRenderPass         render_pass,
+                                    uint32_t             subpass_idx,
+                                    VkPipeline          *pipeline) {
+    uint64_t key = builder.Hash(render_pass, subpass_idx);
+    pipeline_targets_[pipeline] = key;
+
+    auto it = pipelines_.find(key);
+    if (it != pipelines_.end()) {
+        *pipeline = it->second;
+        return;
+    }
+    *pipeline = VK_NULL_HANDLE;
+    CompilePipelineAsync(key, builder, render_pass, subpass_idx,
+                         {pipeline, key});
+
+    // The fallback keeps the layout and vertex stage, so it binds the same
+    // resources and draws the same geometry
+    vk::PipelineBuilder fallback = builder;
+    fallback.specialization_constants.clear();
+    for (auto &stage : fallback.shader_stages) {
+        if (stage.stage == VK_SHADER_STAGE_FRAGMENT_BIT) {
+            stage.module =
+                CreateShaderModule(kFallbackShaderName, kShaderTypeFragment);
+        }
+    }
+    uint64_t fallback_key = fallback.Hash(render_pass, subpass_idx);
+    if (fallback_key == key) return;
+
+    it = pipelines_.find(fallback_key);
+    if (it != pipelines_.end()) {
+        *pipeline = it->second;
+    } else {
+        CompilePipelineAsync(fallback_key, fallback, render_pass, subpass_idx,
+                             {pipeline, key});
+    }
+}
+
+void RenderResource::UpdatePipelines() {
+    for (auto &[name, material] : materials_) {
+        material->UpdatePipeline(this);
+    }
+
+    for (auto it = pending_pipelines_.begin();
+         it != pending_pipelines_.end();) {
+        auto &[key, pending] = *it;
+        if (pending.future.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+            it++;
+            continue;
+        }
+        FinishPipeline(key, pending);
+        it = pending_pipelines_.erase(it);
+    }
+}
+
+void RenderResource::WarmUpPipelines(
+    const std::vector<std::string> &material_types) {
+    for (auto &type_name : material_types) {
+        CreateMaterial("_warm_up_" + type_name, type_name);
+    }
+}
+
+// Owns the arrays the builder points to, so that it outlives the caller
+struct PipelineBuildJob {
+    vk::PipelineBuilder                            builder{};
+    std::vector<VkVertexInputBindingDescription>   bindings{};
+    std::vector<VkVertexInputAttributeDescription> attributes{};
+    VkRenderPass                                   render_pass{};
+    uint32_t                                       subpass_idx{};
+};
+
+void RenderResource::CompilePipelineAsync(
+    uint64_t key, const vk::PipelineBuilder &builder, VkRenderPass render_pass,
+    uint32_t subpass_idx, const PipelineRequest &request) {
+    auto [it, inserted] = pending_pipelines_.try_emplace(key);
+    it->second.requests.emplace_back(request);
+    if (!inserted) return;
+
+    auto job         = std::make_shared<PipelineBuildJob>();
+    job->builder     = builder;
+    job->render_pass = render_pass;
+    job->subpass_idx = subpass_idx;
+
+    auto &input = job->builder.vertex_input_info;
+    job->bindings.assign(input.pVertexBindingDescriptions,
+                         input.pVertexBindingDescriptions +
+                             input.vertexBindingDescriptionCount);
+    job->attributes.assign(input.pVertexAttributeDescriptions,
+                           input.pVertexAttributeDescriptions +
+                               input.vertexAttributeDescriptionCount);
+    input.pVertexBindingDescriptions   = job->bindings.data();
+    input.pVertexAttributeDescriptions = job->attributes.data();
+
+    // The pipeline cache is internally synchronized
+    VkDevice        device = rhi->device();
+    VkPipelineCache cache  = rhi->pipeline_cache();
+
+    it->second.future = pipeline_compile_pool_->Submit([job, device, cache]() {
+        auto start = std::chrono::steady_clock::now();
+
+        CompiledPipeline res{};
+        res.pipeline   = job->builder.Build(device, job->render_pass,
+                                            job->subpass_idx, cache);
+        res.elapsed_ms = std::chrono::duration<float, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        return res;
+    });
+}
+
+void RenderResource::FinishPipeline(uint64_t key, PendingPipeline &pending) {
+    CompiledPipeline compiled = pending.future.get();
+    if (compiled.pipeline == VK_NULL_HANDLE) return;  // Build logs the error
+
+    VkDevice   device   = rhi->device();
+    VkPipeline pipeline = compiled.pipeline;
+    pipelines_[key]     = pipeline;
+    dtor_queue_resource_.Push([device, pipeline]() {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    });
+
+    for (auto &request : pending.requests) {
+        // The target moved on to another variant or was destroyed
+        auto target = pipeline_targets_.find(request.target);
+        if (target == pipeline_targets_.end() ||
+            target->second != request.key) {
+            continue;
+        }
+
+        // A late fallback must not replace the requested pipeline
+        if (request.key == key ||
+            pipelines_.find(request.key) == pipelines_.end()) {
+            *request.target = pipeline;
+        }
+    }
+
+    pipeline_build_ms_ += compiled.elapsed_ms;
+    LOG_INFO("Pipeline {} built in {:.2f} ms {} cache, {:.2f} ms for {} "
+             "pipelines",
+             key, compiled.elapsed_ms,
+             rhi->pipeline_cache_loaded() ? "with" : "without",
+             pipeline_build_ms_, pipelines_.size());
+}
+
+void RenderResource::AcquireFrameContext() {
+    frame_context.Acquire();
 
     // global
     {
-        size_t cam_size = rhi->PaddedSizeOfSSBO<CamDataSSBO>();
-        size_t env_size = rhi->PaddedSizeOfSSBO<EnvDataSSBO>();
+        auto cam = frame_context.uniforms.Allocate(sizeof(CamDataSSBO));
+        auto env = frame_context.uniforms.Allocate(sizeof(EnvDataSSBO));
 
-        char *begin = (char *)(global.data.begin);
-        char *cam   = begin + idx * (cam_size + env_size);
-        char *env   = cam + cam_size;
-
-        global.data.cam = reinterpret_cast<CamDataSSBO *>(cam);
-        global.data.env = reinterpret_cast<EnvDataSSBO *>(env);
+        global.data.cam        = reinterpret_cast<CamDataSSBO *>(cam.data);
+        global.data.env        = reinterpret_cast<EnvDataSSBO *>(env.data);
+        global.dynamic_offsets = {cam.offset, env.offset};
     }
     // Mesh Instances
     {
-        size_t size = rhi->PaddedSizeOfSSBO(sizeof(MeshInstanceSSBO) *
-                                            kMaxVisibleObjects);
-
-        char *begin     = (char *)(mesh_instances.data.begin);
-        char *instances = begin + idx * size;
+        auto instances = frame_context.instances.Allocate(
+            sizeof(MeshInstanceSSBO) * kMaxVisibleObjects);
 
         mesh_instances.data.cur_instance =
-            reinterpret_cast<MeshInstanceSSBO *>(instances);
+            reinterpret_cast<MeshInstanceSSBO *>(instances.data);
+        mesh_instances.dynamic_offsets = {instances.offset};
     }
 }
 
+void RenderResource::CmdReleaseFrameContext(VkCommandBuffer cmd) {
+    for (auto &[type, arena] : material_params_arenas_) {
+        arena->CmdFlush(cmd, frame_context.upload);
+    }
+
+    frame_context.Release();
+}
+
 void RenderResource::UpdateGlobalDescriptorSet() {
     EditGlobalDescriptorSet(true);
 
     global.skybox_material->Upload(this);
 }
 
-std::vector<uint32_t> RenderResource::GlobalSSBODynamicOffsets() const {
-    auto res = std::vector<uint32_t>{};
-
-    size_t cam_size = rhi->PaddedSizeOfSSBO<CamDataSSBO>();
-    size_t env_size = rhi->PaddedSizeOfSSBO<EnvDataSSBO>();
-
-    res.emplace_back(uint32_t(cam_size + env_size) * rhi->frame_idx());
-    res.emplace_back(res.back() + uint32_t(cam_size));
-    return res;
+std::array<uint32_t, 2> RenderResource::GlobalSSBODynamicOffsets() const {
+    return global.dynamic_offsets;
 }
 
-std::vector<uint32_t> RenderResource::MeshInstanceSSBODynamicOffsets() const {
-    auto res = std::vector<uint32_t>{};
-
-    size_t size =
-        rhi->PaddedSizeOfSSBO(sizeof(MeshInstanceSSBO) * kMaxVisibleObjects);
-
-    res.emplace_back(uint32_t(size) * rhi->frame_idx());
-    return res;
+std::array<uint32_t, 1> RenderResource::MeshInstanceSSBODynamicOffsets()
+    const {
+    return mesh_instances.dynamic_offsets;
 }
 
 VkShaderModule RenderResource::GetShaderModule(const std::string &name,
@@ -363,13 +780,13 @@ VkShaderModule RenderResource::CreateShaderModule(const std::string &name,
     const char *postfix = "";
     switch (type) {
         case kShaderTypeVertex:
-            postfix = ".vert.spv";
+            postfix = ".vert";
             break;
         case kShaderTypeFragment:
-            postfix = ".frag.spv";
+            postfix = ".frag";
             break;
         case kShaderTypeCompute:
-            postfix = ".comp.spv";
+            postfix = ".comp";
             break;
         default:
             LOG_ERROR("Unknown shader type {} when creating {}", type, name);
@@ -377,9 +794,23 @@ VkShaderModule RenderResource::CreateShaderModule(const std::string &name,
     }
 
     auto        p_shader = &shaders_[type][name];
-    std::string filepath = LUMI_SHADERS_DIR "/" + name + postfix;
-    if (!LoadVkShaderModule(filepath, p_shader)) {
-        LOG_ERROR("Error when loading shader from {}", filepath);
+    std::string filename = name + postfix;
+#ifdef LUMI_SHADERS_OVERRIDE
+    std::string filepath = LUMI_SHADERS_DIR "/" + filename + ".spv";
+    if (fs::exists(filepath)) {
+        if (!LoadVkShaderModule(filepath, p_shader)) {
+            LOG_ERROR("Error when loading shader from {}", filepath);
+        }
+    } else
+#endif
+    {
+        auto shader = FindEmbeddedShader(StringHash(filename));
+        if (!shader) {
+            LOG_ERROR("Shader {} is not embedded", filename);
+        } else if (!CreateVkShaderModule(shader->code, shader->size,
+                                         p_shader)) {
+            LOG_ERROR("Error when creating shader {}", filename);
+        }
     }
 
     dtor_queue_resource_.Push([this, p_shader]() {
@@ -425,6 +856,26 @@ Material *RenderResource::CreateMaterial(const std::string &name,
     return material.get();
 }
 
+Mesh *RenderResource::CreateMesh(const std::string             &name,
+                                 std::vector<vk::Vertex>      &&vertices,
+                                 std::vector<Mesh::IndexType> &&indices) {
+    Mesh *res = GetMesh(name);
+    if (res) {
+        LOG_WARNING("Create mesh with an existed name {}", name);
+        return res;
+    }
+
+    auto &mesh    = meshes_[name];
+    mesh.vertices = std::move(vertices);
+    mesh.indices  = std::move(indices);
+    for (auto &vertex : mesh.vertices) {
+        mesh.bbox.Merge(vertex.position);
+    }
+
+    UploadMesh(&mesh);
+    return &mesh;
+}
+
 Mesh *RenderResource::CreateMeshFromObjFile(const std::string &name,
                                             const fs::path    &filepath) {
     Mesh *res = GetMesh(name);
@@ -521,6 +972,10 @@ vk::Texture *RenderResource::CreateTexture2DFromFile(const std::string &name,
     int   texWidth, texHeight, texChannels;
     auto &absolute_path =
         filepath.is_absolute() ? filepath : LUMI_ASSETS_DIR / filepath;
+    if (absolute_path.extension() == ".ktx2") {
+        return CreateTexture2DFromKTX2(name, absolute_path);
+    }
+
     stbi_uc *pixels = stbi_load(absolute_path.string().c_str(), &texWidth,
                                 &texHeight, &texChannels, STBI_default);
     if (!pixels) {
@@ -538,27 +993,91 @@ vk::Texture *RenderResource::CreateTexture2DFromFile(const std::string &name,
             break;
         case STBI_grey:
             format = is_srgb ? VK_FORMAT_R8_SRGB : VK_FORMAT_R8_UNORM;
-            aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+            aspect = VK_IMAGE_ASPECT_COLOR_BIT;
             break;
         default:
             LOG_ERROR("Unknown image format when loading {}", filepath);
     }
 
     vk::TextureCreateInfo info{};
-    info.width  = texWidth;
-    info.height = texHeight;
-    info.format = format;
-    info.image_usage =
-        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    info.width       = texWidth;
+    info.height      = texHeight;
+    info.mip_levels  = MipGenerator::FullMipLevels(texWidth, texHeight);
+    info.format      = format;
+    info.image_usage = VK_IMAGE_USAGE_SAMPLED_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     info.memory_usage    = VMA_MEMORY_USAGE_GPU_ONLY;
-    info.aspect_flags    = aspect;
-    info.sampler_name    = "nearest";
-    vk::Texture *texture = CreateTexture2D(name, &info, pixels);
+    info.aspect_flags = aspect;
+    info.sampler_name = "nearest";
+
+    vk::Texture *texture =
+        CreateTexture2DShared(name, &info, pixels, BlockFormat::kBC7);
 
     stbi_image_free(pixels);
     return texture;
 }
 
+vk::Texture *RenderResource::CreateTexture2DFromKTX2(
+    const std::string &name, const fs::path &filepath) {
+    KTX2File file{};
+    if (!KTX2File::Load(filepath, &file)) {
+        return nullptr;
+    }
+
+    vk::TextureCreateInfo info{};
+    info.width       = file.width;
+    info.height      = file.height;
+    info.mip_levels  = (uint32_t)file.levels.size();
+    info.format      = file.format;
+    info.image_usage =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    info.memory_usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    info.aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
+    info.sampler_name = "linear";
+
+    uint64_t key = HashTextureContent(info, file.data.data(), file.data.size());
+    if (vk::Texture *shared = ShareTextureContent(name, key)) {
+        return shared;
+    }
+
+    if (rhi->SupportsSampledFormat(file.format)) {
+        return RecordTextureContent(
+            name, key,
+            CreateTexture2D(name, &info, file.data.data(), file.data.size(),
+                            file.levels));
+    }
+
+    // Decode to RGBA8 if the device cannot sample the block format
+    BlockFormat block_format{};
+    bool        is_srgb{};
+    if (!GetBlockFormat(file.format, &block_format, &is_srgb)) {
+        LOG_ERROR("Unsupported format {} in KTX2 file {}", file.format,
+                  filepath);
+        return nullptr;
+    }
+    info.format = is_srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+
+    std::vector<MipGenerator::Level> levels{};
+
+    size_t size = MipGenerator::ComputeLayout(file.width, file.height, 4,
+                                              info.mip_levels, levels);
+
+    std::vector<uint8_t> pixels(size);
+    for (uint32_t i = 0; i < info.mip_levels; i++) {
+        if (!BlockCompressor::Decode(
+                block_format, file.data.data() + file.levels[i].offset,
+                levels[i].width, levels[i].height,
+                pixels.data() + levels[i].offset)) {
+            LOG_ERROR("No uncompressed fallback for format {} in KTX2 file {}",
+                      file.format, filepath);
+            return nullptr;
+        }
+    }
+    return RecordTextureContent(
+        name, key, CreateTexture2D(name, &info, pixels.data(), size, levels));
+}
+
 vk::Texture *RenderResource::CreateTextureHDRFromFile(
     const std::string &name, const fs::path &filepath) {
 
@@ -579,23 +1098,27 @@ vk::Texture *RenderResource::CreateTextureHDRFromFile(
         return nullptr;
     }
 
+    // Stored as half floats, full precision is not needed for sampling
+    size_t                count = (size_t)texWidth * texHeight * 4;
+    std::vector<uint16_t> halves(count);
+    FloatConverter::ToHalf(pixels, halves.data(), count);
+    stbi_image_free(pixels);
+
     vk::TextureCreateInfo info{};
     info.width  = texWidth;
     info.height = texHeight;
-    info.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    info.format = VK_FORMAT_R16G16B16A16_SFLOAT;
     info.image_usage =
         VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-    info.memory_usage    = VMA_MEMORY_USAGE_GPU_ONLY;
-    info.aspect_flags    = VK_IMAGE_ASPECT_COLOR_BIT;
-    info.sampler_name    = "nearest";
-    vk::Texture *texture = CreateTexture2D(name, &info, pixels);
-
-    stbi_image_free(pixels);
-    return texture;
+    info.memory_usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    info.aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
+    info.sampler_name = "nearest";
+    return CreateTexture2D(name, &info, halves.data());
 }
 
 vk::Texture *RenderResource::CreateTextureCubemapFromFile(
-    const std::string &name, const fs::path &basepath) {
+    const std::string &name, const fs::path &basepath,
+    SphericalHarmonics::Coeffs *sh_irradiance) {
     vk::Texture *res = GetTexture(name);
     if (res) {
         LOG_WARNING("Create texture with an existed name {}", name);
@@ -604,29 +1127,40 @@ vk::Texture *RenderResource::CreateTextureCubemapFromFile(
 
     auto &absolute_path =
         basepath.is_absolute() ? basepath : LUMI_ASSETS_DIR / basepath;
-    // assume all textures have same width, height and format
-    int texWidth, texHeight, texChannels;
+    if (absolute_path.extension() == ".hdr") {
+        return CreateTextureCubemapFromEquirect(name, absolute_path,
+                                                sh_irradiance);
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    const auto            &faces = kCubemapFaceSuffixes;
+    std::array<HDRFile, 6> files{};
+    std::array<bool, 6>    loaded{};
+    ThreadPool::Instance().ParallelFor(6, [&](uint32_t i) {
+        loaded[i] =
+            HDRFile::Load(absolute_path.string() + faces[i], &files[i]);
+    });
 
-    std::array<const char *, 6> faces = {
-        "_X+.hdr", "_X-.hdr", "_Z+.hdr", "_Z-.hdr", "_Y+.hdr", "_Y-.hdr",
-    };
-    std::array<void *, 6> image_datas{};
+    // All faces must have the same size
     for (int i = 0; i < 6; i++) {
-        std::string &cur_name = absolute_path.string() + faces[i];
-        float       *pixels =
-            stbi_loadf(cur_name.c_str(), &texWidth, &texHeight, &texChannels,
-                       STBI_rgb_alpha);  // required 4-channels
-        if (!pixels) {
-            LOG_ERROR("Failed to load texture file {}", cur_name);
+        if (!loaded[i]) return nullptr;
+        if (files[i].width() != files[0].width() ||
+            files[i].height() != files[0].height()) {
+            LOG_ERROR("Cubemap face {}{} has a different size",
+                      absolute_path.string(), faces[i]);
             return nullptr;
         }
-        image_datas[i] = pixels;
     }
 
+    // Alpha is unused, pack into 32 bits if mipmaps can be blitted.
+    // Otherwise fall back to half floats.
+    bool packed = rhi->SupportsLinearBlit(VK_FORMAT_B10G11R11_UFLOAT_PACK32);
+
     vk::TextureCreateInfo info{};
-    info.width       = texWidth;
-    info.height      = texHeight;
-    info.format      = VK_FORMAT_R32G32B32A32_SFLOAT;
+    info.width  = files[0].width();
+    info.height = files[0].height();
+    info.format = packed ? VK_FORMAT_B10G11R11_UFLOAT_PACK32
+                         : VK_FORMAT_R16G16B16A16_SFLOAT;
     info.image_usage = VK_IMAGE_USAGE_SAMPLED_BIT |
                        VK_IMAGE_USAGE_TRANSFER_DST_BIT |
                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
@@ -634,16 +1168,275 @@ vk::Texture *RenderResource::CreateTextureCubemapFromFile(
     info.aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
     info.sampler_name = "cubemap";
 
-    info.mip_levels =
-        uint32_t(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+    info.mip_levels = MipGenerator::FullMipLevels(info.width, info.height);
 
-    vk::Texture *texture =
-        CreateTextureCubemap(name, &info, image_datas);
+    // Scanlines are decoded straight into the staging buffer, unless the
+    // faces are projected to SH as well. Staging memory is slow to read.
+    std::array<SphericalHarmonics::FaceSums, 6> sh_sums{};
+    auto decode = [&](uint32_t face, void *dst) {
+        if (!sh_irradiance) return files[face].Decode(info.format, dst);
+
+        uint32_t           texel_count = info.width * info.height;
+        std::vector<float> rgba((size_t)texel_count * 4);
+        if (!files[face].Decode(VK_FORMAT_R32G32B32A32_SFLOAT, rgba.data())) {
+            return false;
+        }
+        SphericalHarmonics::ProjectFace(face, VK_FORMAT_R32G32B32A32_SFLOAT,
+                                        rgba.data(), info.width,
+                                        &sh_sums[face]);
+        if (packed) {
+            FloatConverter::ToB10G11R11(rgba.data(), (uint32_t *)dst,
+                                        texel_count);
+        } else {
+            FloatConverter::ToHalf(rgba.data(), (uint16_t *)dst,
+                                   rgba.size());
+        }
+        return true;
+    };
+    res = CreateTextureCubemap(
+        name, &info, [&](uint32_t face, void *dst, size_t size) {
+            if (!decode(face, dst)) {
+                LOG_ERROR("Failed to decode cubemap face {}{}",
+                          absolute_path.string(), faces[face]);
+                memset(dst, 0, size);
+            }
+        });
+    if (sh_irradiance) {
+        *sh_irradiance =
+            SphericalHarmonics::ResolveIrradiance(sh_sums.data(), 6);
+    }
+
+    float elapsed_ms = std::chrono::duration<float, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    LOG_INFO("Loaded cubemap {} in {:.1f} ms", name, elapsed_ms);
+    return res;
+}
 
-    for (auto &data : image_datas) {
-        stbi_image_free(data);
+vk::Texture *RenderResource::CreateTextureCubemapFromEquirect(
+    const std::string &name, const fs::path &filepath,
+    SphericalHarmonics::Coeffs *sh_irradiance) {
+    auto start = std::chrono::steady_clock::now();
+
+    bool packed = rhi->SupportsLinearBlit(VK_FORMAT_B10G11R11_UFLOAT_PACK32);
+
+    vk::TextureCreateInfo info{};
+    info.format = packed ? VK_FORMAT_B10G11R11_UFLOAT_PACK32
+                         : VK_FORMAT_R16G16B16A16_SFLOAT;
+
+    // Cache key covers the source file and the output format, the blob
+    // starts with the face size followed by the 6 faces
+    uint64_t key = HashBytes(&info.format, sizeof(info.format));
+    if (!HashFileStamp(filepath, &key)) {
+        LOG_ERROR("Failed to load texture file {}", filepath);
+        return nullptr;
     }
-    return texture;
+
+    std::string          cache_name = name + ".cubemap";
+    std::vector<uint8_t> blob{};
+    uint32_t             face_dim = 0;
+    if (LoadCache(cache_name, key, blob) && blob.size() > sizeof(face_dim)) {
+        memcpy(&face_dim, blob.data(), sizeof(face_dim));
+    }
+
+    size_t texel_size = EquirectConverter::TexelSize(info.format);
+    size_t face_size  = (size_t)face_dim * face_dim * texel_size;
+    bool resampled = face_dim == 0 ||
+                     blob.size() != sizeof(face_dim) + face_size * 6;
+    if (resampled) {
+        HDRFile file{};
+        if (!HDRFile::Load(filepath, &file)) return nullptr;
+
+        std::vector<float> rgba((size_t)file.width() * file.height() * 4);
+        if (!file.Decode(VK_FORMAT_R32G32B32A32_SFLOAT, rgba.data())) {
+            return nullptr;
+        }
+
+        face_dim  = EquirectConverter::FaceSize(file.width());
+        face_size = (size_t)face_dim * face_dim * texel_size;
+        blob.resize(sizeof(face_dim) + face_size * 6);
+        memcpy(blob.data(), &face_dim, sizeof(face_dim));
+        EquirectConverter::ToCubemap(rgba.data(), file.width(), file.height(),
+                                     face_dim, info.format,
+                                     blob.data() + sizeof(face_dim));
+        SaveCache(cache_name, key, blob.data(), blob.size());
+    }
+
+    info.width       = face_dim;
+    info.height      = face_dim;
+    info.image_usage = VK_IMAGE_USAGE_SAMPLED_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    info.memory_usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    info.aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
+    info.sampler_name = "cubemap";
+    info.mip_levels   = MipGenerator::FullMipLevels(face_dim, face_dim);
+
+    const uint8_t *faces = blob.data() + sizeof(face_dim);
+
+    std::array<SphericalHarmonics::FaceSums, 6> sh_sums{};
+    vk::Texture *res = CreateTextureCubemap(
+        name, &info, [&](uint32_t face, void *dst, size_t size) {
+            memcpy(dst, faces + face * size, size);
+            if (sh_irradiance) {
+                SphericalHarmonics::ProjectFace(face, info.format,
+                                                faces + face * size, face_dim,
+                                                &sh_sums[face]);
+            }
+        });
+    if (sh_irradiance) {
+        *sh_irradiance =
+            SphericalHarmonics::ResolveIrradiance(sh_sums.data(), 6);
+    }
+
+    float elapsed_ms = std::chrono::duration<float, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    LOG_INFO("Loaded cubemap {} from {} in {:.1f} ms ({})", name,
+             filepath.filename(), elapsed_ms,
+             resampled ? "resampled" : "cached");
+    return res;
+}
+
+vk::Texture *RenderResource::CreateTextureSpecularIBLFromFile(
+    const std::string &name, const fs::path &basepath,
+    SphericalHarmonics::Coeffs *sh_irradiance) {
+    vk::Texture *res = GetTexture(name);
+    if (res) {
+        LOG_WARNING("Create texture with an existed name {}", name);
+        return res;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    auto &absolute_path =
+        basepath.is_absolute() ? basepath : LUMI_ASSETS_DIR / basepath;
+
+    // Levels are uploaded as they are, so no blit support is needed
+    bool packed =
+        rhi->SupportsSampledFormat(VK_FORMAT_B10G11R11_UFLOAT_PACK32);
+    VkFormat format = packed ? VK_FORMAT_B10G11R11_UFLOAT_PACK32
+                             : VK_FORMAT_R16G16B16A16_SFLOAT;
+
+    // Cache key covers the source files, the output format and the baker
+    uint64_t key = HashBytes(&IBLBaker::kVersion, sizeof(IBLBaker::kVersion));
+    key          = HashBytes(&format, sizeof(format), key);
+    bool found   = true;
+    if (absolute_path.extension() == ".hdr") {
+        found = HashFileStamp(absolute_path, &key);
+    } else {
+        for (const char *suffix : kCubemapFaceSuffixes) {
+            found = found &&
+                    HashFileStamp(absolute_path.string() + suffix, &key);
+        }
+    }
+    if (!found) {
+        LOG_ERROR("Failed to load texture file {}", absolute_path);
+        return nullptr;
+    }
+
+    // The blob starts with this header, followed by the packed mip chain
+    struct IBLBlobHeader {
+        uint32_t                   face_size{};
+        uint32_t                   mip_levels{};
+        SphericalHarmonics::Coeffs sh_irradiance{};
+    };
+
+    std::string                      cache_name = name + ".ibl";
+    std::vector<uint8_t>             blob{};
+    IBLBlobHeader                    header{};
+    std::vector<MipGenerator::Level> levels{};
+
+    uint32_t texel_size = EquirectConverter::TexelSize(format);
+    bool     needs_bake = true;
+    if (LoadCache(cache_name, key, blob) && blob.size() > sizeof(header)) {
+        memcpy(&header, blob.data(), sizeof(header));
+        size_t size = IBLBaker::ComputeCubemapLayout(
+            header.face_size, header.mip_levels, texel_size, levels);
+        needs_bake = blob.size() != sizeof(header) + size;
+    }
+    if (needs_bake) {
+        std::vector<float> faces{};
+        if (!LoadCubemapFacesHDR(absolute_path, faces, &header.face_size)) {
+            return nullptr;
+        }
+
+        size_t face_floats = (size_t)header.face_size * header.face_size * 4;
+        std::array<SphericalHarmonics::FaceSums, 6> sh_sums{};
+        ThreadPool::Instance().ParallelFor(6, [&](uint32_t face) {
+            SphericalHarmonics::ProjectFace(
+                face, VK_FORMAT_R32G32B32A32_SFLOAT,
+                faces.data() + face * face_floats, header.face_size,
+                &sh_sums[face]);
+        });
+        header.sh_irradiance =
+            SphericalHarmonics::ResolveIrradiance(sh_sums.data(), 6);
+
+        header.mip_levels = IBLBaker::SpecularMipLevels(header.face_size);
+        size_t size       = IBLBaker::ComputeCubemapLayout(
+            header.face_size, header.mip_levels, texel_size, levels);
+        blob.resize(sizeof(header) + size);
+        memcpy(blob.data(), &header, sizeof(header));
+        IBLBaker::PrefilterSpecular(faces.data(), header.face_size, format,
+                                    levels, blob.data() + sizeof(header));
+        SaveCache(cache_name, key, blob.data(), blob.size());
+    }
+    if (sh_irradiance) *sh_irradiance = header.sh_irradiance;
+
+    vk::TextureCreateInfo info{};
+    info.width  = header.face_size;
+    info.height = header.face_size;
+    info.format = format;
+    info.image_usage =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    info.memory_usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    info.aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
+    info.sampler_name = "cubemap";
+    info.mip_levels   = header.mip_levels;
+    res = CreateTextureCubemap(name, &info, blob.data() + sizeof(header),
+                               blob.size() - sizeof(header), levels);
+
+    float elapsed_ms = std::chrono::duration<float, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    LOG_INFO("Loaded specular IBL {} in {:.1f} ms ({})", name, elapsed_ms,
+             needs_bake ? "baked" : "cached");
+    return res;
+}
+
+vk::Texture *RenderResource::CreateBRDFLut(const std::string &name) {
+    auto start = std::chrono::steady_clock::now();
+
+    uint32_t lut_size = IBLBaker::kBRDFLutSize;
+    uint64_t key = HashBytes(&IBLBaker::kVersion, sizeof(IBLBaker::kVersion));
+    key          = HashBytes(&lut_size, sizeof(lut_size), key);
+
+    std::string          cache_name = name + ".lut";
+    std::vector<uint8_t> blob{};
+    size_t size  = (size_t)lut_size * lut_size * 2 * sizeof(uint16_t);
+    bool   baked = !LoadCache(cache_name, key, blob) || blob.size() != size;
+    if (baked) {
+        blob.resize(size);
+        IBLBaker::BakeBRDFLut(lut_size, (uint16_t *)blob.data());
+        SaveCache(cache_name, key, blob.data(), blob.size());
+    }
+
+    vk::TextureCreateInfo info{};
+    info.width  = lut_size;
+    info.height = lut_size;
+    info.format = VK_FORMAT_R16G16_SFLOAT;
+    info.image_usage =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    info.memory_usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    info.aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
+    info.sampler_name = "hdr";
+    vk::Texture *res  = CreateTexture2D(name, &info, blob.data());
+
+    float elapsed_ms = std::chrono::duration<float, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    LOG_INFO("Loaded BRDF lut {} in {:.1f} ms ({})", name, elapsed_ms,
+             baked ? "baked" : "cached");
+    return res;
 }
 
 void RenderResource::RegisterTexture(const std::string           &name,
@@ -657,6 +1450,92 @@ void RenderResource::RegisterTexture(const std::string           &name,
     textures_[name] = texture;
 }
 
+void RenderResource::DestroyMesh(const std::string &name) {
+    auto it = meshes_.find(name);
+    if (it == meshes_.end()) {
+        LOG_WARNING("Destroy mesh with an unknown name {}", name);
+        return;
+    }
+    vk::AllocatedBuffer vertex_buffer = it->second.vertex_buffer;
+    vk::AllocatedBuffer index_buffer  = it->second.index_buffer;
+    meshes_.erase(it);
+
+    rhi->DestroyDeferred([this, vertex_buffer, index_buffer]() mutable {
+        rhi->DestroyBuffer(&vertex_buffer);
+        rhi->DestroyBuffer(&index_buffer);
+    });
+}
+
+void RenderResource::DestroyTexture(const std::string &name) {
+    auto it = textures_.find(name);
+    if (it == textures_.end()) {
+        LOG_WARNING("Destroy texture with an unknown name {}", name);
+        return;
+    }
+    std::shared_ptr<vk::Texture> texture = std::move(it->second);
+    textures_.erase(it);
+
+    const std::string *alias = nullptr;
+    for (auto &[other_name, other] : textures_) {
+        if (other == texture) {
+            alias = &other_name;
+            break;
+        }
+    }
+
+    // Content keys follow a surviving alias, the name may be reused for
+    // other content
+    for (auto content = texture_contents_.begin();
+         content != texture_contents_.end();) {
+        if (content->second.name != name) {
+            content++;
+        } else if (alias != nullptr) {
+            content->second.name = *alias;
+            content++;
+        } else {
+            content = texture_contents_.erase(content);
+        }
+    }
+
+    // Still used by another name with the same content
+    if (alias != nullptr) return;
+    // Registered, destroyed by its creator
+    if (owned_textures_.erase(texture.get()) == 0) return;
+
+    // The slot is reused once no frame may sample it
+    uint32_t bindless_index = ~0u;
+    auto     bindless       = bindless_textures.indices.find(texture.get());
+    if (bindless != bindless_textures.indices.end()) {
+        bindless_index = bindless->second;
+        bindless_textures.indices.erase(bindless);
+    }
+
+    // Cached sets sampling the view are recycled before its handle value may
+    // be reused by a new view
+    rhi->DestroyDeferred([this, texture, bindless_index]() {
+        descriptor_allocator_.EvictSetsReferencing(texture->image.image_view);
+        rhi->DestroyTexture(texture.get());
+        if (bindless_index != ~0u) {
+            bindless_textures.free_indices.push_back(bindless_index);
+        }
+    });
+}
+
+void RenderResource::DestroyMaterial(const std::string &name) {
+    auto it = materials_.find(name);
+    if (it == materials_.end()) {
+        LOG_WARNING("Destroy material with an unknown name {}", name);
+        return;
+    }
+    std::shared_ptr<Material> material = std::move(it->second);
+    materials_.erase(it);
+
+    // Pipelines are shared by the cache, compiling ones are not handed over
+    pipeline_targets_.erase(&material->pipeline);
+
+    rhi->DestroyDeferred([this, material]() { material->Release(this); });
+}
+
 vk::Texture *RenderResource::CreateTexture2D(const std::string     &name,  //
                                              vk::TextureCreateInfo *info,  //
                                              const void            *pixels) {
@@ -679,14 +1558,143 @@ vk::Texture *RenderResource::CreateTexture2D(const std::string     &name,  //
                     info->sampler_name, name);
     }
 
-    dtor_queue_resource_.Push(
-        [this, texture]() { rhi->DestroyTexture(texture); });
+    owned_textures_.insert(texture);
+    return texture;
+}
+
+vk::Texture *RenderResource::CreateTexture2D(
+    const std::string &name, vk::TextureCreateInfo *info, const void *data,
+    size_t size, const std::vector<MipGenerator::Level> &levels) {
+
+    vk::Texture *res = GetTexture(name);
+    if (res) {
+        LOG_WARNING("Create texture with an existed name {}", name);
+        return res;
+    }
+    auto &texture_storage = textures_[name];
+    texture_storage       = std::make_shared<vk::Texture>();
+
+    vk::Texture *texture = texture_storage.get();
+    rhi->AllocateTexture2D(texture, info);
+    UploadTextureLevels(texture, data, size, levels, info->aspect_flags);
+
+    VkSampler sampler = GetSampler(info->sampler_name);
+    if (!sampler) {
+        LOG_WARNING("Unknown sampler name {} when creating texture {}",
+                    info->sampler_name, name);
+    }
+
+    owned_textures_.insert(texture);
+    return texture;
+}
+
+vk::Texture *RenderResource::CreateTexture2DCompressed(
+    const std::string &name, vk::TextureCreateInfo *info, const void *pixels,
+    BlockFormat format) {
+    bool is_srgb  = info->format == VK_FORMAT_R8G8B8A8_SRGB;
+    bool is_rgba8 = is_srgb || info->format == VK_FORMAT_R8G8B8A8_UNORM;
+
+    VkFormat block_vk_format = GetBlockVkFormat(format, is_srgb);
+    if (!is_rgba8 || !rhi->SupportsSampledFormat(block_vk_format)) {
+        return CreateTexture2D(name, info, pixels);
+    }
+
+    // Uncompressed mip chain first, then every level is encoded
+    std::vector<MipGenerator::Level> rgba_levels{};
+
+    size_t rgba_size = MipGenerator::ComputeLayout(
+        info->width, info->height, 4, info->mip_levels, rgba_levels);
+
+    std::vector<uint8_t> rgba(rgba_size);
+    memcpy(rgba.data(), pixels, (size_t)info->width * info->height * 4);
+    MipGenerator::Generate(rgba.data(), rgba_levels, 4, is_srgb);
+
+    std::vector<MipGenerator::Level> levels{};
+
+    size_t size = BlockCompressor::ComputeLayout(
+        format, info->width, info->height, info->mip_levels, levels);
+
+    std::vector<uint8_t> blocks(size);
+    for (size_t i = 0; i < levels.size(); i++) {
+        BlockCompressor::Encode(format, rgba.data() + rgba_levels[i].offset,
+                                levels[i].width, levels[i].height,
+                                blocks.data() + levels[i].offset);
+    }
+
+    vk::TextureCreateInfo block_info = *info;
+    block_info.format                = block_vk_format;
+    block_info.image_usage =
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    return CreateTexture2D(name, &block_info, blocks.data(), size, levels);
+}
+
+vk::Texture *RenderResource::CreateTexture2DShared(
+    const std::string &name, vk::TextureCreateInfo *info, const void *pixels,
+    BlockFormat format) {
+    bool is_r8    = info->format == VK_FORMAT_R8_SRGB ||
+                    info->format == VK_FORMAT_R8_UNORM;
+    bool is_rgba8 = info->format == VK_FORMAT_R8G8B8A8_SRGB ||
+                    info->format == VK_FORMAT_R8G8B8A8_UNORM;
+    if (!is_r8 && !is_rgba8) {
+        return CreateTexture2D(name, info, pixels);
+    }
+    size_t size = (size_t)info->width * info->height * (is_r8 ? 1 : 4);
+
+    bool compressed =
+        cvars::GetBool("texture.compression").value() && is_rgba8;
+
+    uint64_t key = HashTextureContent(*info, pixels, size);
+    key          = HashBytes(&compressed, sizeof(compressed), key);
+    if (compressed) key = HashBytes(&format, sizeof(format), key);
+    if (vk::Texture *shared = ShareTextureContent(name, key)) {
+        return shared;
+    }
+
+    return RecordTextureContent(
+        name, key,
+        compressed ? CreateTexture2DCompressed(name, info, pixels, format)
+                   : CreateTexture2D(name, info, pixels));
+}
+
+vk::Texture *RenderResource::ShareTextureContent(const std::string &name,
+                                                 uint64_t content_key) {
+    auto it = texture_contents_.find(content_key);
+    if (it == texture_contents_.end()) return nullptr;
+
+    // The name may hold another texture by now
+    auto shared = textures_.find(it->second.name);
+    if (shared == textures_.end() ||
+        shared->second.get() != it->second.texture) {
+        texture_contents_.erase(it);
+        return nullptr;
+    }
+    textures_[name] = shared->second;
+    LOG_INFO("Texture {} shares the content of {}", name, it->second.name);
+    return shared->second.get();
+}
+
+vk::Texture *RenderResource::RecordTextureContent(const std::string &name,
+                                                  uint64_t     content_key,
+                                                  vk::Texture *texture) {
+    if (texture != nullptr) {
+        texture_contents_[content_key] = {name, texture};
+    }
     return texture;
 }
 
 vk::Texture *RenderResource::CreateTextureCubemap(const std::string     &name,
                                                   vk::TextureCreateInfo *info,
                                                   std::array<void *, 6> &pixels) {
+    return CreateTextureCubemap(
+        name, info, [&pixels](uint32_t face, void *dst, size_t size) {
+            memcpy(dst, pixels[face], size);
+        });
+}
+
+vk::Texture *RenderResource::CreateTextureCubemap(
+    const std::string &name, vk::TextureCreateInfo *info, const void *data,
+    size_t size, const std::vector<MipGenerator::Level> &levels) {
+
     vk::Texture *res = GetTexture(name);
     if (res) {
         LOG_WARNING("Create texture with an existed name {}", name);
@@ -697,7 +1705,7 @@ vk::Texture *RenderResource::CreateTextureCubemap(const std::string     &name,
 
     vk::Texture *texture = texture_storage.get();
     rhi->AllocateTextureCubemap(texture, info);
-    UploadTextureCubemap(texture, pixels, info->aspect_flags, info->mip_levels);
+    UploadTextureLevels(texture, data, size, levels, info->aspect_flags, 6);
 
     VkSampler sampler = GetSampler(info->sampler_name);
     if (!sampler) {
@@ -705,8 +1713,33 @@ vk::Texture *RenderResource::CreateTextureCubemap(const std::string     &name,
                     info->sampler_name, name);
     }
 
-    dtor_queue_resource_.Push(
-        [this, texture]() { rhi->DestroyTexture(texture); });
+    owned_textures_.insert(texture);
+    return texture;
+}
+
+vk::Texture *RenderResource::CreateTextureCubemap(
+    const std::string &name, vk::TextureCreateInfo *info,
+    const CubemapFaceFunc &fill_face) {
+    vk::Texture *res = GetTexture(name);
+    if (res) {
+        LOG_WARNING("Create texture with an existed name {}", name);
+        return res;
+    }
+    auto &texture_storage = textures_[name];
+    texture_storage       = std::make_shared<vk::Texture>();
+
+    vk::Texture *texture = texture_storage.get();
+    rhi->AllocateTextureCubemap(texture, info);
+    UploadTextureCubemap(texture, fill_face, info->aspect_flags,
+                         info->mip_levels);
+
+    VkSampler sampler = GetSampler(info->sampler_name);
+    if (!sampler) {
+        LOG_WARNING("Unknown sampler name {} when creating texture {}",
+                    info->sampler_name, name);
+    }
+
+    owned_textures_.insert(texture);
     return texture;
 }
 
@@ -720,16 +1753,21 @@ bool RenderResource::LoadVkShaderModule(const std::string &filepath,
     // The cursor is at the end, it gives the size directly in bytes
     size_t file_size = (size_t)shader_file.tellg();
 
-    std::vector<char> buffer(file_size);
+    std::vector<uint32_t> buffer((file_size + 3) / sizeof(uint32_t));
     shader_file.seekg(0);
-    shader_file.read(buffer.data(), file_size);
+    shader_file.read((char *)buffer.data(), file_size);
     shader_file.close();
 
+    return CreateVkShaderModule(buffer.data(), file_size, p_shader_module);
+}
+
+bool RenderResource::CreateVkShaderModule(const uint32_t *code, size_t size,
+                                          VkShaderModule *p_shader_module) {
     VkShaderModuleCreateInfo createInfo{};
     createInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     createInfo.pNext    = nullptr;
-    createInfo.codeSize = buffer.size();
-    createInfo.pCode    = (uint32_t *)buffer.data();
+    createInfo.codeSize = size;
+    createInfo.pCode    = code;
 
     if (vkCreateShaderModule(rhi->device(), &createInfo, nullptr,
                              p_shader_module) != VK_SUCCESS) {
@@ -755,8 +1793,6 @@ void RenderResource::UploadMesh(Mesh *mesh) {
             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
             VMA_MEMORY_USAGE_GPU_ONLY);
-        dtor_queue_resource_.Push(
-            [this, mesh]() { rhi->DestroyBuffer(&mesh->vertex_buffer); });
 
         // data -> staging buffer
         rhi->CopyBuffer(mesh->vertices.data(), &staging_buffer, buffer_size);
@@ -779,8 +1815,6 @@ void RenderResource::UploadMesh(Mesh *mesh) {
             buffer_size,
             VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
             VMA_MEMORY_USAGE_GPU_ONLY);
-        dtor_queue_resource_.Push(
-            [this, mesh]() { rhi->DestroyBuffer(&mesh->index_buffer); });
 
         // data -> staging buffer
         rhi->CopyBuffer(mesh->indices.data(), &staging_buffer, buffer_size);
@@ -795,6 +1829,18 @@ void RenderResource::UploadTexture2D(vk::Texture *texture, const void *pixels,
     VkDeviceSize channels     = 0;
     size_t       element_size = sizeof(char);
     switch (texture->format) {
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+            element_size = sizeof(uint32_t);
+            channels     = 1;
+            break;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            element_size = sizeof(uint16_t);
+            channels     = 4;
+            break;
+        case VK_FORMAT_R16G16_SFLOAT:
+            element_size = sizeof(uint16_t);
+            channels     = 2;
+            break;
         case VK_FORMAT_R32G32B32A32_SFLOAT:
             element_size = sizeof(float);
         case VK_FORMAT_R8G8B8A8_SRGB:
@@ -815,6 +1861,30 @@ void RenderResource::UploadTexture2D(vk::Texture *texture, const void *pixels,
     VkDeviceSize image_size =
         channels * texture->width * texture->height * element_size;
 
+    // Mipmaps of 8-bit textures can be built on the CPU, which is also the
+    // fallback for formats without linear blit support
+    uint32_t mip_levels  = texture->mip_levels;
+    bool     mips_on_cpu = mip_levels > 1 && element_size == sizeof(char) &&
+                       (cvars::GetBool("texture.cpu_mipmaps").value() ||
+                        !rhi->SupportsLinearBlit(texture->format));
+    if (mips_on_cpu) {
+        bool is_srgb = texture->format == VK_FORMAT_R8G8B8A8_SRGB ||
+                       texture->format == VK_FORMAT_R8_SRGB;
+
+        std::vector<MipGenerator::Level> levels{};
+
+        size_t size =
+            MipGenerator::ComputeLayout(texture->width, texture->height,
+                                        (uint32_t)channels, mip_levels, levels);
+
+        std::vector<uint8_t> data(size);
+        memcpy(data.data(), pixels, image_size);
+        MipGenerator::Generate(data.data(), levels, (uint32_t)channels,
+                               is_srgb);
+        UploadTextureLevels(texture, data.data(), size, levels, aspect);
+        return;
+    }
+
     // allocate temporary buffer for holding texture data to upload
     vk::AllocatedBuffer staging_buffer =
         rhi->AllocateBuffer(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -827,12 +1897,12 @@ void RenderResource::UploadTexture2D(vk::Texture *texture, const void *pixels,
     rhi->CopyBuffer(pixels, &staging_buffer, image_size);
 
     // staging buffer -> texture
-    rhi->ImmediateSubmit([this, texture, aspect,
+    rhi->ImmediateSubmit([this, texture, aspect, mip_levels,
                           &staging_buffer](VkCommandBuffer cmd) {
         // --- Transit image layout to transfer_dst ---
-        rhi->CmdImageLayoutTransition(cmd, texture->image.image, aspect,
-                                      VK_IMAGE_LAYOUT_UNDEFINED,
-                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        rhi->CmdImageLayoutTransition(
+            cmd, texture->image.image, aspect, VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels);
 
         // --- Copy data to texture ---
         rhi->CmdCopyBufferToImage(cmd, staging_buffer.buffer,
@@ -840,19 +1910,72 @@ void RenderResource::UploadTexture2D(vk::Texture *texture, const void *pixels,
                                   texture->height);
 
         // --- Transit image layout to shader readable ---
-        rhi->CmdImageLayoutTransition(cmd, texture->image.image, aspect,
-                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        if (mip_levels > 1) {
+            rhi->CmdGenerateMipMaps(cmd, texture, aspect, mip_levels, 1);
+        } else {
+            rhi->CmdImageLayoutTransition(
+                cmd, texture->image.image, aspect,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    });
+}
+
+void RenderResource::UploadTextureLevels(
+    vk::Texture *texture, const void *data, size_t size,
+    const std::vector<MipGenerator::Level> &levels, VkImageAspectFlags aspect,
+    uint32_t layers) {
+    uint32_t mip_levels = (uint32_t)levels.size();
+
+    // allocate temporary buffer for holding texture data to upload
+    vk::AllocatedBuffer staging_buffer = rhi->AllocateBuffer(
+        size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+    ScopeGuard guard = [this, &staging_buffer]() {
+        rhi->DestroyBuffer(&staging_buffer);
+    };
+
+    // data -> staging buffer
+    rhi->CopyBuffer(data, &staging_buffer, size);
+
+    // staging buffer -> texture
+    rhi->ImmediateSubmit([this, texture, aspect, mip_levels, layers, &levels,
+                          &staging_buffer](VkCommandBuffer cmd) {
+        // --- Transit image layout to transfer_dst ---
+        rhi->CmdImageLayoutTransition(
+            cmd, texture->image.image, aspect, VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels, layers);
+
+        // --- Copy every level to texture ---
+        for (uint32_t i = 0; i < mip_levels; i++) {
+            rhi->CmdCopyBufferToImage(
+                cmd, staging_buffer.buffer, texture->image.image, aspect,
+                levels[i].width, levels[i].height, layers, i,
+                levels[i].offset);
+        }
+
+        // --- Transit image layout to shader readable ---
+        rhi->CmdImageLayoutTransition(
+            cmd, texture->image.image, aspect,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mip_levels, layers);
     });
 }
 
 void RenderResource::UploadTextureCubemap(vk::Texture           *texture,
-                                          std::array<void *, 6> &pixels,
+                                          const CubemapFaceFunc &fill_face,
                                           VkImageAspectFlags     aspect,
                                           uint32_t               mip_levels) {
     VkDeviceSize channels     = 0;
     size_t       element_size = sizeof(char);
     switch (texture->format) {
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+            element_size = sizeof(uint32_t);
+            channels     = 1;
+            break;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            element_size = sizeof(uint16_t);
+            channels     = 4;
+            break;
         case VK_FORMAT_R32G32B32A32_SFLOAT:
             element_size = sizeof(float);
         case VK_FORMAT_R8G8B8A8_SRGB:
@@ -883,13 +2006,10 @@ void RenderResource::UploadTextureCubemap(vk::Texture           *texture,
         rhi->DestroyBuffer(&staging_buffer);
     };
 
-    // data -> staging buffer
-    VkDeviceSize offset = 0;
-    for (int i = 0; i < 6; i++) {
-        char *src_data = (char *)pixels[i];
-        memcpy(dst_data + offset, src_data, image_size);
-        offset += image_size;
-    }
+    // data -> staging buffer, one face per job
+    ThreadPool::Instance().ParallelFor(6, [&](uint32_t face) {
+        fill_face(face, dst_data + face * image_size, (size_t)image_size);
+    });
 
     // staging buffer -> cubemap
     rhi->ImmediateSubmit([this, texture, aspect, mip_levels,
@@ -949,41 +2069,27 @@ void RenderResource::LoadFromGLTFFile(const fs::path &filepath) {
     UploadMesh(&mesh);
 }
 
-void RenderResource::GLTFLoadTexture(const std::string &name,
-                                     tinygltf::Model &gltf_model, int idx,
-                                     bool is_srgb) {
-    const std::string &tex_name = name + "_tex_" + std::to_string(idx);
-    if (GetTexture(tex_name) != nullptr) return;
-
-    tinygltf::Texture &tex   = gltf_model.textures[idx];
-    tinygltf::Image   &image = gltf_model.images[tex.source];
+// Size, mipmaps and sampler of a glTF texture, the format is left to callers
+static vk::TextureCreateInfo GLTFTextureCreateInfo(
+    const tinygltf::Model &gltf_model, const tinygltf::Texture &tex,
+    const std::string &tex_name) {
+    const tinygltf::Image &image = gltf_model.images[tex.source];
 
     vk::TextureCreateInfo info{};
-    info.width  = image.width;
-    info.height = image.height;
-    info.image_usage =
-        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    info.width       = image.width;
+    info.height      = image.height;
+    info.mip_levels  = MipGenerator::FullMipLevels(image.width, image.height);
+    info.image_usage = VK_IMAGE_USAGE_SAMPLED_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                       VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     info.memory_usage = VMA_MEMORY_USAGE_GPU_ONLY;
     info.aspect_flags = VK_IMAGE_ASPECT_COLOR_BIT;
 
-    switch (image.component) {
-        case 1:
-            info.format = is_srgb ? VK_FORMAT_R8_SRGB : VK_FORMAT_R8_UNORM;
-            break;
-        case 4:
-            info.format =
-                is_srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
-            break;
-        default:
-            LOG_ERROR("Unsupported image component number {}", image.component);
-            break;
-    }
-
     if (tex.sampler == -1) {
         // No sampler specified, use a default one
         info.sampler_name = "linear";
     } else {
-        tinygltf::Sampler &sampler = gltf_model.samplers[tex.sampler];
+        const tinygltf::Sampler &sampler = gltf_model.samplers[tex.sampler];
         switch (sampler.minFilter) {
             case -1:
             case TINYGLTF_TEXTURE_FILTER_NEAREST:
@@ -997,15 +2103,123 @@ void RenderResource::GLTFLoadTexture(const std::string &name,
                 info.sampler_name = "linear";
                 break;
             default:
-                LOG_ERROR(
-                    "Unknown filter mode when loading GLTF texture "
-                    "{}_tex_{}",
-                    name, idx);
+                LOG_ERROR("Unknown filter mode when loading GLTF texture {}",
+                          tex_name);
                 break;
         }
+
+        // Mipmaps are only sampled with the *_MIPMAP_* filters
+        if (sampler.minFilter == TINYGLTF_TEXTURE_FILTER_NEAREST ||
+            sampler.minFilter == TINYGLTF_TEXTURE_FILTER_LINEAR) {
+            info.mip_levels = 1;
+        }
     }
+    return info;
+}
 
-    CreateTexture2D(tex_name, &info, image.image.data());
+// Copies one channel of an 8-bit image into one channel of an RGBA8 image,
+// resampled with the nearest texel if the sizes differ
+static bool CopyImageChannel(const tinygltf::Image &image, uint32_t channel,
+                             uint32_t width, uint32_t height, uint8_t *rgba,
+                             uint32_t dst_channel) {
+    if (image.bits != 8 || image.component <= 0 || image.width <= 0 ||
+        image.height <= 0) {
+        return false;
+    }
+    uint32_t components = (uint32_t)image.component;
+    uint32_t src_width  = (uint32_t)image.width;
+    uint32_t src_height = (uint32_t)image.height;
+    channel             = std::min(channel, components - 1);
+
+    for (uint32_t y = 0; y < height; y++) {
+        size_t         src_y = (size_t)y * src_height / height;
+        const uint8_t *row = image.image.data() + src_y * src_width * components;
+        uint8_t       *out = rgba + (size_t)y * width * 4 + dst_channel;
+        for (uint32_t x = 0; x < width; x++) {
+            out[x * 4] = row[(x * src_width / width) * components + channel];
+        }
+    }
+    return true;
+}
+
+void RenderResource::GLTFLoadTexture(const std::string &name,
+                                     tinygltf::Model &gltf_model, int idx,
+                                     bool is_srgb, bool is_normal_map) {
+    const std::string &tex_name = name + "_tex_" + std::to_string(idx);
+    if (GetTexture(tex_name) != nullptr) return;
+
+    tinygltf::Texture &tex   = gltf_model.textures[idx];
+    tinygltf::Image   &image = gltf_model.images[tex.source];
+
+    vk::TextureCreateInfo info =
+        GLTFTextureCreateInfo(gltf_model, tex, tex_name);
+    switch (image.component) {
+        case 1:
+            info.format = is_srgb ? VK_FORMAT_R8_SRGB : VK_FORMAT_R8_UNORM;
+            break;
+        case 4:
+            info.format =
+                is_srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+            break;
+        default:
+            LOG_ERROR("Unsupported image component number {}", image.component);
+            return;
+    }
+
+    // Normal maps keep xy only, z is reconstructed in shaders
+    BlockFormat format = is_normal_map ? BlockFormat::kBC5 : BlockFormat::kBC7;
+    CreateTexture2DShared(tex_name, &info, image.image.data(), format);
+}
+
+std::string RenderResource::GLTFLoadOcclusionRoughnessMetallic(
+    const std::string &name, tinygltf::Model &gltf_model, int occlusion_idx,
+    int metallic_roughness_idx) {
+    // Already packed by the exporter
+    if (occlusion_idx == metallic_roughness_idx) {
+        GLTFLoadTexture(name, gltf_model, occlusion_idx, false);
+        return name + "_tex_" + std::to_string(occlusion_idx);
+    }
+
+    std::string tex_name = name + "_orm_" + std::to_string(occlusion_idx) +
+                           "_" + std::to_string(metallic_roughness_idx);
+    if (GetTexture(tex_name) != nullptr) return tex_name;
+
+    // Size and sampler follow the metallic roughness texture if there is one
+    int base_idx =
+        metallic_roughness_idx >= 0 ? metallic_roughness_idx : occlusion_idx;
+    vk::TextureCreateInfo info =
+        GLTFTextureCreateInfo(gltf_model, gltf_model.textures[base_idx],
+                              tex_name);
+    info.format = VK_FORMAT_R8G8B8A8_UNORM;
+
+    // Same defaults as the orm_default texture
+    std::vector<uint8_t> pixels((size_t)info.width * info.height * 4);
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        memcpy(pixels.data() + i, &Color4u8::kYellow, 4);
+    }
+
+    bool copied = true;
+    if (occlusion_idx >= 0) {
+        const tinygltf::Image &image =
+            gltf_model.images[gltf_model.textures[occlusion_idx].source];
+        copied = CopyImageChannel(image, 0, info.width, info.height,
+                                  pixels.data(), 0);
+    }
+    if (metallic_roughness_idx >= 0) {
+        const tinygltf::Image &image =
+            gltf_model.images[gltf_model.textures[metallic_roughness_idx]
+                                  .source];
+        for (uint32_t c = 1; c <= 2; c++) {
+            copied = copied && CopyImageChannel(image, c, info.width,
+                                                info.height, pixels.data(), c);
+        }
+    }
+    if (!copied) {
+        LOG_ERROR("Only 8-bit images are packed into {}", tex_name);
+    }
+
+    CreateTexture2DShared(tex_name, &info, pixels.data(), BlockFormat::kBC7);
+    return tex_name;
 }
 
 void RenderResource::GLTFLoadMaterials(const std::string &name,
@@ -1024,37 +2238,59 @@ void RenderResource::GLTFLoadMaterials(const std::string &name,
             GLTFLoadTexture(name, gltf_model, tex_idx, true);
             material->base_color_tex_name =
                 name + "_tex_" + std::to_string(tex_idx);
-            material->params.data->texcoord_set_base_color =
+            material->params->texcoord_set_base_color =
                 mat.values["baseColorTexture"].TextureTexCoord();
         }
+
+        // Occlusion, roughness and metallic are packed into one texture
+        int occlusion_idx          = -1;
+        int metallic_roughness_idx = -1;
+        int orm_texcoord_set       = 0;
         if (mat.values.find("metallicRoughnessTexture") != mat.values.end()) {
-            int tex_idx = mat.values["metallicRoughnessTexture"].TextureIndex();
-            GLTFLoadTexture(name, gltf_model, tex_idx, true);
-            material->metallic_roughness_tex_name =
-                name + "_tex_" + std::to_string(tex_idx);
-            material->params.data->texcoord_set_metallic_roughness =
-                mat.values["metallicRoughnessTexture"].TextureTexCoord();
+            auto &param            = mat.values["metallicRoughnessTexture"];
+            metallic_roughness_idx = param.TextureIndex();
+            orm_texcoord_set       = param.TextureTexCoord();
+        }
+        if (mat.additionalValues.find("occlusionTexture") !=
+            mat.additionalValues.end()) {
+            auto &param   = mat.additionalValues["occlusionTexture"];
+            occlusion_idx = param.TextureIndex();
+            if (metallic_roughness_idx < 0) {
+                orm_texcoord_set = param.TextureTexCoord();
+            } else if (param.TextureTexCoord() != orm_texcoord_set) {
+                LOG_WARNING(
+                    "Occlusion of {}_mat_{} is sampled with the texcoord set "
+                    "of metallic roughness",
+                    name, i);
+            }
+        }
+        if (occlusion_idx >= 0 || metallic_roughness_idx >= 0) {
+            material->occlusion_roughness_metallic_tex_name =
+                GLTFLoadOcclusionRoughnessMetallic(
+                    name, gltf_model, occlusion_idx, metallic_roughness_idx);
+            material->params->texcoord_set_occlusion_roughness_metallic =
+                orm_texcoord_set;
         }
         if (mat.values.find("roughnessFactor") != mat.values.end()) {
-            material->params.data->roughness_factor =
+            material->params->roughness_factor =
                 static_cast<float>(mat.values["roughnessFactor"].Factor());
         }
         if (mat.values.find("metallicFactor") != mat.values.end()) {
-            material->params.data->metallic_factor =
+            material->params->metallic_factor =
                 static_cast<float>(mat.values["metallicFactor"].Factor());
         }
         if (mat.values.find("baseColorFactor") != mat.values.end()) {
             auto color = mat.values["baseColorFactor"].ColorFactor();
-            material->params.data->base_color_factor =
+            material->params->base_color_factor =
                 Vec4f(color[0], color[1], color[2], color[3]);
         }
         if (mat.additionalValues.find("normalTexture") !=
             mat.additionalValues.end()) {
             int tex_idx = mat.additionalValues["normalTexture"].TextureIndex();
-            GLTFLoadTexture(name, gltf_model, tex_idx, false);
+            GLTFLoadTexture(name, gltf_model, tex_idx, false, true);
             material->normal_tex_name =
                 name + "_tex_" + std::to_string(tex_idx);
-            material->params.data->texcoord_set_normal =
+            material->params->texcoord_set_normal =
                 mat.additionalValues["normalTexture"].TextureTexCoord();
         }
         if (mat.additionalValues.find("emissiveTexture") !=
@@ -1064,40 +2300,29 @@ void RenderResource::GLTFLoadMaterials(const std::string &name,
             GLTFLoadTexture(name, gltf_model, tex_idx, true);
             material->emissive_tex_name =
                 name + "_tex_" + std::to_string(tex_idx);
-            material->params.data->texcoord_set_emissive =
+            material->params->texcoord_set_emissive =
                 mat.additionalValues["emissiveTexture"].TextureTexCoord();
         }
-        if (mat.additionalValues.find("occlusionTexture") !=
-            mat.additionalValues.end()) {
-            int tex_idx =
-                mat.additionalValues["occlusionTexture"].TextureIndex();
-            GLTFLoadTexture(name, gltf_model, tex_idx, false);
-            material->occlusion_tex_name =
-                name + "_tex_" + std::to_string(tex_idx);
-            material->params.data->texcoord_set_occlusion =
-                mat.additionalValues["occlusionTexture"].TextureTexCoord();
-        }
         if (mat.additionalValues.find("alphaMode") !=
             mat.additionalValues.end()) {
             tinygltf::Parameter param = mat.additionalValues["alphaMode"];
             if (param.string_value == "BLEND") {
-                material->params.data->alpha_mode =
-                    PBRMaterial::kAlphaModeBlend;
+                material->params->alpha_mode = PBRMaterial::kAlphaModeBlend;
             }
             if (param.string_value == "MASK") {
-                material->params.data->alpha_mode = PBRMaterial::kAlphaModeMask;
-                material->params.data->alpha_cutoff = 0.5f;
+                material->params->alpha_mode = PBRMaterial::kAlphaModeMask;
+                material->params->alpha_cutoff = 0.5f;
             }
         }
         if (mat.additionalValues.find("alphaCutoff") !=
             mat.additionalValues.end()) {
-            material->params.data->alpha_cutoff = static_cast<float>(
+            material->params->alpha_cutoff = static_cast<float>(
                 mat.additionalValues["alphaCutoff"].Factor());
         }
         if (mat.additionalValues.find("emissiveFactor") !=
             mat.additionalValues.end()) {
             auto color = mat.additionalValues["emissiveFactor"].ColorFactor();
-            material->params.data->emissive_factor =
+            material->params->emissive_factor =
                 Vec4f(color[0], color[1], color[2], 1.0f);
         }
 
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <unordered_set>
+
+#include "core/thread_pool.h"
+#include "culling/software_occlusion_culler.h"
+#include "frame/frame_context.h"
 #include "material/material.h"
 #include "material/skybox_material.h"
+#include "pacing/frame_pacer.h"
 #include "rhi/vulkan_descriptors.h"
 #include "rhi/vulkan_rhi.h"
+#include "texture/block_compressor.h"
+#include "texture/spherical_harmonics.h"
 
 namespace tinygltf {
 class Model;
@@ -32,12 +40,21 @@ struct Mesh {
 };
 
 struct RenderObject {
-    std::string mesh_name       = "";
-    std::string material_name   = "";
-    Vec3f       position        = Vec3f::kZero;
-    Quaternion  rotation        = Quaternion::kIdentity;
-    Vec3f       scale           = Vec3f::kUnitScale;
-    Mat4x4f     object_to_world = Mat4x4f::kIdentity;
+    std::string mesh_name          = "";
+    std::string material_name      = "";
+    Vec3f       position           = Vec3f::kZero;
+    Quaternion  rotation           = Quaternion::kIdentity;
+    Vec3f       scale              = Vec3f::kUnitScale;
+    Mat4x4f     object_to_world    = Mat4x4f::kIdentity;
+    // Mesh rasterized for occlusion culling, empty if not an occluder
+    std::string occluder_mesh_name = "";
+    // Static objects are merged by material at load time
+    bool        is_static          = false;
+
+    Mat4x4f ComputeObjectToWorld() const {
+        return Mat4x4f::Translation(position) * Mat4x4f(rotation) *
+               Mat4x4f::Scale(scale);
+    }
 };
 
 struct RenderObjectDesc {
@@ -46,10 +63,17 @@ struct RenderObjectDesc {
     Material*     material = nullptr;
 };
 
+// Instanced draw of one visible batch
+struct DrawCall {
+    Material* material{};
+    Mesh*     mesh{};
+    uint32_t  instance_count{};
+    uint32_t  first_instance{};
+};
+
 enum GlobalBindingSlot {
     kGlobalBindingCamera = 0,
     kGlobalBindingEnvironment,
-    kGlobalBindingSkyboxIrradiance,
     kGlobalBindingSkyboxSpecular,
     kGlobalBindingLutBrdf,
     kGlobalBindingShadowMapDirectional,
@@ -75,6 +99,14 @@ struct EnvDataSSBO {
 
     Mat4x4f sunlight_world_to_clip{};
 
+    // Diffuse IBL as SH coefficients, w is unused
+    Vec4f sh_irradiance[SphericalHarmonics::kCoeffCount]{};
+};
+
+enum BindlessBindingSlot {
+    kBindlessBindingTextures = 0,
+
+    kBindlessBindingCount
 };
 
 enum MeshInstanceBindingSlot {
@@ -90,36 +122,65 @@ struct MeshInstanceSSBO {
 
 class RenderResource {
 public:
-    constexpr static int          kMaxVisibleObjects = 100;
+    constexpr static int          kMaxVisibleObjects      = 100;
+    constexpr static uint32_t     kMaxBindlessTextures    = 4096;
+    constexpr static uint32_t     kPipelineCompileThreads = 2;
+    // Flat shaded fragment shader drawn while pipelines are compiling
+    constexpr static const char*  kFallbackShaderName     = "fallback";
 
     // reorganized render objects
     std::unordered_map<Material*,
                        std::unordered_map<Mesh*, std::vector<RenderObjectDesc>>>
         visibles_drawcall_batchs{};
+    // Keys of visibles_drawcall_batchs sorted by pipeline, instance data and
+    // draws follow this order
+    std::vector<Material*> visible_materials{};
+    // Visible batches in the same order, each one indexes its instance data
+    std::vector<DrawCall> visible_draws{};
+
+    SoftwareOcclusionCuller occlusion_culler{};
+
+    FramePacer frame_pacer{};
+
+    // Per frame data written by the CPU, see AcquireFrameContext
+    FrameContext frame_context{};
 
     struct {
-        vk::DescriptorSet   descriptor_set{};
-        vk::AllocatedBuffer staging_buffer{};
-        vk::AllocatedBuffer buffer{};
+        vk::DescriptorSet descriptor_set{};
         struct {
-            void*        begin{};
             CamDataSSBO* cam{};
             EnvDataSSBO* env{};
-        } data{};  // Mapped pointers
+        } data{};  // Mapped pointers of the current frame
+
+        std::array<uint32_t, 2> dynamic_offsets{};
 
         SkyboxMaterial* skybox_material{};
+
+        // Diffuse lighting of the skybox, see EnvDataSSBO
+        SphericalHarmonics::Coeffs sh_irradiance{};
     } global{};
 
     struct {
-        vk::DescriptorSet   descriptor_set{};
-        vk::AllocatedBuffer staging_buffer{};
-        vk::AllocatedBuffer buffer{};
+        vk::DescriptorSet descriptor_set{};
         struct {
-            void*             begin{};
             MeshInstanceSSBO* cur_instance{};
-        } data{};  // Mapped pointers
+        } data{};  // Mapped pointers of the current frame
+
+        std::array<uint32_t, 1> dynamic_offsets{};
     } mesh_instances{};
 
+    // Sampled 2D textures of all materials in one update-after-bind array,
+    // slots are never rewritten while frames in flight may sample them. Slots
+    // of destroyed textures are reused once those frames are complete.
+    struct {
+        vk::DescriptorSet descriptor_set{};
+        VkDescriptorPool  pool{};
+
+        std::unordered_map<vk::Texture*, uint32_t> indices{};
+        std::vector<uint32_t>                      free_indices{};
+        uint32_t                                   next_index{};
+    } bindless_textures{};
+
     std::shared_ptr<VulkanRHI> rhi{};
 
 private:
@@ -132,6 +193,47 @@ private:
     std::unordered_map<std::string, VkSampler>                    samplers_{};
     std::unordered_map<std::string, Mesh>                         meshes_{};
     std::unordered_map<std::string, std::shared_ptr<Material>>    materials_{};
+    // Textures created by the resource, registered ones belong to their
+    // creator. Shared by every name of the same content.
+    std::unordered_set<vk::Texture*> owned_textures_{};
+
+    struct TextureContent {
+        std::string  name{};  // Any name sharing the texture
+        vk::Texture* texture{};
+    };
+
+    // Content key -> texture created with that content
+    std::unordered_map<uint64_t, TextureContent> texture_contents_{};
+
+    std::unordered_map<std::string, std::unique_ptr<MaterialParamsArena>>
+        material_params_arenas_{};
+
+    // State hash -> pipeline objects shared by all materials with that state
+    std::unordered_map<uint64_t, VkPipelineLayout> pipeline_layouts_{};
+    std::unordered_map<uint64_t, VkPipeline>       pipelines_{};
+    float                                          pipeline_build_ms_{};
+
+    struct CompiledPipeline {
+        VkPipeline pipeline{};
+        float      elapsed_ms{};
+    };
+
+    struct PipelineRequest {
+        VkPipeline* target{};
+        uint64_t    key{};  // Requested state, differs for fallbacks
+    };
+
+    struct PendingPipeline {
+        std::future<CompiledPipeline> future{};
+        std::vector<PipelineRequest>  requests{};
+    };
+
+    // Pipelines compiling on pipeline_compile_pool_, its own workers keep
+    // ParallelFor of the shared pool from waiting behind compilation
+    std::unordered_map<uint64_t, PendingPipeline> pending_pipelines_{};
+    std::unique_ptr<ThreadPool>                   pipeline_compile_pool_{};
+    // Latest requested state of each target, older requests are dropped
+    std::unordered_map<VkPipeline*, uint64_t> pipeline_targets_{};
 
     vk::DescriptorAllocator   descriptor_allocator_{};
     vk::DescriptorLayoutCache descriptor_layout_cache_{};
@@ -150,13 +252,50 @@ public:
 
     void PushDestructor(std::function<void()>&& destructor);
 
-    void ResetMappedPointers();
+    // Arena of the material type, created with stride and capacity on first
+    // use. Stride must match the array stride of the params in shaders.
+    MaterialParamsArena* GetMaterialParamsArena(const std::string& type,
+                                                uint32_t           stride,
+                                                uint32_t           capacity);
+
+    // Returns the layout created with the same set layouts and push constant
+    // ranges if any, the resource owns the layout
+    VkPipelineLayout CreatePipelineLayout(
+        const VkPipelineLayoutCreateInfo& info);
+
+    // Sets *pipeline to the pipeline built from the same state if any.
+    // Otherwise it is compiled on a worker thread and *pipeline holds a
+    // fallback or VK_NULL_HANDLE until UpdatePipelines patches it.
+    // The resource owns the pipeline.
+    void CreatePipeline(vk::PipelineBuilder& builder, VkRenderPass render_pass,
+                        uint32_t subpass_idx, VkPipeline* pipeline);
+
+    // Rebuilds outdated material variants and hands compiled pipelines to
+    // their materials, once per frame
+    void UpdatePipelines();
+
+    // Starts compiling the pipelines of the material types in the default
+    // render pass before any scene material asks for them
+    void WarmUpPipelines(const std::vector<std::string>& material_types);
+
+    // Waits until the GPU is done with the slices of the current frame, then
+    // points the mapped pointers and dynamic offsets at them. Nothing of the
+    // frame may be written before.
+    void AcquireFrameContext();
+
+    // Records the copies of the material params written since the last
+    // frame and flushes the writes of the frame, before the render passes
+    void CmdReleaseFrameContext(VkCommandBuffer cmd);
 
     void UpdateGlobalDescriptorSet();
 
-    std::vector<uint32_t> GlobalSSBODynamicOffsets() const;
+    // Camera and environment offsets of the current frame
+    std::array<uint32_t, 2> GlobalSSBODynamicOffsets() const;
+
+    std::array<uint32_t, 1> MeshInstanceSSBODynamicOffsets() const;
 
-    std::vector<uint32_t> MeshInstanceSSBODynamicOffsets() const;
+    // Slot of the texture in the bindless array, written on first use
+    uint32_t GetBindlessTextureIndex(vk::Texture* texture);
 
     VkShaderModule GetShaderModule(const std::string& name, ShaderType type);
 
@@ -168,6 +307,8 @@ public:
 
     Mesh* GetMesh(const std::string& name);
 
+    // Creates the module from the SPIR-V embedded in the binary. With
+    // LUMI_SHADERS_OVERRIDE, .spv files in LUMI_SHADERS_DIR take precedence.
     VkShaderModule CreateShaderModule(const std::string& name, ShaderType type);
 
     VkSampler CreateSampler(const std::string& name, VkSamplerCreateInfo* info);
@@ -183,6 +324,10 @@ public:
                               default_subpass_idx_);
     }
 
+    Mesh* CreateMesh(const std::string&             name,
+                     std::vector<vk::Vertex>&&      vertices,
+                     std::vector<Mesh::IndexType>&& indices);
+
     Mesh* CreateMeshFromObjFile(const std::string& name,
                                 const fs::path&    filepath);
 
@@ -190,10 +335,37 @@ public:
                                  vk::TextureCreateInfo* info,  //
                                  const void*            pixels);
 
+    // Uploads a prebuilt mip chain, levels give the offset of each level
+    vk::Texture* CreateTexture2D(
+        const std::string& name, vk::TextureCreateInfo* info, const void* data,
+        size_t size, const std::vector<MipGenerator::Level>& levels);
+
+    // Encodes RGBA8 pixels with their mip chain into the block format.
+    // Falls back to the uncompressed format if the device lacks support.
+    vk::Texture* CreateTexture2DCompressed(const std::string&     name,
+                                           vk::TextureCreateInfo* info,
+                                           const void*            pixels,
+                                           BlockFormat            format);
+
+    // Writes mip level 0 of one face into the mapped staging buffer
+    using CubemapFaceFunc =
+        std::function<void(uint32_t face, void* dst, size_t size)>;
+
     vk::Texture* CreateTextureCubemap(const std::string&     name,
                                       vk::TextureCreateInfo* info,
                                       std::array<void*, 6>&  pixels);
 
+    // Faces are filled on worker threads
+    vk::Texture* CreateTextureCubemap(const std::string&     name,
+                                      vk::TextureCreateInfo* info,
+                                      const CubemapFaceFunc& fill_face);
+
+    // data holds a packed mip chain, every level has its 6 faces back to back
+    vk::Texture* CreateTextureCubemap(
+        const std::string& name, vk::TextureCreateInfo* info, const void* data,
+        size_t size, const std::vector<MipGenerator::Level>& levels);
+
+    // .ktx2 files are uploaded as they are, is_srgb is ignored for them
     vk::Texture* CreateTexture2DFromFile(const std::string& name,
                                          const fs::path&    filepath,
                                          bool               is_srgb);
@@ -201,12 +373,36 @@ public:
     vk::Texture* CreateTextureHDRFromFile(const std::string& name,
                                           const fs::path&    filepath);
 
-    vk::Texture* CreateTextureCubemapFromFile(const std::string& name,
-                                              const fs::path&    basepath);
+    // basepath is either a single equirectangular .hdr file, or the common
+    // prefix of 6 face files named like basepath_X+.hdr.
+    // sh_irradiance receives the diffuse lighting of the cubemap if not null.
+    vk::Texture* CreateTextureCubemapFromFile(
+        const std::string& name, const fs::path& basepath,
+        SphericalHarmonics::Coeffs* sh_irradiance = nullptr);
+
+    // Same sources as CreateTextureCubemapFromFile. Mip level i is the GGX
+    // prefiltered radiance for roughness i / (mip_levels - 1), baked on the
+    // CPU and cached on disk together with sh_irradiance.
+    vk::Texture* CreateTextureSpecularIBLFromFile(
+        const std::string& name, const fs::path& basepath,
+        SphericalHarmonics::Coeffs* sh_irradiance = nullptr);
 
     void RegisterTexture(const std::string&           name,
                          std::shared_ptr<vk::Texture> texture);
 
+    // Runtime destruction. The name is free again right away, the Vulkan
+    // objects are destroyed once no frame in flight may use them. Render
+    // objects, materials and descriptor sets referring to the resource must
+    // be removed or rebound before the next frame is prepared.
+    void DestroyMesh(const std::string& name);
+
+    // The content stays alive while other names share it
+    void DestroyTexture(const std::string& name);
+
+    // The descriptor set of the material stays cached for materials with the
+    // same contents, it is recycled once a texture it samples is destroyed
+    void DestroyMaterial(const std::string& name);
+
     void LoadFromGLTFFile(const fs::path& filepath);
 
     vk::DescriptorEditor BeginEditDescriptorSet(
@@ -223,26 +419,79 @@ public:
 private:
     void InitDefaultTextures();
 
+    void CompilePipelineAsync(uint64_t key, const vk::PipelineBuilder& builder,
+                              VkRenderPass render_pass, uint32_t subpass_idx,
+                              const PipelineRequest& request);
+
+    void FinishPipeline(uint64_t key, PendingPipeline& pending);
+
+    // Split sum scale and bias to F0, baked once and cached on disk
+    vk::Texture* CreateBRDFLut(const std::string& name);
+
     void InitGlobalResource();
 
     void EditGlobalDescriptorSet(bool update_only);
 
     void InitMeshInstancesResource();
 
+    void InitBindlessTexturesResource();
+
     bool LoadVkShaderModule(const std::string& filepath,
                             VkShaderModule*    p_shader_module);
 
+    bool CreateVkShaderModule(const uint32_t* code, size_t size,
+                              VkShaderModule* p_shader_module);
+
     void UploadMesh(Mesh* mesh);
 
     void UploadTexture2D(vk::Texture* texture, const void* pixels,
                          VkImageAspectFlags aspect);
 
-    void UploadTextureCubemap(vk::Texture*          texture,
-                              std::array<void*, 6>& pixels,
+    // layers is 6 for cubemaps, see IBLBaker::ComputeCubemapLayout
+    void UploadTextureLevels(vk::Texture* texture, const void* data,
+                             size_t                                  size,
+                             const std::vector<MipGenerator::Level>& levels,
+                             VkImageAspectFlags aspect, uint32_t layers = 1);
+
+    vk::Texture* CreateTexture2DFromKTX2(const std::string& name,
+                                         const fs::path&    filepath);
+
+    // Used by the loaders for 8-bit pixels. The same content is uploaded
+    // once, and compressed into format if texture.compression is on.
+    vk::Texture* CreateTexture2DShared(const std::string&     name,
+                                       vk::TextureCreateInfo* info,
+                                       const void*            pixels,
+                                       BlockFormat            format);
+
+    // Registers name for the texture created with the same content before.
+    // Returns nullptr if the content is new, see RecordTextureContent.
+    vk::Texture* ShareTextureContent(const std::string& name,
+                                     uint64_t           content_key);
+
+    // Remembers the content of the texture just created under name, returns
+    // the texture
+    vk::Texture* RecordTextureContent(const std::string& name,
+                                      uint64_t           content_key,
+                                      vk::Texture*       texture);
+
+    // Resampled faces are cached on disk
+    vk::Texture* CreateTextureCubemapFromEquirect(
+        const std::string& name, const fs::path& filepath,
+        SphericalHarmonics::Coeffs* sh_irradiance);
+
+    void UploadTextureCubemap(vk::Texture*           texture,
+                              const CubemapFaceFunc& fill_face,
                               VkImageAspectFlags aspect, uint32_t mip_levels);
 
     void GLTFLoadTexture(const std::string& name, tinygltf::Model& gltf_model,
-                         int idx, bool is_srgb);
+                         int idx, bool is_srgb, bool is_normal_map = false);
+
+    // Packs occlusion into R and metallic roughness into GB, either index
+    // may be -1. Returns the name of the packed texture.
+    std::string GLTFLoadOcclusionRoughnessMetallic(const std::string& name,
+                                                   tinygltf::Model& gltf_model,
+                                                   int occlusion_idx,
+                                                   int metallic_roughness_idx);
 
     void GLTFLoadMaterials(const std::string& name,
                            tinygltf::Model&   gltf_model);
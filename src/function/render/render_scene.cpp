@@ -1,5 +1,8 @@
 #include "render_scene.h"
 
+#include <algorithm>
+#include <map>
+
 #include "core/scope_guard.h"
 #include "function/cvars/cvar_system.h"
 #include "material/pbr_material.h"
@@ -7,6 +10,97 @@
 
 namespace lumi {
 
+// Appends the mesh transformed to world space
+static void AppendWorldSpaceMesh(const Mesh &mesh, const Mat4x4f &matrix,
+                                 std::vector<vk::Vertex>      &vertices,
+                                 std::vector<Mesh::IndexType> &indices) {
+    glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(matrix)));
+    // Mirrored objects need to flip the winding order
+    bool flip = glm::determinant(glm::mat3(matrix)) < 0;
+
+    auto base = (Mesh::IndexType)vertices.size();
+    for (auto vertex : mesh.vertices) {
+        Vec4f position  = matrix * Vec4f(vertex.position, 1.0f);
+        vertex.position = Vec3f(position) / position.w;
+        vertex.normal   = Vec3f(normal_matrix * vertex.normal).Normalize();
+        vertices.emplace_back(vertex);
+    }
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        indices.emplace_back(base + mesh.indices[i]);
+        indices.emplace_back(base + mesh.indices[i + (flip ? 2 : 1)]);
+        indices.emplace_back(base + mesh.indices[i + (flip ? 1 : 2)]);
+    }
+}
+
+// Vertex clustering simplification: vertices in the same grid cell are
+// collapsed into one, and triangles which become degenerate are removed.
+static void SimplifyMesh(const BoundingBox &bbox, uint32_t grid_resolution,
+                         std::vector<vk::Vertex>      &vertices,
+                         std::vector<Mesh::IndexType> &indices) {
+    Vec3f size      = bbox.max() - bbox.min();
+    float cell_size = std::max({size.x, size.y, size.z}) / grid_resolution;
+    if (cell_size <= 0) return;
+
+    struct Cell {
+        Mesh::IndexType index{};
+        uint32_t        count{};
+    };
+    std::unordered_map<uint64_t, Cell> cells{};
+    std::vector<vk::Vertex>            new_vertices{};
+    std::vector<Mesh::IndexType>       remap(vertices.size());
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const vk::Vertex &vertex = vertices[i];
+        Vec3f cell_coord =
+            glm::max(glm::vec3((vertex.position - bbox.min()) / cell_size),
+                     glm::vec3(0.0f));
+        uint64_t key = (uint64_t)cell_coord.x |           //
+                       ((uint64_t)cell_coord.y << 21) |  //
+                       ((uint64_t)cell_coord.z << 42);
+
+        auto [it, inserted] = cells.try_emplace(key);
+        Cell &cell          = it->second;
+        if (inserted) {
+            cell.index = (Mesh::IndexType)new_vertices.size();
+            new_vertices.emplace_back(vertex);
+        } else {
+            // Running average of the attributes
+            vk::Vertex &merged = new_vertices[cell.index];
+            float       t      = 1.0f / (cell.count + 1);
+            merged.position += (vertex.position - merged.position) * t;
+            merged.color += (vertex.color - merged.color) * t;
+            merged.normal += vertex.normal;
+        }
+        cell.count++;
+        remap[i] = cell.index;
+    }
+
+    for (size_t i = 0; i < new_vertices.size(); i++) {
+        Vec3f &normal = new_vertices[i].normal;
+        // Opposite normals may cancel out
+        if (normal.LengthSquare() < kEps) {
+            normal = Vec3f::kUnitY;
+        } else {
+            normal = normal.Normalize();
+        }
+    }
+
+    std::vector<Mesh::IndexType> new_indices{};
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        Mesh::IndexType a = remap[indices[i]];
+        Mesh::IndexType b = remap[indices[i + 1]];
+        Mesh::IndexType c = remap[indices[i + 2]];
+        if (a == b || b == c || c == a) continue;
+
+        new_indices.emplace_back(a);
+        new_indices.emplace_back(b);
+        new_indices.emplace_back(c);
+    }
+
+    vertices = std::move(new_vertices);
+    indices  = std::move(new_indices);
+}
+
 void RenderScene::LoadScene() {
     // TODO: load from json file
 
@@ -42,6 +136,7 @@ void RenderScene::LoadScene() {
     //empire.mesh_name     = "empire";
     //empire.material_name = "empire";
     //empire.position      = {5, -10, 0};
+    //empire.occluder_mesh_name = "empire";
 
     //int cnt = 3;
     //for (int x = -cnt; x <= cnt; x++) {
@@ -52,17 +147,15 @@ void RenderScene::LoadScene() {
     //        monkey.rotation = Quaternion::Rotation(Vec3f(0, 0, ToRadians(0))) *
     //                          monkey.rotation;
     //        monkey.position = Vec3f(x, 0, y) * 5;
+    //        monkey.is_static = true;
     //    }
     //}
 
-    // skybox
-    resource->CreateTextureCubemapFromFile("skybox_irradiance",
-                                           "textures/skybox/skybox_irradiance");
-    resource->CreateTextureCubemapFromFile("skybox_specular",
-                                           "textures/skybox/skybox_specular");
+    // skybox, diffuse lighting is projected from the specular cubemap
+    resource->CreateTextureSpecularIBLFromFile(
+        "skybox_specular", "textures/skybox/skybox_specular",
+        &resource->global.sh_irradiance);
 
-    resource->global.skybox_material->irradiance_cubemap_name =
-        "skybox_irradiance";
     resource->global.skybox_material->specular_cubemap_name = "skybox_specular";
     resource->UpdateGlobalDescriptorSet();
 
@@ -71,7 +164,7 @@ void RenderScene::LoadScene() {
 
     //auto material =
     //    (PBRMaterial *)resource->GetMaterial("DamagedHelmet_mat_0");
-    //(*material->params.data) = {};
+    //(*material->params) = {};
     //material->Upload(resource.get());
 
     auto unlit =
@@ -89,45 +182,276 @@ void RenderScene::LoadScene() {
     helmet.rotation      = Quaternion(ToRadians(Vec3f(90, 180, 0)));
     //helmet.material_name = "unlit";
 
-    RenderObject &plane = renderables.emplace_back();
-    plane.mesh_name     = "plane";
-    plane.material_name = "default";
-    plane.position      = {0, -1.2, 0};
-    plane.scale         = {4, 4, 4};
-    plane.rotation      = Quaternion(ToRadians(Vec3f(0, 0, 0)));
+    RenderObject &plane      = renderables.emplace_back();
+    plane.mesh_name          = "plane";
+    plane.material_name      = "default";
+    plane.position           = {0, -1.2, 0};
+    plane.scale              = {4, 4, 4};
+    plane.rotation           = Quaternion(ToRadians(Vec3f(0, 0, 0)));
+    plane.occluder_mesh_name = "plane";
 
     camera.position   = {1.5f, 0, -1.5f};
     camera.eulers_deg = Vec3f(0, -45, 0);
 
     // TODO: camera control in scene node
+
+    BuildStaticBatches();
+
+    BuildHLODClusters();
+}
+
+void RenderScene::BuildStaticBatches() {
+    // Group static objects by material and by the chunk containing the center
+    using ChunkKey = std::tuple<std::string, int32_t, int32_t, int32_t>;
+    std::map<ChunkKey, std::vector<RenderObject *>> chunks{};
+
+    std::vector<RenderObject> result{};
+    for (auto &renderable : renderables) {
+        Mesh *mesh = resource->GetMesh(renderable.mesh_name);
+        if (!renderable.is_static || !mesh) {
+            result.emplace_back(renderable);
+            continue;
+        }
+
+        renderable.object_to_world = renderable.ComputeObjectToWorld();
+        BoundingBox bbox           = renderable.object_to_world * mesh->bbox;
+        Vec3f       chunk          = bbox.center() / kStaticBatchChunkSize;
+
+        auto key = ChunkKey(renderable.material_name,  //
+                            (int32_t)std::floor(chunk.x),
+                            (int32_t)std::floor(chunk.y),
+                            (int32_t)std::floor(chunk.z));
+        chunks[key].emplace_back(&renderable);
+    }
+
+    size_t merged_cnt = 0;
+    size_t batch_idx  = 0;
+    for (auto &[key, objects] : chunks) {
+        if (objects.size() == 1) {
+            result.emplace_back(*objects[0]);
+            continue;
+        }
+
+        // Pre-transform vertices to world space
+        std::vector<vk::Vertex>      vertices{};
+        std::vector<Mesh::IndexType> indices{};
+        // Only the occluders declared by members, members without one must
+        // not cull anything
+        std::vector<vk::Vertex>      occluder_vertices{};
+        std::vector<Mesh::IndexType> occluder_indices{};
+        for (auto object : objects) {
+            Mesh *mesh = resource->GetMesh(object->mesh_name);
+            AppendWorldSpaceMesh(*mesh, object->object_to_world, vertices,
+                                 indices);
+
+            if (object->occluder_mesh_name.empty()) continue;
+            Mesh *occluder = resource->GetMesh(object->occluder_mesh_name);
+            if (!occluder) continue;
+            AppendWorldSpaceMesh(*occluder, object->object_to_world,
+                                 occluder_vertices, occluder_indices);
+        }
+
+        std::string name = "_static_batch_" + std::to_string(batch_idx++);
+        if (!resource->CreateMesh(name, std::move(vertices),
+                                  std::move(indices))) {
+            LOG_ERROR("Creating static batch mesh {} failed", name);
+            continue;
+        }
+
+        std::string occluder_name{};
+        if (!occluder_indices.empty()) {
+            occluder_name = name + "_occluder";
+            if (!resource->CreateMesh(occluder_name,
+                                      std::move(occluder_vertices),
+                                      std::move(occluder_indices))) {
+                LOG_ERROR("Creating static batch occluder {} failed",
+                          occluder_name);
+                occluder_name.clear();
+            }
+        }
+
+        RenderObject &batch      = result.emplace_back();
+        batch.mesh_name          = name;
+        batch.material_name      = std::get<0>(key);
+        batch.is_static          = true;
+        batch.occluder_mesh_name = occluder_name;
+
+        merged_cnt += objects.size();
+    }
+
+    if (batch_idx > 0) {
+        LOG_INFO("Merged {} static objects into {} batches", merged_cnt,
+                 batch_idx);
+    }
+    renderables = std::move(result);
+}
+
+void RenderScene::BuildHLODClusters() {
+    hlod_clusters_.clear();
+    hlod_members_.assign(renderables.size(), false);
+
+    // Cluster static objects by the cell containing the center
+    using CellKey = std::tuple<int32_t, int32_t, int32_t>;
+    std::map<CellKey, std::vector<size_t>> cells{};
+    for (size_t i = 0; i < renderables.size(); i++) {
+        auto &renderable = renderables[i];
+        Mesh *mesh       = resource->GetMesh(renderable.mesh_name);
+        if (!renderable.is_static || !mesh) continue;
+
+        renderable.object_to_world = renderable.ComputeObjectToWorld();
+        BoundingBox bbox           = renderable.object_to_world * mesh->bbox;
+        Vec3f       cell           = bbox.center() / kHLODClusterSize;
+
+        auto key = CellKey((int32_t)std::floor(cell.x),
+                           (int32_t)std::floor(cell.y),
+                           (int32_t)std::floor(cell.z));
+        cells[key].emplace_back(i);
+    }
+
+    size_t src_triangles   = 0;
+    size_t proxy_triangles = 0;
+    for (auto &[_, members] : cells) {
+        if (members.size() == 1) continue;
+
+        auto &cluster   = hlod_clusters_.emplace_back();
+        cluster.members = members;
+
+        // Merge members by material, then simplify each merged mesh
+        std::map<std::string, std::vector<size_t>> materials{};
+        for (size_t idx : members) {
+            auto &renderable = renderables[idx];
+            Mesh *mesh       = resource->GetMesh(renderable.mesh_name);
+            cluster.bbox.Merge(renderable.object_to_world * mesh->bbox);
+            materials[renderable.material_name].emplace_back(idx);
+
+            hlod_members_[idx] = true;
+        }
+
+        size_t cluster_idx = hlod_clusters_.size() - 1;
+        for (auto &[material_name, objects] : materials) {
+            std::vector<vk::Vertex>      vertices{};
+            std::vector<Mesh::IndexType> indices{};
+            for (size_t idx : objects) {
+                auto &renderable = renderables[idx];
+                Mesh *mesh       = resource->GetMesh(renderable.mesh_name);
+                AppendWorldSpaceMesh(*mesh, renderable.object_to_world,
+                                     vertices, indices);
+            }
+            src_triangles += indices.size() / 3;
+
+            SimplifyMesh(cluster.bbox, kHLODGridResolution, vertices, indices);
+            if (indices.empty()) continue;
+            proxy_triangles += indices.size() / 3;
+
+            std::string name = "_hlod_" + std::to_string(cluster_idx) + "_" +
+                               std::to_string(cluster.proxies.size());
+            if (!resource->CreateMesh(name, std::move(vertices),
+                                      std::move(indices))) {
+                LOG_ERROR("Creating HLOD proxy mesh {} failed", name);
+                continue;
+            }
+
+            RenderObject &proxy = cluster.proxies.emplace_back();
+            proxy.mesh_name     = name;
+            proxy.material_name = material_name;
+            proxy.is_static     = true;
+        }
+    }
+
+    if (!hlod_clusters_.empty()) {
+        LOG_INFO("Built {} HLOD clusters, {} triangles simplified to {}",
+                 hlod_clusters_.size(), src_triangles, proxy_triangles);
+    }
 }
 
 void RenderScene::UpdateVisibleObjects() {
-    auto &visible_batchs = resource->visibles_drawcall_batchs;
+    auto &visible_batchs    = resource->visibles_drawcall_batchs;
+    auto &visible_materials = resource->visible_materials;
     visible_batchs.clear();
+    visible_materials.clear();
 
-    // TODO: culling
+    // synchronize object_to_world matrix
     for (auto &renderable : renderables) {
-        // synchronize object_to_world matrix
-        renderable.object_to_world =
-            Mat4x4f::Translation(renderable.position) *  //
-            Mat4x4f(renderable.rotation) *               //
-            Mat4x4f::Scale(renderable.scale);
+        renderable.object_to_world = renderable.ComputeObjectToWorld();
+    }
 
+    // Occlusion culling
+    auto &culler = resource->occlusion_culler;
+    bool  occlusion_culling =
+        cvars::GetBool("culling.occlusion.enable").value();
+    if (occlusion_culling) {
+        culler.BeginFrame(camera.projection() * camera.view(), camera.near,
+                          camera.far);
+        for (auto &renderable : renderables) {
+            if (renderable.occluder_mesh_name.empty()) continue;
+
+            Mesh *occluder = resource->GetMesh(renderable.occluder_mesh_name);
+            if (!occluder) continue;
+            culler.AddOccluder(renderable.object_to_world, occluder->vertices,
+                               occluder->indices);
+        }
+        culler.RasterizeOccluders();
+    }
+
+    auto add_visible = [&](RenderObject &renderable) {
         Material *material = resource->GetMaterial(renderable.material_name);
         Mesh     *mesh     = resource->GetMesh(renderable.mesh_name);
-        auto     &batch    = visible_batchs[material][mesh];
+        if (occlusion_culling &&
+            !culler.IsVisible(renderable.object_to_world, mesh->bbox)) {
+            return;
+        }
+
+        auto [it, inserted] = visible_batchs.try_emplace(material);
+        if (inserted) visible_materials.emplace_back(material);
+
+        auto &batch = it->second[mesh];
 
         auto &desc    = batch.emplace_back();
         desc.material = material;
         desc.mesh     = mesh;
         desc.object   = &renderable;
+    };
+
+    bool use_hlod = cvars::GetBool("hlod.enable").value();
+    for (size_t i = 0; i < renderables.size(); i++) {
+        if (use_hlod && i < hlod_members_.size() && hlod_members_[i]) continue;
+        add_visible(renderables[i]);
     }
+
+    if (use_hlod) {
+        // Swap distant clusters for their proxies
+        float hlod_distance = cvars::GetFloat("hlod.distance").value();
+        for (auto &cluster : hlod_clusters_) {
+            Vec3f closest = glm::clamp(glm::vec3(camera.position),
+                                       glm::vec3(cluster.bbox.min()),
+                                       glm::vec3(cluster.bbox.max()));
+            if ((closest - camera.position).Length() > hlod_distance) {
+                for (auto &proxy : cluster.proxies) {
+                    add_visible(proxy);
+                }
+            } else {
+                for (size_t idx : cluster.members) {
+                    add_visible(renderables[idx]);
+                }
+            }
+        }
+    }
+
+    // Group materials sharing a pipeline so that it is bound once
+    std::sort(visible_materials.begin(), visible_materials.end(),
+              [](const Material *a, const Material *b) {
+                  return std::less<VkPipeline>()(a->pipeline, b->pipeline);
+              });
 }
 
 void RenderScene::UploadGlobalResource() {
+    // Written in place, the frame context is acquired and read by the GPU
+    // without copies. Material params are copied by the frame's commands.
+    LOG_ASSERT(resource->frame_context.acquired(),
+               "Frame data written before the frame context is acquired");
+
     // --- Global resource ---
-    // Update camera data staging buffer
+    // Update camera data
     auto cam_data = resource->global.data.cam;
 
     const Mat4x4f &view = camera.view();
@@ -142,7 +466,7 @@ void RenderScene::UploadGlobalResource() {
     Mat4x4f sunlight_world_to_clip =
         GetSunlightWorldToClip(camera, sunlight_dir);
 
-    // Update environment data staging buffer
+    // Update environment data
     auto env_data = resource->global.data.env;
 
     env_data->sunlight_color = cvars::GetVec3f("env.sunlight.color").value();
@@ -153,25 +477,27 @@ void RenderScene::UploadGlobalResource() {
     env_data->mip_levels =
         resource
             ->GetTexture(
-                resource->global.skybox_material->irradiance_cubemap_name)
+                resource->global.skybox_material->specular_cubemap_name)
             ->mip_levels;
     env_data->debug_idx              = cvars::GetInt("debug.shading").value();
     env_data->sunlight_world_to_clip = sunlight_world_to_clip;
-
-    // Upload global data to GPU
-    size_t cam_size = rhi->PaddedSizeOfSSBO<CamDataSSBO>();
-    size_t env_size = rhi->PaddedSizeOfSSBO<EnvDataSSBO>();
-    rhi->CopyBuffer(&resource->global.staging_buffer, &resource->global.buffer,
-                    cam_size + env_size,
-                    resource->GlobalSSBODynamicOffsets()[0]);
+    for (uint32_t i = 0; i < SphericalHarmonics::kCoeffCount; i++) {
+        env_data->sh_irradiance[i] =
+            Vec4f(resource->global.sh_irradiance[i], 0.0f);
+    }
 
     // --- Mesh instance resource ---
-    // Update staging buffer
     size_t visibles_cnt = 0;
     auto   cur_instance = resource->mesh_instances.data.cur_instance;
-    for (auto &[mat, mat_batch] : resource->visibles_drawcall_batchs) {
+    auto  &draws        = resource->visible_draws;
+    draws.clear();
+    for (Material *material : resource->visible_materials) {
+        auto &mat_batch = resource->visibles_drawcall_batchs[material];
         for (auto &[mesh, batch] : mat_batch) {
-            // Write to staging buffer
+            draws.push_back({material, mesh, (uint32_t)batch.size(),
+                             (uint32_t)visibles_cnt});
+
+            // Write to the instances of the frame
             for (auto &desc : batch) {
                 RenderObject *object          = desc.object;
                 cur_instance->object_to_world = object->object_to_world;
@@ -184,12 +510,6 @@ void RenderScene::UploadGlobalResource() {
             }
         }
     }
-
-    // Upload mesh instance data to GPU
-    rhi->CopyBuffer(&resource->mesh_instances.staging_buffer,
-                    &resource->mesh_instances.buffer,
-                    sizeof(MeshInstanceSSBO) * visibles_cnt,
-                    resource->MeshInstanceSSBODynamicOffsets()[0]);
 }
 
 Mat4x4f RenderScene::GetSunlightWorldToClip(const Camera &camera,
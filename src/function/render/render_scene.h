@@ -34,11 +34,26 @@ public:
     std::shared_ptr<VulkanRHI>      rhi{};
     std::shared_ptr<RenderResource> resource{};
 
+private:
+    // Static objects in the same cell, drawn as simplified proxies when far
+    struct HLODCluster {
+        BoundingBox               bbox{};
+        std::vector<size_t>       members{};  // indices of renderables
+        std::vector<RenderObject> proxies{};  // one per material
+    };
+
+    std::vector<HLODCluster> hlod_clusters_{};
+    std::vector<bool>        hlod_members_{};
+
 public:
     RenderScene(std::shared_ptr<VulkanRHI>      rhi,
                 std::shared_ptr<RenderResource> resource)
         : rhi(rhi), resource(resource) {}
 
+    constexpr static float    kStaticBatchChunkSize = 32.0f;
+    constexpr static float    kHLODClusterSize      = 128.0f;
+    constexpr static uint32_t kHLODGridResolution   = 32;
+
     void LoadScene();
 
     void UpdateVisibleObjects();
@@ -46,6 +61,10 @@ public:
     void UploadGlobalResource();
 
 private:
+    void BuildStaticBatches();
+
+    void BuildHLODClusters();
+
     Mat4x4f GetSunlightWorldToClip(const Camera& camera,
                                    const Vec3f&  sunlight_dir);
 };
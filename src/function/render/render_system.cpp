@@ -28,18 +28,36 @@ void RenderSystem::Init(std::shared_ptr<Window> window) {
     pipeline = std::make_shared<ForwardPipeline>(rhi, resource);
     pipeline->Init();
 
+    // Compiles while the scene loads
+    resource->WarmUpPipelines({"PBRMaterial", "UnlitMaterial"});
+
     scene = std::make_shared<RenderScene>(rhi, resource);
     scene->LoadScene();
 }
 
+void RenderSystem::BeginFrame() {
+    // Applied before anything of the frame is written
+    if (rhi->ApplyFrameSettings()) {
+        pipeline->RecreateSwapchain();
+    }
+
+    resource->frame_pacer.BeginFrame();
+
+    // Frame data is written only after this, the slices may still be read
+    // by the GPU before
+    resource->AcquireFrameContext();
+}
+
 void RenderSystem::Tick() { 
-    resource->ResetMappedPointers();
+    resource->UpdatePipelines();
 
     scene->UpdateVisibleObjects();
 
     scene->UploadGlobalResource();
 
     pipeline->Render();
+
+    resource->frame_pacer.EndFrame();
 }
 
 void RenderSystem::Finalize() {
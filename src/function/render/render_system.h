@@ -19,6 +19,9 @@ public:
 public:
     void Init(std::shared_ptr<Window> window);
 
+    // Paces the frame, input is polled after it returns
+    void BeginFrame();
+
     void Tick();
 
     void Finalize();
@@ -0,0 +1,180 @@
+#include "vulkan_command_recorder.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "core/log.h"
+
+namespace lumi {
+namespace vk {
+
+void CommandRecorder::Begin(VkCommandBuffer cmd) {
+    cmd_   = cmd;
+    stats_ = {};
+    Invalidate();
+}
+
+void CommandRecorder::Invalidate() {
+    pipeline_        = VK_NULL_HANDLE;
+    viewport_valid_  = false;
+    scissor_valid_   = false;
+    cull_mode_valid_ = false;
+    descriptor_sets_ = {};
+    push_constants_  = {};
+    vertex_buffer_   = VK_NULL_HANDLE;
+    index_buffer_    = VK_NULL_HANDLE;
+}
+
+void CommandRecorder::AddStats(const Stats& stats) {
+    stats_.emitted += stats.emitted;
+    stats_.skipped += stats.skipped;
+    stats_.draws += stats.draws;
+}
+
+void CommandRecorder::BindPipeline(VkPipeline pipeline) {
+    if (pipeline == pipeline_) {
+        stats_.skipped++;
+        return;
+    }
+    pipeline_ = pipeline;
+
+    vkCmdBindPipeline(cmd_, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    stats_.emitted++;
+}
+
+void CommandRecorder::SetViewport(const VkViewport& viewport) {
+    if (viewport_valid_ &&
+        memcmp(&viewport, &viewport_, sizeof(VkViewport)) == 0) {
+        stats_.skipped++;
+        return;
+    }
+    viewport_       = viewport;
+    viewport_valid_ = true;
+
+    vkCmdSetViewport(cmd_, 0, 1, &viewport);
+    stats_.emitted++;
+}
+
+void CommandRecorder::SetScissor(const VkRect2D& scissor) {
+    if (scissor_valid_ &&
+        memcmp(&scissor, &scissor_, sizeof(VkRect2D)) == 0) {
+        stats_.skipped++;
+        return;
+    }
+    scissor_       = scissor;
+    scissor_valid_ = true;
+
+    vkCmdSetScissor(cmd_, 0, 1, &scissor);
+    stats_.emitted++;
+}
+
+void CommandRecorder::SetCullMode(VkCullModeFlags cull_mode) {
+    if (cull_mode_valid_ && cull_mode == cull_mode_) {
+        stats_.skipped++;
+        return;
+    }
+    cull_mode_       = cull_mode;
+    cull_mode_valid_ = true;
+
+    vkCmdSetCullMode(cmd_, cull_mode);
+    stats_.emitted++;
+}
+
+void CommandRecorder::BindDescriptorSet(VkPipelineLayout layout,
+                                        uint32_t         slot,
+                                        VkDescriptorSet  set,
+                                        uint32_t         offset_count,
+                                        const uint32_t*  offsets) {
+    LOG_ASSERT(slot < kMaxDescriptorSets, "Descriptor set slot {} too large",
+               slot);
+    LOG_ASSERT(offset_count <= kMaxDynamicOffsets,
+               "Too many dynamic offsets: {}", offset_count);
+
+    // Same layout handles are always compatible, sets bound with another
+    // layout may be disturbed
+    BoundDescriptorSet& bound = descriptor_sets_[slot];
+    if (bound.layout == layout && bound.set == set &&
+        bound.offset_count == offset_count &&
+        std::equal(offsets, offsets + offset_count, bound.offsets.begin())) {
+        stats_.skipped++;
+        return;
+    }
+    for (auto& other : descriptor_sets_) {
+        if (other.layout != layout) other = {};
+    }
+    bound.layout       = layout;
+    bound.set          = set;
+    bound.offset_count = offset_count;
+    std::copy(offsets, offsets + offset_count, bound.offsets.begin());
+
+    vkCmdBindDescriptorSets(cmd_, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, slot,
+                            1, &set, offset_count, offsets);
+    stats_.emitted++;
+}
+
+void CommandRecorder::PushConstants(VkPipelineLayout   layout,
+                                    VkShaderStageFlags stages, uint32_t offset,
+                                    uint32_t size, const void* data) {
+    LOG_ASSERT(size <= kMaxPushConstantSize, "Push constants too large: {}",
+               size);
+
+    BoundPushConstants& bound = push_constants_;
+    if (bound.layout == layout && bound.stages == stages &&
+        bound.offset == offset && bound.size == size &&
+        memcmp(bound.data.data(), data, size) == 0) {
+        stats_.skipped++;
+        return;
+    }
+    bound.layout = layout;
+    bound.stages = stages;
+    bound.offset = offset;
+    bound.size   = size;
+    memcpy(bound.data.data(), data, size);
+
+    vkCmdPushConstants(cmd_, layout, stages, offset, size, data);
+    stats_.emitted++;
+}
+
+void CommandRecorder::BindVertexBuffer(VkBuffer buffer) {
+    if (buffer == vertex_buffer_) {
+        stats_.skipped++;
+        return;
+    }
+    vertex_buffer_ = buffer;
+
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(cmd_, 0, 1, &buffer, &offset);
+    stats_.emitted++;
+}
+
+void CommandRecorder::BindIndexBuffer(VkBuffer buffer, VkIndexType index_type) {
+    if (buffer == index_buffer_ && index_type == index_type_) {
+        stats_.skipped++;
+        return;
+    }
+    index_buffer_ = buffer;
+    index_type_   = index_type;
+
+    vkCmdBindIndexBuffer(cmd_, buffer, 0, index_type);
+    stats_.emitted++;
+}
+
+void CommandRecorder::Draw(uint32_t vertex_count, uint32_t instance_count,
+                           uint32_t first_vertex, uint32_t first_instance) {
+    vkCmdDraw(cmd_, vertex_count, instance_count, first_vertex,
+              first_instance);
+    stats_.emitted++;
+    stats_.draws++;
+}
+
+void CommandRecorder::DrawIndexed(uint32_t index_count, uint32_t instance_count,
+                                  uint32_t first_index, int32_t vertex_offset,
+                                  uint32_t first_instance) {
+    vkCmdDrawIndexed(cmd_, index_count, instance_count, first_index,
+                     vertex_offset, first_instance);
+    stats_.emitted++;
+    stats_.draws++;
+}
+
+}  // namespace vk
+}  // namespace lumi
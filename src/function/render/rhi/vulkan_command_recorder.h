@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+
+#include "vulkan_types.h"
+
+namespace lumi {
+namespace vk {
+
+// Records graphics commands and skips the ones that set state which is
+// already bound. Only commands recorded through it are tracked, call
+// Invalidate after recording into cmd() directly.
+class CommandRecorder {
+public:
+    constexpr static uint32_t kMaxDescriptorSets   = 4;
+    constexpr static uint32_t kMaxDynamicOffsets   = 4;
+    constexpr static uint32_t kMaxPushConstantSize = 128;
+
+    struct Stats {
+        uint32_t emitted{};
+        uint32_t skipped{};
+        uint32_t draws{};
+    };
+
+private:
+    struct BoundDescriptorSet {
+        VkPipelineLayout layout{};
+        VkDescriptorSet  set{};
+        uint32_t         offset_count{};
+
+        std::array<uint32_t, kMaxDynamicOffsets> offsets{};
+    };
+
+    struct BoundPushConstants {
+        VkPipelineLayout   layout{};
+        VkShaderStageFlags stages{};
+        uint32_t           offset{};
+        uint32_t           size{};
+
+        std::array<uint8_t, kMaxPushConstantSize> data{};
+    };
+
+    VkCommandBuffer cmd_{};
+
+    VkPipeline      pipeline_{};
+    VkViewport      viewport_{};
+    VkRect2D        scissor_{};
+    VkCullModeFlags cull_mode_{};
+    bool            viewport_valid_{};
+    bool            scissor_valid_{};
+    bool            cull_mode_valid_{};
+
+    std::array<BoundDescriptorSet, kMaxDescriptorSets> descriptor_sets_{};
+    BoundPushConstants                                 push_constants_{};
+
+    VkBuffer    vertex_buffer_{};
+    VkBuffer    index_buffer_{};
+    VkIndexType index_type_{};
+
+    Stats stats_{};
+
+public:
+    // Starts tracking cmd with nothing bound, stats are reset
+    void Begin(VkCommandBuffer cmd);
+
+    // Forgets the bound state, the next commands are all emitted
+    void Invalidate();
+
+    void BindPipeline(VkPipeline pipeline);
+
+    void SetViewport(const VkViewport& viewport);
+
+    void SetScissor(const VkRect2D& scissor);
+
+    void SetCullMode(VkCullModeFlags cull_mode);
+
+    void BindDescriptorSet(VkPipelineLayout layout, uint32_t slot,
+                           VkDescriptorSet set, uint32_t offset_count = 0,
+                           const uint32_t* offsets = nullptr);
+
+    void PushConstants(VkPipelineLayout layout, VkShaderStageFlags stages,
+                       uint32_t offset, uint32_t size, const void* data);
+
+    void BindVertexBuffer(VkBuffer buffer);
+
+    void BindIndexBuffer(VkBuffer buffer, VkIndexType index_type);
+
+    void Draw(uint32_t vertex_count, uint32_t instance_count,
+              uint32_t first_vertex, uint32_t first_instance);
+
+    void DrawIndexed(uint32_t index_count, uint32_t instance_count,
+                     uint32_t first_index, int32_t vertex_offset,
+                     uint32_t first_instance);
+
+    // Counts the commands of a secondary command buffer executed from cmd()
+    void AddStats(const Stats& stats);
+
+    VkCommandBuffer cmd() const { return cmd_; }
+
+    const Stats& stats() const { return stats_; }
+};
+
+}  // namespace vk
+}  // namespace lumi
@@ -1,6 +1,7 @@
 ﻿#include "vulkan_descriptors.h"
 
 #include <algorithm>
+#include <cstring>
 
 #include "core/hash.h"
 #include "vulkan_utils.h"
@@ -11,6 +12,9 @@ namespace vk {
 void DescriptorAllocator::Init(VkDevice device) { device_ = device; }
 
 void DescriptorAllocator::Finalize() {
+    set_cache_.clear();
+    view_keys_.clear();
+    free_sets_.clear();
     for (auto pool : free_pools_) {
         vkDestroyDescriptorPool(device_, pool, nullptr);
     }
@@ -27,9 +31,19 @@ void DescriptorAllocator::ResetPools() {
     free_pools_ = used_pools_;
     used_pools_.clear();
     current_pool_ = VK_NULL_HANDLE;
+    set_cache_.clear();
+    view_keys_.clear();
+    free_sets_.clear();
 }
 
 bool DescriptorAllocator::Allocate(vk::DescriptorSet* descriptor_set) {
+    auto free_sets = free_sets_.find(descriptor_set->layout);
+    if (free_sets != free_sets_.end() && !free_sets->second.empty()) {
+        descriptor_set->set = free_sets->second.back();
+        free_sets->second.pop_back();
+        return true;
+    }
+
     if (current_pool_ == VK_NULL_HANDLE) {
         current_pool_ = GrabPool();
         used_pools_.emplace_back(current_pool_);
@@ -70,6 +84,51 @@ bool DescriptorAllocator::Allocate(vk::DescriptorSet* descriptor_set) {
     return false;
 }
 
+VkDescriptorSet DescriptorAllocator::FindCachedSet(uint64_t key) const {
+    auto it = set_cache_.find(key);
+    return it != set_cache_.end() ? it->second.set : VK_NULL_HANDLE;
+}
+
+void DescriptorAllocator::CacheSet(uint64_t                 key,
+                                   const vk::DescriptorSet& descriptor_set,
+                                   const VkImageView*       image_views,
+                                   uint32_t                 view_count) {
+    auto& cached  = set_cache_[key];
+    cached.set    = descriptor_set.set;
+    cached.layout = descriptor_set.layout;
+    cached.image_views.assign(image_views, image_views + view_count);
+
+    for (uint32_t i = 0; i < view_count; i++) {
+        view_keys_[image_views[i]].push_back(key);
+    }
+}
+
+void DescriptorAllocator::EvictSetsReferencing(VkImageView image_view) {
+    auto it = view_keys_.find(image_view);
+    if (it == view_keys_.end()) return;
+    std::vector<uint64_t> keys = std::move(it->second);
+    view_keys_.erase(it);
+
+    for (uint64_t key : keys) {
+        auto cached = set_cache_.find(key);
+        if (cached == set_cache_.end()) continue;
+
+        // Other views of the set no longer lead to it
+        for (VkImageView other : cached->second.image_views) {
+            auto other_keys = view_keys_.find(other);
+            if (other_keys == view_keys_.end()) continue;
+            auto& list = other_keys->second;
+            list.erase(std::remove(list.begin(), list.end(), key), list.end());
+            if (list.empty()) {
+                view_keys_.erase(other_keys);
+            }
+        }
+
+        free_sets_[cached->second.layout].push_back(cached->second.set);
+        set_cache_.erase(cached);
+    }
+}
+
 VkDescriptorPool DescriptorAllocator::GrabPool() {
     if (free_pools_.empty()) {
         return CreatePool();
@@ -105,16 +164,16 @@ VkDescriptorPool DescriptorAllocator::CreatePool(
 bool DescriptorLayoutCache::DescriptorLayoutInfo::operator==(
     const DescriptorLayoutInfo& other) const {
 
-    if (bindings.size() != other.bindings.size()) {
+    if (count != other.count) {
         return false;
     }
     // Compare each of the bindings is the same.
     // Bindings are sorted so they will match
-    for (int i = 0; i < bindings.size(); i++) {
+    for (uint32_t i = 0; i < count; i++) {
         auto& lhs = bindings[i];
         auto& rhs = other.bindings[i];
 
-        if (lhs.binding != lhs.binding) {
+        if (lhs.binding != rhs.binding) {
             return false;
         }
         if (lhs.descriptorType != rhs.descriptorType) {
@@ -133,9 +192,10 @@ bool DescriptorLayoutCache::DescriptorLayoutInfo::operator==(
 
 size_t DescriptorLayoutCache::DescriptorLayoutInfo::hash() const {
     size_t result = 0;
-    HashCombine(result, bindings.size());
+    HashCombine(result, count);
 
-    for (const auto& b : bindings) {
+    for (uint32_t i = 0; i < count; i++) {
+        const auto& b = bindings[i];
         HashCombine(result, b.binding);
         HashCombine(result, b.descriptorType);
         HashCombine(result, b.descriptorCount);
@@ -147,6 +207,9 @@ size_t DescriptorLayoutCache::DescriptorLayoutInfo::hash() const {
 void DescriptorLayoutCache::Init(VkDevice device) { device_ = device; }
 
 void DescriptorLayoutCache::Finalize() {
+    for (auto [layout, update_template] : update_templates_) {
+        vkDestroyDescriptorUpdateTemplate(device_, update_template, nullptr);
+    }
     for (auto [info, layout] : layout_cache_) {
         vkDestroyDescriptorSetLayout(device_, layout, nullptr);
     }
@@ -155,12 +218,15 @@ void DescriptorLayoutCache::Finalize() {
 VkDescriptorSetLayout DescriptorLayoutCache::CreateDescriptorLayout(
     VkDescriptorSetLayoutCreateInfo* info) {
 
+    LOG_ASSERT(info->bindingCount <= kMaxBindings,
+               "Too many descriptor bindings: {}", info->bindingCount);
+
     DescriptorLayoutInfo layout_info{};
-    layout_info.bindings.reserve(info->bindingCount);
+    layout_info.count    = info->bindingCount;
     bool    sorted       = true;
     int32_t last_binding = -1;
     for (uint32_t i = 0; i < info->bindingCount; i++) {
-        layout_info.bindings.emplace_back(info->pBindings[i]);
+        layout_info.bindings[i] = info->pBindings[i];
 
         // Check that the bindings are in strict increasing order
         if (sorted &&
@@ -172,7 +238,8 @@ VkDescriptorSetLayout DescriptorLayoutCache::CreateDescriptorLayout(
     }
 
     if (!sorted) {
-        std::sort(layout_info.bindings.begin(), layout_info.bindings.end(),
+        std::sort(layout_info.bindings.begin(),
+                  layout_info.bindings.begin() + layout_info.count,
                   [](const VkDescriptorSetLayoutBinding& a,
                      const VkDescriptorSetLayoutBinding& b) {
                       return a.binding < b.binding;
@@ -192,6 +259,40 @@ VkDescriptorSetLayout DescriptorLayoutCache::CreateDescriptorLayout(
     return layout;
 }
 
+VkDescriptorUpdateTemplate DescriptorLayoutCache::GetUpdateTemplate(
+    VkDescriptorSetLayout               layout,
+    const VkDescriptorSetLayoutBinding* bindings, uint32_t count) {
+
+    auto it = update_templates_.find(layout);
+    if (it != update_templates_.end()) {
+        return it->second;
+    }
+
+    std::array<VkDescriptorUpdateTemplateEntry, kMaxBindings> entries{};
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].dstBinding      = bindings[i].binding;
+        entries[i].dstArrayElement = 0;
+        entries[i].descriptorCount = 1;
+        entries[i].descriptorType  = bindings[i].descriptorType;
+        entries[i].offset          = i * sizeof(DescriptorInfo);
+        entries[i].stride          = sizeof(DescriptorInfo);
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    info.pNext = nullptr;
+    info.descriptorUpdateEntryCount = count;
+    info.pDescriptorUpdateEntries   = entries.data();
+    info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    info.descriptorSetLayout = layout;
+
+    VkDescriptorUpdateTemplate update_template;
+    VK_CHECK(vkCreateDescriptorUpdateTemplate(device_, &info, nullptr,
+                                              &update_template));
+    update_templates_[layout] = update_template;
+    return update_template;
+}
+
 DescriptorEditor DescriptorEditor::Begin(DescriptorAllocator*   allocator,
                                          DescriptorLayoutCache* layout_cache,
                                          vk::DescriptorSet* descriptor_set) {
@@ -211,26 +312,26 @@ DescriptorEditor& DescriptorEditor::BindBuffer(
     VkDeviceSize       offset,      //
     VkDeviceSize       range) {
 
-    auto& layout_binding              = bindings_.emplace_back();
+    if (count_ >= kMaxBindings) {
+        LOG_ERROR("More than {} descriptor bindings", kMaxBindings);
+        return *this;
+    }
+
+    auto& layout_binding              = bindings_[count_];
     layout_binding.descriptorCount    = 1;
     layout_binding.descriptorType     = type;
     layout_binding.pImmutableSamplers = nullptr;
     layout_binding.stageFlags         = stageFlags;
     layout_binding.binding            = binding;
 
-    auto& buffer_info  = buffer_infos_.emplace_back();
-    buffer_info.buffer = buffer;
-    buffer_info.offset = offset;
-    buffer_info.range  = range;
-
-    auto& write           = writes_.emplace_back();
-    write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.pNext           = nullptr;
-    write.descriptorCount = 1;
-    write.descriptorType  = type;
-    write.pBufferInfo     = &buffer_info;
-    write.dstBinding      = binding;
+    // Zeroed padding keeps the content hash stable
+    auto& info = infos_[count_];
+    memset(&info, 0, sizeof(DescriptorInfo));
+    info.buffer.buffer = buffer;
+    info.buffer.offset = offset;
+    info.buffer.range  = range;
 
+    count_++;
     return *this;
 }
 
@@ -242,53 +343,92 @@ DescriptorEditor& DescriptorEditor::BindImage(  //
     VkImageView        imageView,               //
     VkImageLayout      imageLayout) {
 
-    auto& layout_binding              = bindings_.emplace_back();
+    if (count_ >= kMaxBindings) {
+        LOG_ERROR("More than {} descriptor bindings", kMaxBindings);
+        return *this;
+    }
+
+    auto& layout_binding              = bindings_[count_];
     layout_binding.descriptorCount    = 1;
     layout_binding.descriptorType     = type;
     layout_binding.pImmutableSamplers = nullptr;
     layout_binding.stageFlags         = stageFlags;
     layout_binding.binding            = binding;
 
-    auto& image_info       = image_infos_.emplace_back();
-    image_info.sampler     = sampler;
-    image_info.imageView   = imageView;
-    image_info.imageLayout = imageLayout;
-
-    auto& write           = writes_.emplace_back();
-    write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.pNext           = nullptr;
-    write.descriptorCount = 1;
-    write.descriptorType  = type;
-    write.pImageInfo      = &image_info;
-    write.dstBinding      = binding;
+    auto& info = infos_[count_];
+    memset(&info, 0, sizeof(DescriptorInfo));
+    info.image.sampler     = sampler;
+    info.image.imageView   = imageView;
+    info.image.imageLayout = imageLayout;
 
+    count_++;
     return *this;
 }
 
 bool DescriptorEditor::Execute(bool update_only) {
+    // Layouts and templates expect increasing binding numbers
+    for (uint32_t i = 1; i < count_; i++) {
+        for (uint32_t j = i; j > 0; j--) {
+            if (bindings_[j - 1].binding < bindings_[j].binding) break;
+            std::swap(bindings_[j - 1], bindings_[j]);
+            std::swap(infos_[j - 1], infos_[j]);
+        }
+    }
+
     if (!update_only) {
         // Build layout
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
         layoutInfo.pNext = nullptr;
         layoutInfo.pBindings    = bindings_.data();
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings_.size());
+        layoutInfo.bindingCount = count_;
         descriptor_set_->layout = cache_->CreateDescriptorLayout(&layoutInfo);
+    }
 
-        // Allocate descriptor
-        bool success = allocator_->Allocate(descriptor_set_);
-        if (!success) {
-            return false;
-        };
+    // Sets with the same layout and descriptors are shared
+    uint64_t key = HashBytes(&descriptor_set_->layout,
+                             sizeof(VkDescriptorSetLayout));
+    key = HashBytes(infos_.data(), count_ * sizeof(DescriptorInfo), key);
+
+    VkDescriptorSet cached = allocator_->FindCachedSet(key);
+    if (cached != VK_NULL_HANDLE) {
+        descriptor_set_->set = cached;
+        return true;
     }
 
-    // Write descriptor
-    for (auto& write : writes_) {
-        write.dstSet = descriptor_set_->set;
+    // The old set may be shared or in flight, write into a new one
+    bool success = allocator_->Allocate(descriptor_set_);
+    if (!success) {
+        return false;
+    };
+
+    if (count_ > 0) {
+        VkDescriptorUpdateTemplate update_template = cache_->GetUpdateTemplate(
+            descriptor_set_->layout, bindings_.data(), count_);
+        vkUpdateDescriptorSetWithTemplate(allocator_->device(),
+                                          descriptor_set_->set,
+                                          update_template, infos_.data());
+    }
+
+    // The set is evicted when one of its views is destroyed
+    std::array<VkImageView, kMaxBindings> image_views{};
+    uint32_t                              view_count = 0;
+    for (uint32_t i = 0; i < count_; i++) {
+        switch (bindings_[i].descriptorType) {
+            case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+            case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+            case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+            case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+                if (infos_[i].image.imageView != VK_NULL_HANDLE) {
+                    image_views[view_count++] = infos_[i].image.imageView;
+                }
+                break;
+            default:
+                break;
+        }
     }
-    vkUpdateDescriptorSets(allocator_->device(),
-                           static_cast<uint32_t>(writes_.size()),
-                           writes_.data(), 0, nullptr);
+    allocator_->CacheSet(key, *descriptor_set_, image_views.data(),
+                         view_count);
 
     return true;
 }
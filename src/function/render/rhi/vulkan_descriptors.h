@@ -10,6 +10,12 @@
 namespace lumi {
 namespace vk {
 
+// One descriptor in the data of an update template, the stride of all entries
+union DescriptorInfo {
+    VkDescriptorBufferInfo buffer;
+    VkDescriptorImageInfo  image;
+};
+
 class DescriptorAllocator {
 private:
     constexpr static int kMaxSets = 1000;
@@ -32,6 +38,20 @@ private:
     std::vector<VkDescriptorPool> used_pools_{};
     std::vector<VkDescriptorPool> free_pools_{};
 
+    struct CachedSet {
+        VkDescriptorSet          set{};
+        VkDescriptorSetLayout    layout{};
+        std::vector<VkImageView> image_views{};
+    };
+
+    // Written sets keyed by the hash of their layout and descriptors
+    std::unordered_map<uint64_t, CachedSet> set_cache_{};
+    // Keys of the cached sets referring to each image view
+    std::unordered_map<VkImageView, std::vector<uint64_t>> view_keys_{};
+    // Evicted sets by layout, rewritten when a set of the layout is allocated
+    std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSet>>
+        free_sets_{};
+
     VkDevice device_{};
 
 public:
@@ -39,10 +59,23 @@ public:
 
     void Finalize();
 
+    // Also drops the cached sets
     void ResetPools();
 
+    // Recycles an evicted set of the layout if any
     bool Allocate(vk::DescriptorSet* descriptor_set);
 
+    // Returns VK_NULL_HANDLE if no set was written with these contents
+    VkDescriptorSet FindCachedSet(uint64_t key) const;
+
+    void CacheSet(uint64_t key, const vk::DescriptorSet& descriptor_set,
+                  const VkImageView* image_views, uint32_t view_count);
+
+    // Drops the cached sets referring to the view and recycles them. Called
+    // before the view is destroyed, once no frame in flight may use them, so
+    // a later view with the same handle value never hits a stale set.
+    void EvictSetsReferencing(VkImageView image_view);
+
     VkDevice device() const { return device_; }
 
 private:
@@ -53,8 +86,11 @@ private:
 
 class DescriptorLayoutCache {
 public:
+    constexpr static uint32_t kMaxBindings = 8;
+
     struct DescriptorLayoutInfo {
-        std::vector<VkDescriptorSetLayoutBinding> bindings{};
+        std::array<VkDescriptorSetLayoutBinding, kMaxBindings> bindings{};
+        uint32_t                                               count{};
 
         bool operator==(const DescriptorLayoutInfo& other) const;
 
@@ -75,6 +111,9 @@ private:
                            DescriptorLayoutInfo::Hash>;
     LayoutCache layout_cache_{};
 
+    std::unordered_map<VkDescriptorSetLayout, VkDescriptorUpdateTemplate>
+        update_templates_{};
+
 public:
     void Init(VkDevice device);
 
@@ -82,6 +121,12 @@ public:
 
     VkDescriptorSetLayout CreateDescriptorLayout(
         VkDescriptorSetLayoutCreateInfo* info);
+
+    // Template of the layout, created on first use. Entry i writes binding i
+    // from the DescriptorInfo at index i, bindings must be sorted.
+    VkDescriptorUpdateTemplate GetUpdateTemplate(
+        VkDescriptorSetLayout               layout,
+        const VkDescriptorSetLayoutBinding* bindings, uint32_t count);
 };
 
 class DescriptorEditor {
@@ -104,13 +149,18 @@ public:
                                 VkImageView        imageView,   //
                                 VkImageLayout      imageLayout);
 
+    // Reuses a set written with the same contents if any. Otherwise the
+    // contents go to a new set, shared sets are never written in place.
     bool Execute(bool update_only);
 
 private:
-    std::vector<VkDescriptorSetLayoutBinding> bindings_{};
-    std::vector<VkWriteDescriptorSet>         writes_{};
-    std::list<VkDescriptorBufferInfo>         buffer_infos_{};
-    std::list<VkDescriptorImageInfo>          image_infos_{};
+    constexpr static uint32_t kMaxBindings =
+        DescriptorLayoutCache::kMaxBindings;
+
+    // Fixed storage, editing does not allocate
+    std::array<VkDescriptorSetLayoutBinding, kMaxBindings> bindings_{};
+    std::array<DescriptorInfo, kMaxBindings>               infos_{};
+    uint32_t                                               count_{};
 
     DescriptorAllocator*   allocator_      = nullptr;
     DescriptorLayoutCache* cache_          = nullptr;
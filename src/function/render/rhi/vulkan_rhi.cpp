@@ -1,5 +1,8 @@
 #include "vulkan_rhi.h"
 
+#include <algorithm>
+
+#include "core/disk_cache.h"
 #include "core/scope_guard.h"
 #include "function/cvars/cvar_system.h"
 
@@ -18,11 +21,46 @@
 
 namespace lumi {
 
+static int GetFramesInFlightSetting() {
+    static CVarInt frames_in_flight = cvars::GetInt("rhi.frames_in_flight");
+    return std::clamp<int>(frames_in_flight.value(), 1,
+                           VulkanRHI::kMaxFramesInFlight);
+}
+
+static VkPresentModeKHR GetPresentModeSetting() {
+    // Same order as the options of rhi.present_mode
+    constexpr VkPresentModeKHR kPresentModes[] = {
+        VK_PRESENT_MODE_FIFO_KHR,
+        VK_PRESENT_MODE_MAILBOX_KHR,
+        VK_PRESENT_MODE_IMMEDIATE_KHR,
+    };
+    static CVarInt present_mode = cvars::GetInt("rhi.present_mode");
+    return kPresentModes[std::clamp<int>(present_mode.value(), 0, 2)];
+}
+
+static const char* GetPresentModeName(VkPresentModeKHR present_mode) {
+    switch (present_mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            return "IMMEDIATE";
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            return "MAILBOX";
+        case VK_PRESENT_MODE_FIFO_KHR:
+            return "FIFO";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            return "FIFO_RELAXED";
+        default:
+            return "UNKNOWN";
+    }
+}
+
 void VulkanRHI::Init() {
+    frames_in_flight_ = GetFramesInFlightSetting();
+
     CreateVulkanInstance();
     CreateSwapchain();
     CreateCommands();
     CreateSyncStructures();
+    CreatePipelineCache();
 }
 
 void VulkanRHI::CreateVulkanInstance() {
@@ -49,11 +87,28 @@ void VulkanRHI::CreateVulkanInstance() {
     VkPhysicalDeviceFeatures required_features{};
     required_features.geometryShader    = VK_TRUE;
     required_features.samplerAnisotropy = VK_TRUE;
+
+    // Bindless textures, a sampler2D array updated while it is bound
+    VkPhysicalDeviceDescriptorIndexingFeatures descriptor_indexing_features{};
+    descriptor_indexing_features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    descriptor_indexing_features.shaderSampledImageArrayNonUniformIndexing =
+        VK_TRUE;
+    descriptor_indexing_features.descriptorBindingSampledImageUpdateAfterBind =
+        VK_TRUE;
+    descriptor_indexing_features.descriptorBindingUpdateUnusedWhilePending =
+        VK_TRUE;
+    descriptor_indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+    descriptor_indexing_features.runtimeDescriptorArray          = VK_TRUE;
+
+    // vkGetDeviceImageMemoryRequirements and vkCmdSetCullMode are core in 1.3
     vkb::PhysicalDeviceSelector      selector{vkb_inst};
     std::vector<vkb::PhysicalDevice> physical_devices =
-        selector.set_minimum_version(1, 1)
+        selector.set_minimum_version(1, 3)
             .set_surface(surface_)
             .set_required_features(required_features)
+            .add_required_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)
+            .add_required_extension_features(descriptor_indexing_features)
             .select_devices()
             .value();
     LOG_ASSERT(physical_devices.size() > 0,
@@ -89,6 +144,14 @@ void VulkanRHI::CreateVulkanInstance() {
     LOG_DEBUG(physical_devices_info.c_str());
     LOG_INFO("Selected physical device: {}", physical_device.name);
 
+    // Block compressed textures are optional, uncompressed ones are the
+    // fallback when the device does not support them
+    VkPhysicalDeviceFeatures supported_features{};
+    vkGetPhysicalDeviceFeatures(physical_device.physical_device,
+                                &supported_features);
+    physical_device.features.textureCompressionBC =
+        supported_features.textureCompressionBC;
+
     VkPhysicalDeviceShaderDrawParametersFeatures
         shader_draw_parameters_features{};
     shader_draw_parameters_features.sType =
@@ -131,19 +194,30 @@ void VulkanRHI::CreateVulkanInstance() {
 void VulkanRHI::CreateSwapchain() {
     VkExtent2D extent = GetWindowExtent();
 
+    // One image more than the frames in flight, so acquiring does not wait
+    // for presentation. Mailbox needs a spare image to replace.
+    requested_present_mode_  = GetPresentModeSetting();
+    uint32_t min_image_count = (uint32_t)frames_in_flight_ + 1;
+    if (requested_present_mode_ == VK_PRESENT_MODE_MAILBOX_KHR) {
+        min_image_count = std::max<uint32_t>(
+            min_image_count, vkb::SwapchainBuilder::TRIPLE_BUFFERING);
+    }
+
     vkb::SwapchainBuilder swapchainBuilder(physical_device_, device_, surface_);
     vkb::Swapchain        vkbSwapchain =
         swapchainBuilder
             .use_default_format_selection()
-            //use vsync present mode
-            .set_desired_present_mode(VK_PRESENT_MODE_FIFO_RELAXED_KHR)
-            .set_desired_min_image_count(
-                vkb::SwapchainBuilder::DOUBLE_BUFFERING)
+            // Falls back to FIFO, which is always supported
+            .set_desired_present_mode(requested_present_mode_)
+            .set_desired_min_image_count(min_image_count)
             .set_desired_extent(extent.width, extent.height)
             .build()
             .value();
     LOG_DEBUG("Create swapchain with window extent ({}, {})", extent.width,
               extent.height);
+    LOG_INFO("Swapchain present mode {}, {} images, {} frames in flight",
+             GetPresentModeName(vkbSwapchain.present_mode),
+             vkbSwapchain.image_count, frames_in_flight_);
 
     // store swapchain and its related images
     extent_                 = extent;
@@ -178,6 +252,17 @@ void VulkanRHI::CreateCommands() {
         dtor_queue_rhi_.Push([this, &frame]() {
             vkDestroyCommandPool(device_, frame.command_pool, nullptr);
         });
+
+        // pools for secondary command buffers, reset as a whole every frame
+        auto slotPoolInfo = vk::BuildCommandPoolCreateInfo(
+            graphics_queue_family_, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        for (auto& slot : frame.record_slots) {
+            VK_CHECK(vkCreateCommandPool(device_, &slotPoolInfo, nullptr,
+                                         &slot.command_pool));
+            dtor_queue_rhi_.Push([this, &slot]() {
+                vkDestroyCommandPool(device_, slot.command_pool, nullptr);
+            });
+        }
     }
 
     // create pool for upload context
@@ -223,9 +308,78 @@ void VulkanRHI::CreateSyncStructures() {
     dtor_queue_rhi_.Push([this]() {
         vkDestroyFence(device_, upload_context_.upload_fence, nullptr);
     });
+
+    // GPU frame times are not measured if the queue cannot write timestamps
+    if (gpu_properties_.limits.timestampComputeAndGraphics) {
+        VkQueryPoolCreateInfo query_pool_info{};
+        query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_info.pNext = nullptr;
+        query_pool_info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+        query_pool_info.queryCount = 2 * kMaxFramesInFlight;
+        VK_CHECK(vkCreateQueryPool(device_, &query_pool_info, nullptr,
+                                   &timestamp_query_pool_));
+        dtor_queue_rhi_.Push([this]() {
+            vkDestroyQueryPool(device_, timestamp_query_pool_, nullptr);
+        });
+    }
+}
+
+void VulkanRHI::CreatePipelineCache() {
+    // Data of another device or driver may crash some drivers, validate it
+    // before handing it over
+    uint64_t key = HashBytes(&gpu_properties_.vendorID,
+                             sizeof(gpu_properties_.vendorID));
+    key = HashBytes(&gpu_properties_.deviceID,
+                    sizeof(gpu_properties_.deviceID), key);
+    key = HashBytes(&gpu_properties_.driverVersion,
+                    sizeof(gpu_properties_.driverVersion), key);
+    key = HashBytes(gpu_properties_.pipelineCacheUUID, VK_UUID_SIZE, key);
+
+    std::vector<uint8_t> data{};
+    bool                 enable = cvars::GetBool("rhi.pipeline_cache").value();
+    if (enable && LoadCache(kPipelineCacheName, key, data)) {
+        VkPipelineCacheHeaderVersionOne header{};
+        if (data.size() >= sizeof(header)) {
+            memcpy(&header, data.data(), sizeof(header));
+        }
+        pipeline_cache_loaded_ =
+            header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+            header.vendorID == gpu_properties_.vendorID &&
+            header.deviceID == gpu_properties_.deviceID &&
+            memcmp(header.pipelineCacheUUID, gpu_properties_.pipelineCacheUUID,
+                   VK_UUID_SIZE) == 0;
+    }
+    if (!pipeline_cache_loaded_) data.clear();
+
+    VkPipelineCacheCreateInfo info{};
+    info.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.pNext           = nullptr;
+    info.initialDataSize = data.size();
+    info.pInitialData    = data.data();
+    VK_CHECK(vkCreatePipelineCache(device_, &info, nullptr, &pipeline_cache_));
+
+    if (pipeline_cache_loaded_) {
+        LOG_INFO("Pipeline cache loaded, {} bytes", data.size());
+    } else {
+        LOG_INFO("Pipeline cache is empty, pipelines compile from SPIR-V");
+    }
+
+    dtor_queue_rhi_.Push([this, key, enable]() {
+        size_t size = 0;
+        VK_CHECK(vkGetPipelineCacheData(device_, pipeline_cache_, &size,
+                                        nullptr));
+        std::vector<uint8_t> data(size);
+        VK_CHECK(vkGetPipelineCacheData(device_, pipeline_cache_, &size,
+                                        data.data()));
+        if (enable && SaveCache(kPipelineCacheName, key, data.data(), size)) {
+            LOG_INFO("Pipeline cache saved, {} bytes", size);
+        }
+        vkDestroyPipelineCache(device_, pipeline_cache_, nullptr);
+    });
 }
 
 void VulkanRHI::Finalize() {
+    dtor_queue_deferred_.Flush();
     dtor_queue_swapchain_.Flush();
     dtor_queue_rhi_.Flush();
 }
@@ -259,6 +413,7 @@ void VulkanRHI::WaitForCurrentFrame() {
     auto& cur_frame = frames_[frame_idx_];
     VK_CHECK(
         vkWaitForFences(device_, 1, &cur_frame.render_fence, true, kTimeout));
+    OnFrameComplete(frame_idx_);
 }
 
 void VulkanRHI::WaitForAllFrames() {
@@ -266,6 +421,44 @@ void VulkanRHI::WaitForAllFrames() {
         VK_CHECK(
             vkWaitForFences(device_, 1, &frame.render_fence, true, kTimeout));
     }
+    completed_frames_ = submitted_frames_;
+
+    // Including resources retired for the frame being prepared, the device
+    // has nothing of ours left
+    dtor_queue_deferred_.Flush();
+}
+
+void VulkanRHI::WaitForLastSubmittedFrame() {
+    // Fences signal in submission order, the older frames are done as well
+    int   last_idx = (frame_idx_ + frames_in_flight_ - 1) % frames_in_flight_;
+    auto& frame    = frames_[last_idx];
+    VK_CHECK(vkWaitForFences(device_, 1, &frame.render_fence, true, kTimeout));
+    OnFrameComplete(last_idx);
+}
+
+bool VulkanRHI::IsFrameComplete(int frame_idx) const {
+    return vkGetFenceStatus(device_, frames_[frame_idx].render_fence) ==
+           VK_SUCCESS;
+}
+
+void VulkanRHI::OnFrameComplete(int frame_idx) {
+    // Fences signal in submission order, the frames before are done as well
+    completed_frames_ =
+        std::max(completed_frames_, frames_[frame_idx].frames_done);
+}
+
+bool VulkanRHI::ApplyFrameSettings() {
+    int frames_in_flight = GetFramesInFlightSetting();
+    if (frames_in_flight == frames_in_flight_ &&
+        GetPresentModeSetting() == requested_present_mode_) {
+        return false;
+    }
+
+    // Frames restart from the first one, nothing may be in flight
+    WaitForAllFrames();
+    frames_in_flight_ = frames_in_flight;
+    frame_idx_        = 0;
+    return true;
 }
 
 void* VulkanRHI::MapMemory(vk::AllocatedBuffer* buffer) {
@@ -278,6 +471,16 @@ void VulkanRHI::UnmapMemory(vk::AllocatedBuffer* buffer) {
     vmaUnmapMemory(allocator_, buffer->allocation);
 }
 
+void VulkanRHI::DestroyDeferred(std::function<void()>&& destructor) {
+    // Frames before the one being prepared may still use it
+    dtor_queue_deferred_.Push(submitted_frames_, std::move(destructor));
+}
+
+void VulkanRHI::FlushMemory(vk::AllocatedBuffer* buffer, size_t offset,
+                            size_t size) {
+    VK_CHECK(vmaFlushAllocation(allocator_, buffer->allocation, offset, size));
+}
+
 vk::AllocatedBuffer VulkanRHI::AllocateBuffer(size_t             alloc_size,
                                               VkBufferUsageFlags buffer_usage,
                                               VmaMemoryUsage     memory_usage) {
@@ -351,6 +554,7 @@ void VulkanRHI::AllocateTexture2D(vk::Texture*           texture,
     // Create VkImageView
     VkImageViewCreateInfo imageinfo = vk::BuildImageViewCreateInfo(
         texture->format, texture->image.image, info->aspect_flags);
+    imageinfo.subresourceRange.levelCount = info->mip_levels;
     VK_CHECK(vkCreateImageView(device_, &imageinfo, nullptr,
                                &texture->image.image_view));
 }
@@ -393,16 +597,112 @@ void VulkanRHI::AllocateTextureCubemap(vk::Texture*           texture,
                                &texture->image.image_view));
 }
 
+bool VulkanRHI::SupportsLinearBlit(VkFormat format) const {
+    VkFormatProperties properties{};
+    vkGetPhysicalDeviceFormatProperties(physical_device_, format, &properties);
+
+    constexpr VkFormatFeatureFlags kRequired =
+        VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & kRequired) == kRequired;
+}
+
+bool VulkanRHI::SupportsSampledFormat(VkFormat format) const {
+    VkFormatProperties properties{};
+    vkGetPhysicalDeviceFormatProperties(physical_device_, format, &properties);
+    return (properties.optimalTilingFeatures &
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
 void VulkanRHI::DestroyTexture(vk::Texture* texture) {
     vkDestroyImageView(device_, texture->image.image_view, nullptr);
     vmaDestroyImage(allocator_, texture->image.image,
                     texture->image.allocation);
 }
 
+VkMemoryRequirements VulkanRHI::GetTextureMemoryRequirements(
+    const vk::TextureCreateInfo* info) {
+    VkImageCreateInfo img_info = vk::BuildImageCreateInfo(
+        info->format, info->image_usage, {info->width, info->height, 1},
+        info->mip_levels, 1);
+
+    VkDeviceImageMemoryRequirements requirements_info{};
+    requirements_info.sType =
+        VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+    requirements_info.pCreateInfo = &img_info;
+
+    VkMemoryRequirements2 requirements{};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    vkGetDeviceImageMemoryRequirements(device_, &requirements_info,
+                                       &requirements);
+    return requirements.memoryRequirements;
+}
+
+VmaAllocation VulkanRHI::AllocateAliasedMemory(
+    const VkMemoryRequirements& requirements) {
+    VmaAllocationCreateInfo alloc_info{};
+    alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VmaAllocation memory{};
+    VK_CHECK(vmaAllocateMemory(allocator_, &requirements, &alloc_info,
+                               &memory, nullptr));
+    return memory;
+}
+
+void VulkanRHI::FreeAliasedMemory(VmaAllocation memory) {
+    vmaFreeMemory(allocator_, memory);
+}
+
+void VulkanRHI::AllocateAliasedTexture2D(vk::Texture*           texture,
+                                         VmaAllocation          memory,
+                                         vk::TextureCreateInfo* info) {
+    texture->width        = info->width;
+    texture->height       = info->height;
+    texture->format       = info->format;
+    texture->mip_levels   = info->mip_levels;
+    texture->sampler_name = info->sampler_name;
+
+    VkImageCreateInfo img_info = vk::BuildImageCreateInfo(
+        info->format, info->image_usage, {info->width, info->height, 1},
+        info->mip_levels, 1);
+    VK_CHECK(vmaCreateAliasingImage(allocator_, memory, &img_info,
+                                    &texture->image.image));
+    // Owned by whoever allocated the aliased memory
+    texture->image.allocation = nullptr;
+
+    VkImageViewCreateInfo imageinfo = vk::BuildImageViewCreateInfo(
+        texture->format, texture->image.image, info->aspect_flags);
+    imageinfo.subresourceRange.levelCount = info->mip_levels;
+    VK_CHECK(vkCreateImageView(device_, &imageinfo, nullptr,
+                               &texture->image.image_view));
+}
+
+void VulkanRHI::DestroyAliasedTexture(vk::Texture* texture) {
+    vkDestroyImageView(device_, texture->image.image_view, nullptr);
+    vkDestroyImage(device_, texture->image.image, nullptr);
+}
+
 bool VulkanRHI::BeginRenderCommand() {
     WaitForCurrentFrame();
     auto& cur_frame = frames_[frame_idx_];
 
+    dtor_queue_deferred_.Flush(completed_frames_);
+
+    // Timestamps of the last frame that used this slot
+    if (cur_frame.timestamps_written) {
+        uint64_t timestamps[2]{};
+        VkResult result = vkGetQueryPoolResults(
+            device_, timestamp_query_pool_, 2 * frame_idx_, 2,
+            sizeof(timestamps), timestamps, sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS) {
+            gpu_frame_time_ = float(double(timestamps[1] - timestamps[0]) *
+                                    gpu_properties_.limits.timestampPeriod *
+                                    1e-6);
+        }
+        cur_frame.timestamps_written = false;
+    }
+
     // request image from the swapchain
     VkResult acquire_swapchain_image_result = vkAcquireNextImageKHR(
         device_, swapchain_, kTimeout, cur_frame.present_semaphore, nullptr,
@@ -417,12 +717,23 @@ bool VulkanRHI::BeginRenderCommand() {
     // we can safely reset the command buffer to begin recording again.
     VK_CHECK(vkResetFences(device_, 1, &cur_frame.render_fence));
     VK_CHECK(vkResetCommandBuffer(cur_frame.main_command_buffer, 0));
+    for (auto& slot : cur_frame.record_slots) {
+        if (slot.used == 0) continue;
+        VK_CHECK(vkResetCommandPool(device_, slot.command_pool, 0));
+        slot.used = 0;
+    }
     VkCommandBuffer cmd = cur_frame.main_command_buffer;
 
     auto cmdBeginInfo = vk::BuildCommandBufferBeginInfo(
         VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
     VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
+    if (timestamp_query_pool_ != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(cmd, timestamp_query_pool_, 2 * frame_idx_, 2);
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            timestamp_query_pool_, 2 * frame_idx_);
+    }
+
     return true;
 }
 
@@ -430,6 +741,11 @@ bool VulkanRHI::EndRenderCommand() {
     auto& cur_frame = frames_[frame_idx_];
 
     VkCommandBuffer cmd = cur_frame.main_command_buffer;
+    if (timestamp_query_pool_ != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            timestamp_query_pool_, 2 * frame_idx_ + 1);
+        cur_frame.timestamps_written = true;
+    }
     VK_CHECK(vkEndCommandBuffer(cmd));
 
     VkPipelineStageFlags waitStage =
@@ -446,6 +762,7 @@ bool VulkanRHI::EndRenderCommand() {
     submit.pCommandBuffers      = &cmd;
     VK_CHECK(
         vkQueueSubmit(graphics_queue_, 1, &submit, cur_frame.render_fence));
+    cur_frame.frames_done = submitted_frames_ + 1;
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -458,18 +775,53 @@ bool VulkanRHI::EndRenderCommand() {
 
     VkResult queue_present_result =
         vkQueuePresentKHR(graphics_queue_, &presentInfo);
+
+    // increase the number of frames drawn, the frame is submitted even if
+    // presenting failed
+    submitted_frames_++;
+    frame_idx_ = (frame_idx_ + 1) % frames_in_flight_;
+
     if (queue_present_result == VK_ERROR_OUT_OF_DATE_KHR ||
         queue_present_result == VK_SUBOPTIMAL_KHR) {
         return false;
     } else {
         VK_CHECK(queue_present_result);
     }
-
-    // increase the number of frames drawn
-    frame_idx_ = (frame_idx_ == kFramesInFlight - 1) ? 0 : frame_idx_ + 1;
     return true;
 }
 
+VkCommandBuffer VulkanRHI::BeginSecondaryCommandBuffer(
+    uint32_t slot_idx, VkRenderPass render_pass, uint32_t subpass_idx) {
+    auto& slot = frames_[frame_idx_].record_slots[slot_idx];
+
+    // Buffers are kept with the pool and reused after its reset
+    if (slot.used == slot.command_buffers.size()) {
+        auto allocInfo = vk::BuildCommandBufferAllocateInfo(
+            slot.command_pool, 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+        VK_CHECK(vkAllocateCommandBuffers(
+            device_, &allocInfo, &slot.command_buffers.emplace_back()));
+    }
+    VkCommandBuffer cmd = slot.command_buffers[slot.used++];
+
+    VkCommandBufferInheritanceInfo inheritance{};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.pNext = nullptr;
+    inheritance.renderPass  = render_pass;
+    inheritance.subpass     = subpass_idx;
+    inheritance.framebuffer = VK_NULL_HANDLE;
+
+    auto cmdBeginInfo = vk::BuildCommandBufferBeginInfo(
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+        VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    cmdBeginInfo.pInheritanceInfo = &inheritance;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+    return cmd;
+}
+
+void VulkanRHI::EndSecondaryCommandBuffer(VkCommandBuffer cmd) {
+    VK_CHECK(vkEndCommandBuffer(cmd));
+}
+
 void VulkanRHI::CmdImageLayoutTransition(VkCommandBuffer    cmd,         //
                                          VkImage            image,       //
                                          VkImageAspectFlags aspect,      //
@@ -543,24 +895,26 @@ void VulkanRHI::CmdImageLayoutTransition(VkCommandBuffer    cmd,         //
                          nullptr, 1, &barrier);
 }
 
-void VulkanRHI::CmdCopyBufferToImage(VkCommandBuffer    cmd,     //
-                                     VkBuffer           buffer,  //
-                                     VkImage            image,   //
-                                     VkImageAspectFlags aspect,  //
-                                     uint32_t           width,   //
-                                     uint32_t           height,  //
-                                     uint32_t           layers) {
+void VulkanRHI::CmdCopyBufferToImage(VkCommandBuffer    cmd,        //
+                                     VkBuffer           buffer,     //
+                                     VkImage            image,      //
+                                     VkImageAspectFlags aspect,     //
+                                     uint32_t           width,      //
+                                     uint32_t           height,     //
+                                     uint32_t           layers,     //
+                                     uint32_t           mip_level,  //
+                                     VkDeviceSize       buffer_offset) {
     VkExtent3D imageExtent{};
     imageExtent.width  = width;
     imageExtent.height = height;
     imageExtent.depth  = 1;
 
     VkBufferImageCopy copyRegion{};
-    copyRegion.bufferOffset                    = 0;
+    copyRegion.bufferOffset                    = buffer_offset;
     copyRegion.bufferRowLength                 = 0;
     copyRegion.bufferImageHeight               = 0;
     copyRegion.imageSubresource.aspectMask     = aspect;
-    copyRegion.imageSubresource.mipLevel       = 0;
+    copyRegion.imageSubresource.mipLevel       = mip_level;
     copyRegion.imageSubresource.baseArrayLayer = 0;
     copyRegion.imageSubresource.layerCount     = layers;
     copyRegion.imageExtent                     = imageExtent;
@@ -8,12 +8,20 @@ class RenderScene;
 
 class VulkanRHI {
 public:
-    constexpr static int      kFramesInFlight = 2;
+    // rhi.frames_in_flight picks how many are used
+    constexpr static int      kMaxFramesInFlight = 3;
     constexpr static uint64_t kTimeout = 1000000000ui64;  // Timeout of 1 second
+    // Secondary command buffers are recorded by up to this many threads
+    constexpr static uint32_t kMaxRecordSlots = 8;
+
+    // File under LUMI_CACHE_DIR
+    constexpr static const char* kPipelineCacheName = "pipelines.cache";
 
 private:
     vk::DestructorQueue dtor_queue_rhi_{};
     vk::DestructorQueue dtor_queue_swapchain_{};
+    // Resources destroyed at runtime, flushed as frames complete
+    vk::DeferredDestructorQueue dtor_queue_deferred_{};
 
     VkInstance       instance_{};         // Vulkan library handle
     VkPhysicalDevice physical_device_{};  // GPU chosen as the default device
@@ -21,6 +29,8 @@ private:
     VkSurfaceKHR     surface_{};          // Vulkan window surface
     VmaAllocator     allocator_{};
     VkPhysicalDeviceProperties gpu_properties_{};
+    VkPipelineCache            pipeline_cache_{};
+    bool                       pipeline_cache_loaded_{};
 
 #ifdef LUMI_ENABLE_DEBUG_LOG
     VkDebugUtilsMessengerEXT debug_messenger_{};  // Vulkan debug output handle
@@ -35,15 +45,35 @@ private:
     VkQueue                  graphics_queue_{};
     uint32_t                 graphics_queue_family_{};
     VkDescriptorPool         imgui_pool_{};
+    VkPresentModeKHR         requested_present_mode_{};
+
+    int      frames_in_flight_ = 0;
+    int      frame_idx_        = 0;
+    uint64_t submitted_frames_ = 0;
+    uint64_t completed_frames_ = 0;  // Seen complete by a fence wait
+
+    // Two timestamps per frame, around its commands
+    VkQueryPool timestamp_query_pool_{};
+    float       gpu_frame_time_{};
 
-    int frame_idx_ = 0;
     struct {
         VkCommandPool   command_pool{};
         VkCommandBuffer main_command_buffer{};
         VkFence         render_fence{};
         VkSemaphore     render_semaphore{};
         VkSemaphore     present_semaphore{};
-    } frames_[kFramesInFlight] = {};
+        bool            timestamps_written{};
+        // submitted_frames_ after its last submit, complete once the fence
+        // signals
+        uint64_t        frames_done{};
+
+        // One pool per recording thread, reset when the frame begins
+        struct {
+            VkCommandPool                command_pool{};
+            std::vector<VkCommandBuffer> command_buffers{};
+            uint32_t                     used{};
+        } record_slots[kMaxRecordSlots];
+    } frames_[kMaxFramesInFlight] = {};
 
     struct {
         VkCommandPool   command_pool{};
@@ -56,6 +86,20 @@ public:
 
     int frame_idx() const { return frame_idx_; }
 
+    int frames_in_flight() const { return frames_in_flight_; }
+
+    uint64_t submitted_frames() const { return submitted_frames_; }
+
+    uint64_t completed_frames() const { return completed_frames_; }
+
+    // Resources retired at runtime and not destroyed yet
+    size_t deferred_destructor_count() const {
+        return dtor_queue_deferred_.size();
+    }
+
+    // Milliseconds the GPU spent on the last completed frame
+    float gpu_frame_time() const { return gpu_frame_time_; }
+
     const VkExtent2D& extent() const { return extent_; }
 
     VkFormat swapchain_image_format() const { return swapchain_image_format_; }
@@ -70,6 +114,11 @@ public:
         return swapchain_image_views_;
     }
 
+    VkPipelineCache pipeline_cache() const { return pipeline_cache_; }
+
+    // Whether the pipeline cache was filled from disk at init
+    bool pipeline_cache_loaded() const { return pipeline_cache_loaded_; }
+
     float max_sampler_anisotropy() const {
         return gpu_properties_.limits.maxSamplerAnisotropy;
     }
@@ -107,12 +156,29 @@ public:
 
     void WaitForCurrentFrame();
 
+    // Also runs all deferred destructors, nothing is in flight after it
     void WaitForAllFrames();
 
+    void WaitForLastSubmittedFrame();
+
+    bool IsFrameComplete(int frame_idx) const;
+
+    // Picks up rhi.frames_in_flight and rhi.present_mode between frames.
+    // Returns true when the swapchain has to be recreated.
+    bool ApplyFrameSettings();
+
+    // Runs the destructor once the frames that may use the resource are
+    // complete, without waiting for the device. The resource must not be
+    // used by frames prepared after this call.
+    void DestroyDeferred(std::function<void()>&& destructor);
+
     void* MapMemory(vk::AllocatedBuffer* buffer);
 
     void UnmapMemory(vk::AllocatedBuffer* buffer);
 
+    // Only needed for memory that is not host coherent, a no-op otherwise
+    void FlushMemory(vk::AllocatedBuffer* buffer, size_t offset, size_t size);
+
     vk::AllocatedBuffer AllocateBuffer(size_t             alloc_size,    //
                                        VkBufferUsageFlags buffer_usage,  //
                                        VmaMemoryUsage     memory_usage);
@@ -133,10 +199,42 @@ public:
 
     void DestroyTexture(vk::Texture* texture);
 
+    // Memory requirements of a 2D texture that is not allocated yet
+    VkMemoryRequirements GetTextureMemoryRequirements(
+        const vk::TextureCreateInfo* info);
+
+    // Memory shared by the images of textures that are never alive at the
+    // same time
+    VmaAllocation AllocateAliasedMemory(
+        const VkMemoryRequirements& requirements);
+
+    void FreeAliasedMemory(VmaAllocation memory);
+
+    // Like AllocateTexture2D, but the image is bound to aliased memory
+    void AllocateAliasedTexture2D(vk::Texture* texture, VmaAllocation memory,
+                                  vk::TextureCreateInfo* info);
+
+    // The aliased memory is left alone
+    void DestroyAliasedTexture(vk::Texture* texture);
+
+    // Whether mipmaps of the format can be generated by linear blits
+    bool SupportsLinearBlit(VkFormat format) const;
+
+    // Whether the format can be sampled with optimal tiling
+    bool SupportsSampledFormat(VkFormat format) const;
+
     bool BeginRenderCommand();
 
     bool EndRenderCommand();
 
+    // Begins a secondary command buffer of the current frame that continues
+    // the subpass. Each slot must be used by one thread at a time.
+    VkCommandBuffer BeginSecondaryCommandBuffer(uint32_t     slot,
+                                                VkRenderPass render_pass,
+                                                uint32_t     subpass_idx);
+
+    void EndSecondaryCommandBuffer(VkCommandBuffer cmd);
+
     void CmdImageLayoutTransition(VkCommandBuffer    cmd,             //
                                   VkImage            image,           //
                                   VkImageAspectFlags aspect,          //
@@ -145,13 +243,15 @@ public:
                                   uint32_t           mip_levels = 1,  //
                                   uint32_t           layers     = 1);
 
-    void CmdCopyBufferToImage(VkCommandBuffer    cmd,     //
-                              VkBuffer           buffer,  //
-                              VkImage            image,   //
-                              VkImageAspectFlags aspect,  //
-                              uint32_t           width,   //
-                              uint32_t           height,  //
-                              uint32_t           layers = 1);
+    void CmdCopyBufferToImage(VkCommandBuffer    cmd,                //
+                              VkBuffer           buffer,             //
+                              VkImage            image,              //
+                              VkImageAspectFlags aspect,             //
+                              uint32_t           width,              //
+                              uint32_t           height,             //
+                              uint32_t           layers        = 1,  //
+                              uint32_t           mip_level     = 0,  //
+                              VkDeviceSize       buffer_offset = 0);
 
     void CmdGenerateMipMaps(VkCommandBuffer    cmd,         //
                             vk::Texture*       texture,     //
@@ -194,6 +294,12 @@ private:
     void CreateCommands();
 
     void CreateSyncStructures();
+
+    // Loads the pipeline cache of the last run, saves it at Finalize
+    void CreatePipelineCache();
+
+    // Called after waiting for the fence of the frame
+    void OnFrameComplete(int frame_idx);
 };
 
 }  // namespace lumi
\ No newline at end of file
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "function/cvars/cvar_system.h"
 #include "imgui/backends/imgui_impl_vulkan.h"
 #include "imgui/imgui.h"
@@ -88,8 +90,12 @@ void VulkanRHI::CreateImGuiContext(VkRenderPass render_pass,
     init_info.Queue          = graphics_queue_;
     init_info.DescriptorPool = imgui_pool_;
     init_info.Subpass        = subpass_idx;
-    init_info.MinImageCount  = (uint32_t)swapchain_images_.size();
-    init_info.ImageCount     = (uint32_t)swapchain_images_.size();
+    // Vertex and index buffers rotate through ImageCount sets, one per frame
+    // that may be in flight whatever rhi.frames_in_flight changes to
+    uint32_t image_count = std::max<uint32_t>(
+        (uint32_t)swapchain_images_.size(), kMaxFramesInFlight);
+    init_info.MinImageCount  = image_count;
+    init_info.ImageCount     = image_count;
     init_info.MSAASamples    = VK_SAMPLE_COUNT_1_BIT;
     ImGui_ImplVulkan_Init(&init_info, render_pass);
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <deque>
+
 #include "core/hash.h"
 #include "core/math.h"
 #include "vma/vk_mem_alloc.h"
@@ -26,6 +28,43 @@ public:
     }
 };
 
+// Destroys resources retired while frames may still use them. Destructors
+// are tagged with the number of the frame being prepared when the resource
+// was retired, and run in push order once that frame has completed.
+class DeferredDestructorQueue {
+private:
+    struct Entry {
+        uint64_t              frame{};
+        std::function<void()> destructor{};
+    };
+
+    std::deque<Entry> entries_{};
+
+public:
+    void Push(uint64_t frame, std::function<void()>&& destructor) {
+        entries_.push_back({frame, std::move(destructor)});
+    }
+
+    // Runs the destructors of the frames before completed_frames
+    void Flush(uint64_t completed_frames) {
+        while (!entries_.empty() &&
+               entries_.front().frame < completed_frames) {
+            entries_.front().destructor();
+            entries_.pop_front();
+        }
+    }
+
+    // Runs all of them, nothing may be in flight
+    void Flush() {
+        for (auto& entry : entries_) {
+            entry.destructor();
+        }
+        entries_.clear();
+    }
+
+    size_t size() const { return entries_.size(); }
+};
+
 struct AllocatedBuffer {
     VmaAllocation allocation{};
     VkBuffer      buffer{};
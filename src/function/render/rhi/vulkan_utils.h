@@ -305,9 +305,106 @@ struct PipelineBuilder {
     VkPipelineMultisampleStateCreateInfo         multisample{};
     VkPipelineLayout                             pipeline_layout{};
     VkPipelineDepthStencilStateCreateInfo        depth_stencil{};
+    // Specialization constants of all stages, constant_id is the index
+    std::vector<uint32_t>                        specialization_constants{};
+
+    // Key of the state consumed by Build, equal keys build equal pipelines.
+    // Fields are hashed one by one to skip the padding of the create infos,
+    // pNext chains are not supported.
+    uint64_t Hash(VkRenderPass render_pass, uint32_t subpass_idx) const {
+        uint64_t hash = HashBytes(&subpass_idx, sizeof(subpass_idx));
+        auto     mix  = [&hash](const auto& value) {
+            hash = HashBytes(&value, sizeof(value), hash);
+        };
+        mix(render_pass);
+        mix(pipeline_layout);
+
+        for (auto& stage : shader_stages) {
+            mix(stage.stage);
+            mix(stage.module);
+            hash = HashBytes(stage.pName, strlen(stage.pName), hash);
+        }
+
+        auto& vertex_input = vertex_input_info;
+        for (uint32_t i = 0; i < vertex_input.vertexBindingDescriptionCount;
+             i++) {
+            mix(vertex_input.pVertexBindingDescriptions[i]);
+        }
+        for (uint32_t i = 0; i < vertex_input.vertexAttributeDescriptionCount;
+             i++) {
+            mix(vertex_input.pVertexAttributeDescriptions[i]);
+        }
+
+        mix(input_assembly.topology);
+        mix(input_assembly.primitiveRestartEnable);
+        mix(viewport);
+        mix(scissor);
+
+        mix(rasterizer.depthClampEnable);
+        mix(rasterizer.rasterizerDiscardEnable);
+        mix(rasterizer.polygonMode);
+        mix(rasterizer.cullMode);
+        mix(rasterizer.frontFace);
+        mix(rasterizer.depthBiasEnable);
+        mix(rasterizer.depthBiasConstantFactor);
+        mix(rasterizer.depthBiasClamp);
+        mix(rasterizer.depthBiasSlopeFactor);
+        mix(rasterizer.lineWidth);
+
+        mix(color_blend_attachment);
+        for (auto state : dynamic_states) {
+            mix(state);
+        }
+
+        mix(multisample.rasterizationSamples);
+        mix(multisample.sampleShadingEnable);
+        mix(multisample.minSampleShading);
+        mix(multisample.alphaToCoverageEnable);
+        mix(multisample.alphaToOneEnable);
+
+        mix(depth_stencil.depthTestEnable);
+        mix(depth_stencil.depthWriteEnable);
+        mix(depth_stencil.depthCompareOp);
+        mix(depth_stencil.depthBoundsTestEnable);
+        mix(depth_stencil.stencilTestEnable);
+        mix(depth_stencil.front);
+        mix(depth_stencil.back);
+        mix(depth_stencil.minDepthBounds);
+        mix(depth_stencil.maxDepthBounds);
+
+        for (auto constant : specialization_constants) {
+            mix(constant);
+        }
+        return hash;
+    }
 
     VkPipeline Build(VkDevice device, VkRenderPass render_pass,
-                     uint32_t subpass_idx) {
+                     uint32_t        subpass_idx,
+                     VkPipelineCache pipeline_cache = VK_NULL_HANDLE) {
+        std::vector<VkSpecializationMapEntry> specialization_entries(
+            specialization_constants.size());
+        for (uint32_t i = 0; i < (uint32_t)specialization_entries.size();
+             i++) {
+            specialization_entries[i].constantID = i;
+            specialization_entries[i].offset     = i * sizeof(uint32_t);
+            specialization_entries[i].size       = sizeof(uint32_t);
+        }
+
+        VkSpecializationInfo specialization_info{};
+        specialization_info.mapEntryCount =
+            (uint32_t)specialization_entries.size();
+        specialization_info.pMapEntries = specialization_entries.data();
+        specialization_info.dataSize =
+            specialization_constants.size() * sizeof(uint32_t);
+        specialization_info.pData = specialization_constants.data();
+
+        std::vector<VkPipelineShaderStageCreateInfo> stages = shader_stages;
+        if (!specialization_constants.empty()) {
+            for (auto& stage : stages) {
+                stage.pSpecializationInfo = &specialization_info;
+            }
+        }
+
         // make viewport state from our stored viewport and scissor.
         // at the moment we won't support multiple viewports or scissors
         VkPipelineViewportStateCreateInfo viewport_state{};
@@ -345,8 +442,8 @@ struct PipelineBuilder {
         VkGraphicsPipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
         pipelineInfo.pNext = nullptr;
-        pipelineInfo.stageCount          = (uint32_t)shader_stages.size();
-        pipelineInfo.pStages             = shader_stages.data();
+        pipelineInfo.stageCount          = (uint32_t)stages.size();
+        pipelineInfo.pStages             = stages.data();
         pipelineInfo.pVertexInputState   = &vertex_input_info;
         pipelineInfo.pInputAssemblyState = &input_assembly;
         pipelineInfo.pViewportState      = &viewport_state;
@@ -363,7 +460,7 @@ struct PipelineBuilder {
         // it's easy to error out on create graphics pipeline,
         // so we handle it a bit better than the common VK_CHECK case
         VkPipeline newPipeline;
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
+        if (vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipelineInfo,
                                       nullptr, &newPipeline) != VK_SUCCESS) {
             LOG_ERROR("Failed to create pipeline");
             return VK_NULL_HANDLE;  // failed to create graphics pipeline
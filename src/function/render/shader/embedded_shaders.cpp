@@ -0,0 +1,35 @@
+#include "embedded_shaders.h"
+
+namespace lumi {
+
+namespace {
+
+// Generated in the build dir by shaders/embed_spirv.cmake
+#include "embedded_shaders.inl"
+
+constexpr size_t kEmbeddedShaderCount =
+    sizeof(kEmbeddedShaders) / sizeof(kEmbeddedShaders[0]);
+
+constexpr bool HasUniqueNames() {
+    for (size_t i = 0; i < kEmbeddedShaderCount; i++) {
+        for (size_t j = i + 1; j < kEmbeddedShaderCount; j++) {
+            if (kEmbeddedShaders[i].name.value ==
+                kEmbeddedShaders[j].name.value) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+static_assert(HasUniqueNames(), "Hash collision between shader names");
+
+}  // namespace
+
+const EmbeddedShader* FindEmbeddedShader(StringHash name) {
+    for (auto& shader : kEmbeddedShaders) {
+        if (shader.name.value == name.value) return &shader;
+    }
+    return nullptr;
+}
+
+}  // namespace lumi
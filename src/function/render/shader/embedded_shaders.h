@@ -0,0 +1,17 @@
+#pragma once
+
+#include "core/hash.h"
+
+namespace lumi {
+
+// SPIR-V of a shader compiled into the binary by the LumiShaderCompile target
+struct EmbeddedShader {
+    StringHash      name;  // Relative to the shaders folder, e.g. "pbr.frag"
+    const uint32_t* code;
+    size_t          size;  // In bytes
+};
+
+// Returns nullptr if no shader has the name
+const EmbeddedShader* FindEmbeddedShader(StringHash name);
+
+}  // namespace lumi
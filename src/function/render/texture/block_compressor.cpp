@@ -0,0 +1,441 @@
+#include "block_compressor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "core/thread_pool.h"
+
+namespace lumi {
+
+namespace {
+
+constexpr uint32_t kPowerIterations = 8;
+
+constexpr uint8_t kBC7Weights4[16] = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64,
+};
+
+// Fits a line through the points along their principal axis,
+// low and high are the extents of the projected points
+template <int N>
+void FitLine(const float (*points)[N], float* low, float* high) {
+    float mean[N] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < N; c++) mean[c] += points[i][c] / 16.0f;
+    }
+
+    float cov[N][N] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int r = 0; r < N; r++) {
+            for (int c = 0; c < N; c++) {
+                cov[r][c] +=
+                    (points[i][r] - mean[r]) * (points[i][c] - mean[c]);
+            }
+        }
+    }
+
+    // Power iteration for the dominant eigenvector
+    float axis[N];
+    std::fill(axis, axis + N, 1.0f);
+    for (uint32_t iter = 0; iter < kPowerIterations; iter++) {
+        float next[N] = {};
+        float length  = 0.0f;
+        for (int r = 0; r < N; r++) {
+            for (int c = 0; c < N; c++) next[r] += cov[r][c] * axis[c];
+            length += next[r] * next[r];
+        }
+        if (length < 1e-12f) break;  // All points are the same
+
+        length = std::sqrt(length);
+        for (int c = 0; c < N; c++) axis[c] = next[c] / length;
+    }
+
+    float min_t = std::numeric_limits<float>::max();
+    float max_t = std::numeric_limits<float>::lowest();
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < N; c++) t += (points[i][c] - mean[c]) * axis[c];
+        min_t = std::min(min_t, t);
+        max_t = std::max(max_t, t);
+    }
+
+    for (int c = 0; c < N; c++) {
+        low[c]  = std::clamp(mean[c] + axis[c] * min_t, 0.0f, 255.0f);
+        high[c] = std::clamp(mean[c] + axis[c] * max_t, 0.0f, 255.0f);
+    }
+}
+
+uint16_t Pack565(const float* color) {
+    uint32_t r = (uint32_t)std::lround(color[0] * 31.0f / 255.0f);
+    uint32_t g = (uint32_t)std::lround(color[1] * 63.0f / 255.0f);
+    uint32_t b = (uint32_t)std::lround(color[2] * 31.0f / 255.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void Unpack565(uint16_t packed, uint8_t* color) {
+    uint32_t r = (packed >> 11) & 0x1f;
+    uint32_t g = (packed >> 5) & 0x3f;
+    uint32_t b = packed & 0x1f;
+    color[0]   = (uint8_t)((r << 3) | (r >> 2));
+    color[1]   = (uint8_t)((g << 2) | (g >> 4));
+    color[2]   = (uint8_t)((b << 3) | (b >> 2));
+}
+
+// Writes fields into a zeroed block, least significant bit first
+class BitWriter {
+private:
+    uint8_t* dst_{};
+    uint32_t pos_{};
+
+public:
+    BitWriter(uint8_t* dst, size_t size) : dst_(dst) { memset(dst, 0, size); }
+
+    void Write(uint32_t value, uint32_t bits) {
+        for (uint32_t i = 0; i < bits; i++, pos_++) {
+            if ((value >> i) & 1) dst_[pos_ / 8] |= (uint8_t)(1 << (pos_ % 8));
+        }
+    }
+};
+
+}  // namespace
+
+uint32_t BlockCompressor::BlockBytes(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::kBC1:
+        case BlockFormat::kBC4:
+            return 8;
+        default:
+            return 16;
+    }
+}
+
+size_t BlockCompressor::LevelSize(BlockFormat format, uint32_t width,
+                                  uint32_t height) {
+    size_t blocks_x = (width + kBlockDim - 1) / kBlockDim;
+    size_t blocks_y = (height + kBlockDim - 1) / kBlockDim;
+    return blocks_x * blocks_y * BlockBytes(format);
+}
+
+size_t BlockCompressor::ComputeLayout(BlockFormat format, uint32_t width,
+                                      uint32_t height, uint32_t mip_levels,
+                                      std::vector<Level>& levels) {
+    levels.resize(mip_levels);
+
+    // Block sizes are 8 or 16 bytes, so every level stays aligned
+    size_t offset = 0;
+    for (uint32_t i = 0; i < mip_levels; i++) {
+        levels[i].offset = offset;
+        levels[i].width  = width;
+        levels[i].height = height;
+
+        offset += LevelSize(format, width, height);
+
+        width  = std::max(width >> 1, 1u);
+        height = std::max(height >> 1, 1u);
+    }
+    return offset;
+}
+
+void BlockCompressor::Encode(BlockFormat format, const uint8_t* rgba,
+                             uint32_t width, uint32_t height, uint8_t* dst) {
+    uint32_t blocks_x    = (width + kBlockDim - 1) / kBlockDim;
+    uint32_t blocks_y    = (height + kBlockDim - 1) / kBlockDim;
+    uint32_t block_bytes = BlockBytes(format);
+
+    ThreadPool::Instance().ParallelFor(blocks_y, [&](uint32_t by) {
+        uint8_t block[kBlockDim * kBlockDim * 4];
+        for (uint32_t bx = 0; bx < blocks_x; bx++) {
+            // Clamp to the edge for partial blocks
+            for (uint32_t y = 0; y < kBlockDim; y++) {
+                uint32_t sy = std::min(by * kBlockDim + y, height - 1);
+                for (uint32_t x = 0; x < kBlockDim; x++) {
+                    uint32_t sx = std::min(bx * kBlockDim + x, width - 1);
+                    memcpy(block + (y * kBlockDim + x) * 4,
+                           rgba + ((size_t)sy * width + sx) * 4, 4);
+                }
+            }
+
+            uint8_t* out = dst + ((size_t)by * blocks_x + bx) * block_bytes;
+            switch (format) {
+                case BlockFormat::kBC1:
+                    EncodeBC1Block(block, out);
+                    break;
+                case BlockFormat::kBC3:
+                    EncodeBC4Block(block, 3, out);
+                    EncodeBC1Block(block, out + 8);
+                    break;
+                case BlockFormat::kBC4:
+                    EncodeBC4Block(block, 0, out);
+                    break;
+                case BlockFormat::kBC5:
+                    EncodeBC4Block(block, 0, out);
+                    EncodeBC4Block(block, 1, out + 8);
+                    break;
+                case BlockFormat::kBC7:
+                    EncodeBC7Block(block, out);
+                    break;
+            }
+        }
+    });
+}
+
+bool BlockCompressor::Decode(BlockFormat format, const uint8_t* src,
+                             uint32_t width, uint32_t height, uint8_t* rgba) {
+    if (format == BlockFormat::kBC7) return false;
+
+    uint32_t blocks_x    = (width + kBlockDim - 1) / kBlockDim;
+    uint32_t blocks_y    = (height + kBlockDim - 1) / kBlockDim;
+    uint32_t block_bytes = BlockBytes(format);
+
+    ThreadPool::Instance().ParallelFor(blocks_y, [&](uint32_t by) {
+        uint8_t block[kBlockDim * kBlockDim * 4];
+        for (uint32_t bx = 0; bx < blocks_x; bx++) {
+            const uint8_t* in =
+                src + ((size_t)by * blocks_x + bx) * block_bytes;
+            switch (format) {
+                case BlockFormat::kBC1:
+                    DecodeBC1Block(in, false, block);
+                    break;
+                case BlockFormat::kBC3:
+                    DecodeBC1Block(in + 8, true, block);
+                    DecodeBC4Block(in, 3, block);
+                    break;
+                case BlockFormat::kBC4:
+                case BlockFormat::kBC5:
+                    for (uint32_t i = 0; i < kBlockDim * kBlockDim; i++) {
+                        block[i * 4 + 1] = 0;
+                        block[i * 4 + 2] = 0;
+                        block[i * 4 + 3] = 255;
+                    }
+                    DecodeBC4Block(in, 0, block);
+                    if (format == BlockFormat::kBC5) {
+                        DecodeBC4Block(in + 8, 1, block);
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            for (uint32_t y = 0; y < kBlockDim; y++) {
+                uint32_t dy = by * kBlockDim + y;
+                if (dy >= height) break;
+                for (uint32_t x = 0; x < kBlockDim; x++) {
+                    uint32_t dx = bx * kBlockDim + x;
+                    if (dx >= width) break;
+                    memcpy(rgba + ((size_t)dy * width + dx) * 4,
+                           block + (y * kBlockDim + x) * 4, 4);
+                }
+            }
+        }
+    });
+    return true;
+}
+
+void BlockCompressor::EncodeBC1Block(const uint8_t* block, uint8_t* dst) {
+    float colors[16][3];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) colors[i][c] = block[i * 4 + c];
+    }
+
+    float low[3], high[3];
+    FitLine<3>(colors, low, high);
+
+    // color0 > color1 selects the 4-color mode
+    uint16_t color0 = Pack565(high);
+    uint16_t color1 = Pack565(low);
+    if (color0 < color1) std::swap(color0, color1);
+
+    uint8_t palette[4][3];
+    Unpack565(color0, palette[0]);
+    Unpack565(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c]) / 3);
+        palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c]) / 3);
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        for (int i = 0; i < 16; i++) {
+            uint32_t best       = 0;
+            int32_t  best_error = INT32_MAX;
+            for (uint32_t p = 0; p < 4; p++) {
+                int32_t error = 0;
+                for (int c = 0; c < 3; c++) {
+                    int32_t d = (int32_t)block[i * 4 + c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < best_error) {
+                    best       = p;
+                    best_error = error;
+                }
+            }
+            indices |= best << (2 * i);
+        }
+    }
+
+    dst[0] = (uint8_t)(color0 & 0xff);
+    dst[1] = (uint8_t)(color0 >> 8);
+    dst[2] = (uint8_t)(color1 & 0xff);
+    dst[3] = (uint8_t)(color1 >> 8);
+    for (int i = 0; i < 4; i++) dst[4 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+void BlockCompressor::EncodeBC4Block(const uint8_t* block, uint32_t channel,
+                                     uint8_t* dst) {
+    uint8_t lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++) {
+        lo = std::min(lo, block[i * 4 + channel]);
+        hi = std::max(hi, block[i * 4 + channel]);
+    }
+
+    // endpoint0 > endpoint1 selects the 8 values mode
+    uint64_t indices = 0;
+    if (hi > lo) {
+        int32_t range = hi - lo;
+        for (int i = 0; i < 16; i++) {
+            // Position between lo (0) and hi (7) rounded to nearest
+            int32_t  t = ((block[i * 4 + channel] - lo) * 14 + range) /
+                        (2 * range);
+            uint64_t index = t == 7 ? 0 : (t == 0 ? 1 : 8 - t);
+            indices |= index << (3 * i);
+        }
+    }
+
+    dst[0] = hi;
+    dst[1] = lo;
+    for (int i = 0; i < 6; i++) dst[2 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+void BlockCompressor::EncodeBC7Block(const uint8_t* block, uint8_t* dst) {
+    float colors[16][4];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) colors[i][c] = block[i * 4 + c];
+    }
+
+    float endpoints[2][4];
+    FitLine<4>(colors, endpoints[0], endpoints[1]);
+
+    // Quantize to 7 bits per channel plus a shared p-bit per endpoint
+    uint8_t quantized[2][4], pbits[2];
+    for (int e = 0; e < 2; e++) {
+        float best_error = std::numeric_limits<float>::max();
+        for (uint8_t p = 0; p < 2; p++) {
+            uint8_t q[4];
+            float   error = 0.0f;
+            for (int c = 0; c < 4; c++) {
+                float v = std::round((endpoints[e][c] - p) / 2.0f);
+                q[c]    = (uint8_t)std::clamp(v, 0.0f, 127.0f);
+                float d = (float)((q[c] << 1) | p) - endpoints[e][c];
+                error += d * d;
+            }
+            if (error < best_error) {
+                best_error = error;
+                pbits[e]   = p;
+                memcpy(quantized[e], q, 4);
+            }
+        }
+    }
+
+    uint8_t palette[16][4];
+    for (int c = 0; c < 4; c++) {
+        int32_t e0 = (quantized[0][c] << 1) | pbits[0];
+        int32_t e1 = (quantized[1][c] << 1) | pbits[1];
+        for (int i = 0; i < 16; i++) {
+            int32_t w     = kBC7Weights4[i];
+            palette[i][c] = (uint8_t)(((64 - w) * e0 + w * e1 + 32) >> 6);
+        }
+    }
+
+    uint8_t indices[16];
+    for (int i = 0; i < 16; i++) {
+        int32_t best_error = INT32_MAX;
+        for (uint8_t p = 0; p < 16; p++) {
+            int32_t error = 0;
+            for (int c = 0; c < 4; c++) {
+                int32_t d = (int32_t)block[i * 4 + c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < best_error) {
+                best_error = error;
+                indices[i] = p;
+            }
+        }
+    }
+
+    // The anchor index has its most significant bit implied to be 0
+    if (indices[0] & 8) {
+        std::swap(quantized[0], quantized[1]);
+        std::swap(pbits[0], pbits[1]);
+        for (auto& index : indices) index = 15 - index;
+    }
+
+    BitWriter writer(dst, 16);
+    writer.Write(1 << 6, 7);  // mode 6
+    for (int c = 0; c < 4; c++) {
+        writer.Write(quantized[0][c], 7);
+        writer.Write(quantized[1][c], 7);
+    }
+    writer.Write(pbits[0], 1);
+    writer.Write(pbits[1], 1);
+    writer.Write(indices[0], 3);
+    for (int i = 1; i < 16; i++) writer.Write(indices[i], 4);
+}
+
+void BlockCompressor::DecodeBC1Block(const uint8_t* src, bool has_alpha_block,
+                                     uint8_t* block) {
+    uint16_t color0 = (uint16_t)(src[0] | (src[1] << 8));
+    uint16_t color1 = (uint16_t)(src[2] | (src[3] << 8));
+    uint32_t indices =
+        src[4] | (src[5] << 8) | (src[6] << 16) | ((uint32_t)src[7] << 24);
+
+    uint8_t palette[4][4];
+    Unpack565(color0, palette[0]);
+    Unpack565(color1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    if (color0 > color1 || has_alpha_block) {
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c]) / 3);
+            palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c]) / 3);
+        }
+    } else {
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c]) / 2);
+            palette[3][c] = 0;
+        }
+        palette[3][3] = 0;
+    }
+
+    for (int i = 0; i < 16; i++) {
+        memcpy(block + i * 4, palette[(indices >> (2 * i)) & 3], 4);
+    }
+}
+
+void BlockCompressor::DecodeBC4Block(const uint8_t* src, uint32_t channel,
+                                     uint8_t* block) {
+    uint8_t palette[8];
+    palette[0] = src[0];
+    palette[1] = src[1];
+    if (palette[0] > palette[1]) {
+        for (int i = 2; i < 8; i++) {
+            palette[i] =
+                (uint8_t)(((8 - i) * palette[0] + (i - 1) * palette[1]) / 7);
+        }
+    } else {
+        for (int i = 2; i < 6; i++) {
+            palette[i] =
+                (uint8_t)(((6 - i) * palette[0] + (i - 1) * palette[1]) / 5);
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; i++) indices |= (uint64_t)src[2 + i] << (8 * i);
+    for (int i = 0; i < 16; i++) {
+        block[i * 4 + channel] = palette[(indices >> (3 * i)) & 7];
+    }
+}
+
+}  // namespace lumi
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "mip_generator.h"
+
+namespace lumi {
+
+enum class BlockFormat {
+    kBC1,  // RGB, 1-bit alpha is not used
+    kBC3,  // RGBA
+    kBC4,  // R
+    kBC5,  // RG, for normal maps
+    kBC7,  // RGBA, high quality color
+};
+
+// Encodes RGBA8 images into 4x4 block compressed formats on the CPU.
+// The BC7 encoder only emits mode 6 blocks, which have a single subset with
+// 7.7.7.7 endpoints and 4-bit indices.
+class BlockCompressor {
+public:
+    constexpr static uint32_t kBlockDim = 4;
+
+    using Level = MipGenerator::Level;
+
+    static uint32_t BlockBytes(BlockFormat format);
+
+    static size_t LevelSize(BlockFormat format, uint32_t width,
+                            uint32_t height);
+
+    // Fills the packed layout of the mip chain, returns its total size
+    static size_t ComputeLayout(BlockFormat format, uint32_t width,
+                                uint32_t height, uint32_t mip_levels,
+                                std::vector<Level>& levels);
+
+    // Encodes a tightly packed RGBA8 image, rows of blocks run in parallel
+    static void Encode(BlockFormat format, const uint8_t* rgba, uint32_t width,
+                       uint32_t height, uint8_t* dst);
+
+    // Decodes into a tightly packed RGBA8 image.
+    // BC7 is not supported, returns false in that case.
+    static bool Decode(BlockFormat format, const uint8_t* src, uint32_t width,
+                       uint32_t height, uint8_t* rgba);
+
+private:
+    // block holds 16 RGBA8 texels in row major order
+    static void EncodeBC1Block(const uint8_t* block, uint8_t* dst);
+
+    static void EncodeBC4Block(const uint8_t* block, uint32_t channel,
+                               uint8_t* dst);
+
+    static void EncodeBC7Block(const uint8_t* block, uint8_t* dst);
+
+    static void DecodeBC1Block(const uint8_t* src, bool has_alpha_block,
+                               uint8_t* block);
+
+    static void DecodeBC4Block(const uint8_t* src, uint32_t channel,
+                               uint8_t* block);
+};
+
+}  // namespace lumi
@@ -0,0 +1,17 @@
+#pragma once
+
+namespace lumi {
+
+// Direction of face coordinates s, t in [-1, 1] is origin + s * s_axis +
+// t * t_axis, see the cube map face selection table of the Vulkan spec.
+// Faces follow the layer order +X, -X, +Y, -Y, +Z, -Z.
+constexpr float kCubemapFaceAxes[6][3][3] = {
+    {{1, 0, 0}, {0, 0, -1}, {0, -1, 0}},   // +X
+    {{-1, 0, 0}, {0, 0, 1}, {0, -1, 0}},   // -X
+    {{0, 1, 0}, {1, 0, 0}, {0, 0, 1}},     // +Y
+    {{0, -1, 0}, {1, 0, 0}, {0, 0, -1}},   // -Y
+    {{0, 0, 1}, {1, 0, 0}, {0, -1, 0}},    // +Z
+    {{0, 0, -1}, {-1, 0, 0}, {0, -1, 0}},  // -Z
+};
+
+}  // namespace lumi
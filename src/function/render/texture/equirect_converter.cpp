@@ -0,0 +1,204 @@
+#include "equirect_converter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "core/json.h"
+#include "core/thread_pool.h"
+#include "cubemap_faces.h"
+#include "float_converter.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define LUMI_EQUIRECT_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace lumi {
+
+namespace {
+
+constexpr uint32_t kRowsPerJob = 8;
+constexpr float    kPi         = 3.14159265358979f;
+
+// Bilinear filtering, wraps around horizontally and clamps at the poles
+void SampleBilinear(const float* rgba, uint32_t width, uint32_t height,
+                    float u, float v, float* out) {
+    float   fx   = u * width - 0.5f;
+    float   fy   = v * height - 0.5f;
+    int32_t x0   = (int32_t)(fx + 1.0f) - 1;  // floor, fx and fy are >= -1
+    int32_t y0   = (int32_t)(fy + 1.0f) - 1;
+    float   wx   = fx - x0;
+    float   wy   = fy - y0;
+    int32_t last = (int32_t)height - 1;
+
+    // u is in [0, 1], so x0 is at most one texel out of range
+    uint32_t ix0 = x0 < 0 ? x0 + width : std::min((uint32_t)x0, width - 1);
+    uint32_t ix1 = ix0 + 1 < width ? ix0 + 1 : 0;
+    uint32_t iy0 = (uint32_t)std::clamp(y0, 0, last);
+    uint32_t iy1 = (uint32_t)std::clamp(y0 + 1, 0, last);
+
+    const float* p00 = rgba + ((size_t)iy0 * width + ix0) * 4;
+    const float* p01 = rgba + ((size_t)iy0 * width + ix1) * 4;
+    const float* p10 = rgba + ((size_t)iy1 * width + ix0) * 4;
+    const float* p11 = rgba + ((size_t)iy1 * width + ix1) * 4;
+
+#ifdef LUMI_EQUIRECT_SSE2
+    auto lerp = [](__m128 a, __m128 b, float w) {
+        return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(w)));
+    };
+    __m128 top = lerp(_mm_loadu_ps(p00), _mm_loadu_ps(p01), wx);
+    __m128 bot = lerp(_mm_loadu_ps(p10), _mm_loadu_ps(p11), wx);
+    _mm_storeu_ps(out, lerp(top, bot, wy));
+#else
+    for (uint32_t c = 0; c < 4; c++) {
+        float top = p00[c] + (p01[c] - p00[c]) * wx;
+        float bot = p10[c] + (p11[c] - p10[c]) * wx;
+        out[c]    = top + (bot - top) * wy;
+    }
+#endif
+}
+
+#ifdef LUMI_EQUIRECT_SSE2
+// Polynomial approximation, the error is below 1e-5 radians
+__m128 Atan2(__m128 y, __m128 x) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 abs_x = _mm_andnot_ps(sign, x);
+    __m128 abs_y = _mm_andnot_ps(sign, y);
+    __m128 a     = _mm_div_ps(_mm_min_ps(abs_x, abs_y),
+                              _mm_max_ps(_mm_max_ps(abs_x, abs_y),
+                                         _mm_set1_ps(1e-30f)));
+    __m128 s     = _mm_mul_ps(a, a);
+    __m128 r     = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(-0.0464964749f)),
+                              _mm_set1_ps(0.15931422f));
+    r = _mm_sub_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.327622764f));
+    r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+
+    auto select = [](__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    };
+    r = select(_mm_cmpgt_ps(abs_y, abs_x),
+               _mm_sub_ps(_mm_set1_ps(kPi * 0.5f), r), r);
+    r = select(_mm_cmplt_ps(x, zero), _mm_sub_ps(_mm_set1_ps(kPi), r), r);
+    return _mm_or_ps(r, _mm_and_ps(y, sign));
+}
+#endif
+
+}  // namespace
+
+uint32_t EquirectConverter::FaceSize(uint32_t width) {
+    uint32_t size = 1;
+    while (size * 2 <= width / 4) {
+        size *= 2;
+    }
+    return size;
+}
+
+uint32_t EquirectConverter::TexelSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return sizeof(float) * 4;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return sizeof(uint16_t) * 4;
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+            return sizeof(uint32_t);
+        default:
+            return 0;
+    }
+}
+
+bool EquirectConverter::ToCubemap(const float* rgba, uint32_t width,
+                                  uint32_t height, uint32_t face_size,
+                                  VkFormat format, void* dst) {
+    uint32_t texel_size = TexelSize(format);
+    if (texel_size == 0) {
+        LOG_ERROR("Unsupported format {} for cubemap faces", format);
+        return false;
+    }
+
+    size_t   row_bytes     = (size_t)face_size * texel_size;
+    uint32_t jobs_per_face = (face_size + kRowsPerJob - 1) / kRowsPerJob;
+    ThreadPool::Instance().ParallelFor(6 * jobs_per_face, [&](uint32_t job) {
+        uint32_t face  = job / jobs_per_face;
+        uint32_t begin = job % jobs_per_face * kRowsPerJob;
+        uint32_t end   = std::min(begin + kRowsPerJob, face_size);
+
+        std::vector<float> row(face_size * 4);
+        for (uint32_t y = begin; y < end; y++) {
+            ResampleRow(rgba, width, height, face_size, face, y, row.data());
+
+            size_t   texel = ((size_t)face * face_size + y) * face_size;
+            uint8_t* out   = (uint8_t*)dst + texel * texel_size;
+            switch (format) {
+                case VK_FORMAT_R32G32B32A32_SFLOAT:
+                    memcpy(out, row.data(), row_bytes);
+                    break;
+                case VK_FORMAT_R16G16B16A16_SFLOAT:
+                    FloatConverter::ToHalf(row.data(), (uint16_t*)out,
+                                           face_size * 4);
+                    break;
+                default:
+                    FloatConverter::ToB10G11R11(row.data(), (uint32_t*)out,
+                                                face_size);
+                    break;
+            }
+        }
+    });
+    return true;
+}
+
+void EquirectConverter::ResampleRow(const float* rgba, uint32_t width,
+                                    uint32_t height, uint32_t face_size,
+                                    uint32_t face, uint32_t y, float* row) {
+    const float(&axes)[3][3] = kCubemapFaceAxes[face];
+
+    float scale = 2.0f / face_size;
+    float t     = (y + 0.5f) * scale - 1.0f;
+
+    // u = 0.5 + atan2(z, x) / 2pi, v = acos(y) / pi = atan2(|xz|, y) / pi
+    uint32_t x = 0;
+#ifdef LUMI_EQUIRECT_SSE2
+    for (; x + 4 <= face_size; x += 4) {
+        __m128 s = _mm_cvtepi32_ps(_mm_setr_epi32(x, x + 1, x + 2, x + 3));
+        s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(s, _mm_set1_ps(0.5f)),
+                                  _mm_set1_ps(scale)),
+                       _mm_set1_ps(1.0f));
+
+        __m128 dir[3]{};
+        for (uint32_t c = 0; c < 3; c++) {
+            dir[c] = _mm_add_ps(_mm_set1_ps(axes[0][c] + t * axes[2][c]),
+                                _mm_mul_ps(s, _mm_set1_ps(axes[1][c])));
+        }
+        __m128 horizontal = _mm_sqrt_ps(_mm_add_ps(
+            _mm_mul_ps(dir[0], dir[0]), _mm_mul_ps(dir[2], dir[2])));
+
+        alignas(16) float u[4];
+        alignas(16) float v[4];
+        _mm_store_ps(u, _mm_add_ps(_mm_set1_ps(0.5f),
+                                   _mm_mul_ps(Atan2(dir[2], dir[0]),
+                                              _mm_set1_ps(0.5f / kPi))));
+        _mm_store_ps(v, _mm_mul_ps(Atan2(horizontal, dir[1]),
+                                   _mm_set1_ps(1.0f / kPi)));
+        for (uint32_t i = 0; i < 4; i++) {
+            SampleBilinear(rgba, width, height, u[i], v[i],
+                           row + (x + i) * 4);
+        }
+    }
+#endif
+    for (; x < face_size; x++) {
+        float s = (x + 0.5f) * scale - 1.0f;
+        float dir[3]{};
+        for (uint32_t c = 0; c < 3; c++) {
+            dir[c] = axes[0][c] + s * axes[1][c] + t * axes[2][c];
+        }
+        float horizontal = std::sqrt(dir[0] * dir[0] + dir[2] * dir[2]);
+
+        float u = 0.5f + std::atan2(dir[2], dir[0]) * (0.5f / kPi);
+        float v = std::atan2(horizontal, dir[1]) / kPi;
+        SampleBilinear(rgba, width, height, u, v, row + x * 4);
+    }
+}
+
+}  // namespace lumi
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "vulkan/vulkan.h"
+
+namespace lumi {
+
+// Resamples equirectangular (latitude-longitude) environment maps into
+// cubemap faces. +Y is up, u = 0.5 looks towards +X, and the faces follow the
+// Vulkan layer order +X, -X, +Y, -Y, +Z, -Z.
+class EquirectConverter {
+public:
+    // Largest power of 2 not above a quarter of the source width
+    static uint32_t FaceSize(uint32_t width);
+
+    static uint32_t TexelSize(VkFormat format);
+
+    // rgba is a tightly packed RGBA32F image. dst receives the 6 faces back to
+    // back in the given format, with bilinear filtering.
+    // Supported formats are R32G32B32A32_SFLOAT, R16G16B16A16_SFLOAT and
+    // B10G11R11_UFLOAT_PACK32. Rows of all faces run in parallel.
+    static bool ToCubemap(const float* rgba, uint32_t width, uint32_t height,
+                          uint32_t face_size, VkFormat format, void* dst);
+
+private:
+    static void ResampleRow(const float* rgba, uint32_t width, uint32_t height,
+                            uint32_t face_size, uint32_t face, uint32_t y,
+                            float* row);
+};
+
+}  // namespace lumi
@@ -0,0 +1,238 @@
+#include "float_converter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define LUMI_RGBE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__)
+#define LUMI_HALF_F16C
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define LUMI_TARGET_F16C
+#else
+#define LUMI_TARGET_F16C __attribute__((target("f16c")))
+#endif
+#endif
+
+namespace lumi {
+
+namespace {
+
+constexpr size_t kChunkTexels = 256;
+
+// 2^(e - 128) / 256 for the shared exponent e, 0 means black
+struct RGBEScaleTable {
+    float scale[256]{};
+
+    RGBEScaleTable() {
+        for (int e = 1; e < 256; e++) {
+            scale[e] = std::ldexp(1.0f, e - (128 + 8));
+        }
+    }
+};
+
+#ifdef LUMI_HALF_F16C
+bool HasF16C() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 29)) != 0;
+#else
+    return __builtin_cpu_supports("f16c");
+#endif
+}
+
+LUMI_TARGET_F16C size_t ToHalfF16C(const float* src, uint16_t* dst,
+                                   size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i lo =
+            _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        __m128i hi =
+            _mm_cvtps_ph(_mm_loadu_ps(src + i + 4), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi64(lo, hi));
+    }
+    return i;
+}
+
+LUMI_TARGET_F16C size_t FromHalfF16C(const uint16_t* src, float* dst,
+                                     size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i halves = _mm_loadl_epi64((const __m128i*)(src + i));
+        _mm_storeu_ps(dst + i, _mm_cvtph_ps(halves));
+    }
+    return i;
+}
+#endif
+
+// Rounds a positive half to an unsigned float with fewer mantissa bits
+uint32_t HalfToUFloat(uint16_t half, uint32_t mantissa_bits) {
+    if (half & 0x8000) return 0;
+
+    uint32_t exp_mantissa = half & 0x7fff;
+    uint32_t max_finite =
+        (0x1e << mantissa_bits) | ((1 << mantissa_bits) - 1);
+    if (exp_mantissa >= 0x7c00) {
+        // Keep NaN, clamp infinity
+        return exp_mantissa > 0x7c00 ? (0x1f << mantissa_bits) | 1
+                                     : max_finite;
+    }
+
+    uint32_t shift = 10 - mantissa_bits;
+    uint32_t odd   = (exp_mantissa >> shift) & 1;
+    uint32_t value = (exp_mantissa + (1 << (shift - 1)) - 1 + odd) >> shift;
+    return std::min(value, max_finite);
+}
+
+}  // namespace
+
+uint16_t FloatConverter::ToHalf(float value) {
+    uint32_t bits{};
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+
+    // Inf and NaN, or too large to be represented
+    if (bits >= 0x47800000) {
+        return (uint16_t)(sign | (bits > 0x7f800000 ? 0x7e00 : 0x7c00));
+    }
+
+    // Denormals, let the float unit do the rounding
+    if (bits < 0x38800000) {
+        constexpr uint32_t kDenormMagic = 0x3f000000;  // 0.5f
+        float              f{};
+        memcpy(&f, &bits, sizeof(f));
+        float magic{};
+        memcpy(&magic, &kDenormMagic, sizeof(magic));
+        f += magic;
+        memcpy(&bits, &f, sizeof(bits));
+        return (uint16_t)(sign | (bits - kDenormMagic));
+    }
+
+    // Rebias the exponent and round the mantissa to nearest even
+    uint32_t odd = (bits >> 13) & 1;
+    bits += 0xc8000fff + odd;
+    return (uint16_t)(sign | (bits >> 13));
+}
+
+void FloatConverter::ToHalf(const float* src, uint16_t* dst, size_t count) {
+    size_t i = 0;
+#ifdef LUMI_HALF_F16C
+    static const bool has_f16c = HasF16C();
+    if (has_f16c) i = ToHalfF16C(src, dst, count);
+#endif
+    for (; i < count; i++) {
+        dst[i] = ToHalf(src[i]);
+    }
+}
+
+float FloatConverter::FromHalf(uint16_t value) {
+    uint32_t sign         = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exp_mantissa = value & 0x7fff;
+
+    uint32_t bits{};
+    if (exp_mantissa >= 0x7c00) {
+        // Infinity and NaN
+        bits = 0x7f800000 | ((exp_mantissa & 0x3ff) << 13);
+    } else {
+        // Scaling by 2^112 rebiases the exponent, denormals included
+        constexpr uint32_t kRebiasMagic = 0x77800000;
+        float              f{};
+        float              magic{};
+        bits = exp_mantissa << 13;
+        memcpy(&f, &bits, sizeof(f));
+        memcpy(&magic, &kRebiasMagic, sizeof(magic));
+        f *= magic;
+        memcpy(&bits, &f, sizeof(bits));
+    }
+    bits |= sign;
+
+    float result{};
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void FloatConverter::FromHalf(const uint16_t* src, float* dst, size_t count) {
+    size_t i = 0;
+#ifdef LUMI_HALF_F16C
+    static const bool has_f16c = HasF16C();
+    if (has_f16c) i = FromHalfF16C(src, dst, count);
+#endif
+    for (; i < count; i++) {
+        dst[i] = FromHalf(src[i]);
+    }
+}
+
+void FloatConverter::FromB10G11R11(const uint32_t* src, float* rgba,
+                                   size_t texel_count) {
+    // The unsigned 11 and 10-bit floats share the exponent bias of halves
+    uint16_t halves[kChunkTexels * 4];
+    for (size_t begin = 0; begin < texel_count; begin += kChunkTexels) {
+        size_t count = std::min(kChunkTexels, texel_count - begin);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t packed   = src[begin + i];
+            halves[i * 4 + 0] = (uint16_t)((packed & 0x7ff) << 4);
+            halves[i * 4 + 1] = (uint16_t)(((packed >> 11) & 0x7ff) << 4);
+            halves[i * 4 + 2] = (uint16_t)(((packed >> 22) & 0x3ff) << 5);
+            halves[i * 4 + 3] = 0x3c00;  // 1.0
+        }
+        FromHalf(halves, rgba + begin * 4, count * 4);
+    }
+}
+
+void FloatConverter::RGBEToFloat(const uint8_t* rgbe, float* rgba,
+                                 size_t texel_count) {
+    static const RGBEScaleTable table{};
+
+#ifdef LUMI_RGBE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128  rgb  = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    const __m128  one  = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    for (size_t i = 0; i < texel_count; i++) {
+        int32_t packed{};
+        memcpy(&packed, rgbe + i * 4, sizeof(packed));
+
+        // Widen the 4 bytes to 32-bit lanes, the exponent lane is masked out
+        __m128i bytes = _mm_cvtsi32_si128(packed);
+        bytes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+
+        __m128 value = _mm_mul_ps(_mm_cvtepi32_ps(bytes),
+                                  _mm_set1_ps(table.scale[rgbe[i * 4 + 3]]));
+        _mm_storeu_ps(rgba + i * 4, _mm_or_ps(_mm_and_ps(value, rgb), one));
+    }
+#else
+    for (size_t i = 0; i < texel_count; i++) {
+        float scale     = table.scale[rgbe[i * 4 + 3]];
+        rgba[i * 4 + 0] = rgbe[i * 4 + 0] * scale;
+        rgba[i * 4 + 1] = rgbe[i * 4 + 1] * scale;
+        rgba[i * 4 + 2] = rgbe[i * 4 + 2] * scale;
+        rgba[i * 4 + 3] = 1.0f;
+    }
+#endif
+}
+
+void FloatConverter::ToB10G11R11(const float* rgba, uint32_t* dst,
+                                 size_t texel_count) {
+    uint16_t halves[kChunkTexels * 4];
+    for (size_t begin = 0; begin < texel_count; begin += kChunkTexels) {
+        size_t count = std::min(kChunkTexels, texel_count - begin);
+        ToHalf(rgba + begin * 4, halves, count * 4);
+
+        for (size_t i = 0; i < count; i++) {
+            uint32_t r = HalfToUFloat(halves[i * 4 + 0], 6);
+            uint32_t g = HalfToUFloat(halves[i * 4 + 1], 6);
+            uint32_t b = HalfToUFloat(halves[i * 4 + 2], 5);
+            dst[begin + i] = r | (g << 11) | (b << 22);
+        }
+    }
+}
+
+}  // namespace lumi
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace lumi {
+
+// Converts between the float formats of HDR textures.
+// F16C is used when the CPU supports it, results are rounded to nearest even.
+class FloatConverter {
+public:
+    // VK_FORMAT_R16G16B16A16_SFLOAT and other half formats
+    static void ToHalf(const float* src, uint16_t* dst, size_t count);
+
+    // VK_FORMAT_B10G11R11_UFLOAT_PACK32 from RGBA texels, alpha is dropped.
+    // Negative values become 0 and values above the range are clamped.
+    static void ToB10G11R11(const float* rgba, uint32_t* dst,
+                            size_t texel_count);
+
+    static void FromHalf(const uint16_t* src, float* dst, size_t count);
+
+    // RGBA floats from VK_FORMAT_B10G11R11_UFLOAT_PACK32, alpha is set to 1
+    static void FromB10G11R11(const uint32_t* src, float* rgba,
+                              size_t texel_count);
+
+    // Expands Radiance RGBE texels to RGBA floats, alpha is set to 1
+    static void RGBEToFloat(const uint8_t* rgbe, float* rgba,
+                            size_t texel_count);
+
+    static uint16_t ToHalf(float value);
+
+    static float FromHalf(uint16_t value);
+};
+
+}  // namespace lumi
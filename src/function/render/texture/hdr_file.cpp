@@ -0,0 +1,153 @@
+#include "hdr_file.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "float_converter.h"
+
+namespace lumi {
+
+namespace {
+
+// Reads a header line without the line break, returns false at the end
+bool ReadLine(const std::vector<uint8_t>& data, size_t& cursor,
+              std::string& line) {
+    line.clear();
+    while (cursor < data.size()) {
+        char c = (char)data[cursor++];
+        if (c == '\n') return true;
+        line += c;
+    }
+    return false;
+}
+
+}  // namespace
+
+bool HDRFile::Load(const fs::path& filepath, HDRFile* file) {
+    auto in = std::ifstream(filepath, std::ios::ate | std::ios::binary);
+    if (!in.is_open()) {
+        LOG_ERROR("Failed to open HDR file {}", filepath);
+        return false;
+    }
+    size_t file_size = (size_t)in.tellg();
+    file->data_.resize(file_size);
+    in.seekg(0);
+    in.read((char*)file->data_.data(), file_size);
+    in.close();
+
+    size_t      cursor = 0;
+    std::string line{};
+    if (!ReadLine(file->data_, cursor, line) ||
+        (line != "#?RADIANCE" && line != "#?RGBE")) {
+        LOG_ERROR("Invalid HDR file {}", filepath);
+        return false;
+    }
+
+    // Header ends with an empty line
+    while (ReadLine(file->data_, cursor, line) && !line.empty()) {
+        if (line.rfind("FORMAT=", 0) == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+            LOG_ERROR("Unsupported {} in HDR file {}", line, filepath);
+            return false;
+        }
+    }
+
+    int width = 0, height = 0;
+    if (!ReadLine(file->data_, cursor, line) ||
+        sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2 ||
+        width <= 0 || height <= 0) {
+        LOG_ERROR("Unsupported image orientation in HDR file {}", filepath);
+        return false;
+    }
+
+    file->width_         = (uint32_t)width;
+    file->height_        = (uint32_t)height;
+    file->pixels_offset_ = cursor;
+    return true;
+}
+
+bool HDRFile::Decode(VkFormat format, void* dst) const {
+    std::vector<uint8_t> rgbe(width_ * 4);
+    std::vector<float>   rgba(width_ * 4);
+
+    size_t cursor = pixels_offset_;
+    for (uint32_t y = 0; y < height_; y++) {
+        if (!DecodeScanline(cursor, rgbe.data())) {
+            LOG_ERROR("Corrupted scanline {} in HDR file", y);
+            return false;
+        }
+
+        size_t row = (size_t)y * width_;
+        switch (format) {
+            case VK_FORMAT_R32G32B32A32_SFLOAT:
+                FloatConverter::RGBEToFloat(rgbe.data(), (float*)dst + row * 4,
+                                            width_);
+                break;
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+                FloatConverter::RGBEToFloat(rgbe.data(), rgba.data(), width_);
+                FloatConverter::ToHalf(rgba.data(), (uint16_t*)dst + row * 4,
+                                       width_ * 4);
+                break;
+            case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+                FloatConverter::RGBEToFloat(rgbe.data(), rgba.data(), width_);
+                FloatConverter::ToB10G11R11(rgba.data(), (uint32_t*)dst + row,
+                                            width_);
+                break;
+            default:
+                LOG_ERROR("Unsupported format {} to decode HDR file", format);
+                return false;
+        }
+    }
+    return true;
+}
+
+bool HDRFile::DecodeScanline(size_t& cursor, uint8_t* rgbe) const {
+    const uint8_t* data = data_.data();
+    size_t         size = data_.size();
+
+    // New RLE scanlines start with 2, 2 and the width in 15 bits
+    bool is_rle = width_ >= 8 && width_ < 32768 && cursor + 4 <= size &&
+                  data[cursor] == 2 && data[cursor + 1] == 2 &&
+                  !(data[cursor + 2] & 0x80);
+    if (!is_rle) {
+        size_t row_size = (size_t)width_ * 4;
+        if (cursor + row_size > size) return false;
+
+        memcpy(rgbe, data + cursor, row_size);
+        cursor += row_size;
+        return true;
+    }
+
+    uint32_t length = (data[cursor + 2] << 8) | data[cursor + 3];
+    if (length != width_) return false;
+    cursor += 4;
+
+    // Each channel is run length encoded separately
+    for (uint32_t channel = 0; channel < 4; channel++) {
+        uint32_t x = 0;
+        while (x < width_) {
+            if (cursor >= size) return false;
+
+            uint32_t count = data[cursor++];
+            if (count > 128) {
+                // A run of the same value
+                count -= 128;
+                if (x + count > width_ || cursor >= size) return false;
+
+                uint8_t value = data[cursor++];
+                for (uint32_t i = 0; i < count; i++, x++) {
+                    rgbe[x * 4 + channel] = value;
+                }
+            } else {
+                if (count == 0 || x + count > width_ || cursor + count > size) {
+                    return false;
+                }
+                for (uint32_t i = 0; i < count; i++, x++) {
+                    rgbe[x * 4 + channel] = data[cursor++];
+                }
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace lumi
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "core/json.h"
+#include "vulkan/vulkan.h"
+
+namespace lumi {
+
+// Reads Radiance RGBE (.hdr) images.
+// Scanlines are decoded straight into texels of the destination format,
+// without a full float copy of the image in between.
+class HDRFile {
+private:
+    std::vector<uint8_t> data_{};  // Content of the whole file
+    size_t               pixels_offset_{};
+    uint32_t             width_{};
+    uint32_t             height_{};
+
+public:
+    uint32_t width() const { return width_; }
+
+    uint32_t height() const { return height_; }
+
+    // Reads the file and parses the header, scanlines are not decoded yet
+    static bool Load(const fs::path& filepath, HDRFile* file);
+
+    // Supported formats are R32G32B32A32_SFLOAT, R16G16B16A16_SFLOAT and
+    // B10G11R11_UFLOAT_PACK32. dst holds width * height tightly packed texels.
+    bool Decode(VkFormat format, void* dst) const;
+
+private:
+    // Decodes one RLE or flat scanline, cursor is moved past it
+    bool DecodeScanline(size_t& cursor, uint8_t* rgbe) const;
+};
+
+}  // namespace lumi
@@ -0,0 +1,328 @@
+#include "ibl_baker.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "core/math.h"
+#include "core/thread_pool.h"
+#include "cubemap_faces.h"
+#include "float_converter.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define LUMI_IBL_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace lumi {
+
+namespace {
+
+constexpr uint32_t kRowsPerJob = 8;
+
+// Van der Corput sequence, the second dimension of the Hammersley set
+float RadicalInverse(uint32_t bits) {
+    bits = (bits << 16) | (bits >> 16);
+    bits = ((bits & 0x55555555u) << 1) | ((bits & 0xaaaaaaaau) >> 1);
+    bits = ((bits & 0x33333333u) << 2) | ((bits & 0xccccccccu) >> 2);
+    bits = ((bits & 0x0f0f0f0fu) << 4) | ((bits & 0xf0f0f0f0u) >> 4);
+    bits = ((bits & 0x00ff00ffu) << 8) | ((bits & 0xff00ff00u) >> 8);
+    return bits * 2.3283064365386963e-10f;
+}
+
+// Half vector around +Z distributed by GGX
+void ImportanceSampleGGX(uint32_t i, uint32_t count, float alpha, float* h) {
+    float phi       = kTwoPi * i / count;
+    float xi        = RadicalInverse(i);
+    float cos_theta =
+        std::sqrt((1.0f - xi) / (1.0f + (alpha * alpha - 1.0f) * xi));
+    float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+
+    h[0] = sin_theta * std::cos(phi);
+    h[1] = sin_theta * std::sin(phi);
+    h[2] = cos_theta;
+}
+
+float DistributionGGX(float n_dot_h, float alpha) {
+    float a2 = alpha * alpha;
+    float d  = n_dot_h * n_dot_h * (a2 - 1.0f) + 1.0f;
+    return a2 / (kPi * d * d);
+}
+
+// Light direction in the tangent space of N = V, with its source mip level
+struct SpecularSample {
+    float    l[3]{};
+    float    weight{};  // NdotL
+    uint32_t level{};
+};
+
+// Box filtered radiance, lower levels are read by rough samples so that few
+// samples do not alias, see "GPU-Based Importance Sampling" in GPU Gems 3
+struct SourceChain {
+    std::vector<std::vector<float>> levels{};  // 6 RGBA32F faces each
+    std::vector<uint32_t>           sizes{};
+
+    SourceChain(const float* faces, uint32_t face_size) {
+        sizes.push_back(face_size);
+        levels.emplace_back(faces, faces + (size_t)face_size * face_size * 24);
+
+        while (face_size > 1) {
+            uint32_t           half = face_size / 2;
+            const float*       src  = levels.back().data();
+            std::vector<float> dst((size_t)half * half * 24);
+            // Faces are stacked, so the rows of all 6 are filtered at once
+            for (uint32_t y = 0; y < half * 6; y++) {
+                const float* row0 = src + (size_t)y * 2 * face_size * 4;
+                const float* row1 = row0 + (size_t)face_size * 4;
+                float*       out  = dst.data() + (size_t)y * half * 4;
+                for (uint32_t x = 0; x < half * 4; x++) {
+                    uint32_t i = (x / 4) * 8 + x % 4;
+                    out[x] = 0.25f * (row0[i] + row0[i + 4] + row1[i] +
+                                      row1[i + 4]);
+                }
+            }
+            face_size = half;
+            sizes.push_back(face_size);
+            levels.emplace_back(std::move(dst));
+        }
+    }
+};
+
+// Inverse of kCubemapFaceAxes, s and t are in [0, 1]
+void DirectionToFace(const float* dir, uint32_t* face, float* s, float* t) {
+    float ax = std::fabs(dir[0]);
+    float ay = std::fabs(dir[1]);
+    float az = std::fabs(dir[2]);
+    float sc{}, tc{}, ma{};
+    if (ax >= ay && ax >= az) {
+        *face = dir[0] > 0.0f ? 0 : 1;
+        sc    = dir[0] > 0.0f ? -dir[2] : dir[2];
+        tc    = -dir[1];
+        ma    = ax;
+    } else if (ay >= az) {
+        *face = dir[1] > 0.0f ? 2 : 3;
+        sc    = dir[0];
+        tc    = dir[1] > 0.0f ? dir[2] : -dir[2];
+        ma    = ay;
+    } else {
+        *face = dir[2] > 0.0f ? 4 : 5;
+        sc    = dir[2] > 0.0f ? dir[0] : -dir[0];
+        tc    = -dir[1];
+        ma    = az;
+    }
+    *s = 0.5f * (sc / ma + 1.0f);
+    *t = 0.5f * (tc / ma + 1.0f);
+}
+
+// Bilinear inside the face, clamped at its edges
+void SampleCubemap(const SourceChain& chain, const float* dir, uint32_t level,
+                   float weight, float* sum) {
+    uint32_t face{};
+    float    s{}, t{};
+    DirectionToFace(dir, &face, &s, &t);
+
+    uint32_t size = chain.sizes[level];
+    float    fx   = std::clamp(s * size - 0.5f, 0.0f, size - 1.0f);
+    float    fy   = std::clamp(t * size - 0.5f, 0.0f, size - 1.0f);
+    uint32_t x0   = (uint32_t)fx;
+    uint32_t y0   = (uint32_t)fy;
+    uint32_t x1   = std::min(x0 + 1, size - 1);
+    uint32_t y1   = std::min(y0 + 1, size - 1);
+    float    wx   = fx - x0;
+    float    wy   = fy - y0;
+
+    const float* texels =
+        chain.levels[level].data() + (size_t)face * size * size * 4;
+    const float* p00 = texels + (y0 * size + x0) * 4;
+    const float* p01 = texels + (y0 * size + x1) * 4;
+    const float* p10 = texels + (y1 * size + x0) * 4;
+    const float* p11 = texels + (y1 * size + x1) * 4;
+
+#ifdef LUMI_IBL_SSE2
+    auto lerp = [](__m128 a, __m128 b, float w) {
+        return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(w)));
+    };
+    __m128 top   = lerp(_mm_loadu_ps(p00), _mm_loadu_ps(p01), wx);
+    __m128 bot   = lerp(_mm_loadu_ps(p10), _mm_loadu_ps(p11), wx);
+    __m128 value = _mm_mul_ps(lerp(top, bot, wy), _mm_set1_ps(weight));
+    _mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), value));
+#else
+    for (uint32_t c = 0; c < 4; c++) {
+        float top = p00[c] + (p01[c] - p00[c]) * wx;
+        float bot = p10[c] + (p11[c] - p10[c]) * wx;
+        sum[c] += (top + (bot - top) * wy) * weight;
+    }
+#endif
+}
+
+void WriteRow(const float* rgba, VkFormat format, uint32_t count,
+              uint8_t* dst) {
+    if (format == VK_FORMAT_B10G11R11_UFLOAT_PACK32) {
+        FloatConverter::ToB10G11R11(rgba, (uint32_t*)dst, count);
+    } else {
+        FloatConverter::ToHalf(rgba, (uint16_t*)dst, count * 4);
+    }
+}
+
+}  // namespace
+
+uint32_t IBLBaker::SpecularMipLevels(uint32_t face_size) {
+    return std::min(MipGenerator::FullMipLevels(face_size, face_size),
+                    kMaxSpecularMipLevels);
+}
+
+size_t IBLBaker::ComputeCubemapLayout(uint32_t face_size, uint32_t mip_levels,
+                                      uint32_t texel_size,
+                                      std::vector<Level>& levels) {
+    // 6 faces of one level are the same as one image with 6 times the rows
+    size_t size = MipGenerator::ComputeLayout(face_size, face_size * 6,
+                                              texel_size, mip_levels, levels);
+    for (uint32_t i = 0; i < mip_levels; i++) {
+        levels[i].width  = std::max(face_size >> i, 1u);
+        levels[i].height = levels[i].width;
+    }
+    return size;
+}
+
+void IBLBaker::PrefilterSpecular(const float* faces, uint32_t face_size,
+                                 VkFormat format,
+                                 const std::vector<Level>& levels,
+                                 uint8_t* dst) {
+    uint32_t texel_size =
+        format == VK_FORMAT_B10G11R11_UFLOAT_PACK32 ? 4 : 8;
+    uint32_t mip_levels = (uint32_t)levels.size();
+
+    SourceChain chain(faces, face_size);
+
+    // Same samples for every texel of a level
+    float texel_solid_angle = 4.0f * kPi / (6.0f * face_size * face_size);
+    std::vector<std::vector<SpecularSample>> samples(mip_levels);
+    for (uint32_t i = 1; i < mip_levels; i++) {
+        float roughness = (float)i / (mip_levels - 1);
+        float alpha     = roughness * roughness;
+        for (uint32_t j = 0; j < kSpecularSampleCount; j++) {
+            float h[3]{};
+            ImportanceSampleGGX(j, kSpecularSampleCount, alpha, h);
+
+            // Reflect V = N = +Z around H
+            SpecularSample sample{};
+            sample.l[0]   = 2.0f * h[2] * h[0];
+            sample.l[1]   = 2.0f * h[2] * h[1];
+            sample.l[2]   = 2.0f * h[2] * h[2] - 1.0f;
+            sample.weight = sample.l[2];
+            if (sample.weight <= 0.0f) continue;
+
+            // pdf of L is D * NdotH / (4 * VdotH), the same as D / 4 here
+            float pdf         = DistributionGGX(h[2], alpha) * 0.25f;
+            float solid_angle = 1.0f / (kSpecularSampleCount * pdf + 1e-6f);
+            float level =
+                0.5f * std::log2(solid_angle / texel_solid_angle) + 1.0f;
+            sample.level = (uint32_t)std::clamp(
+                level, 0.0f, (float)(chain.sizes.size() - 1));
+            samples[i].push_back(sample);
+        }
+    }
+
+    // One job per kRowsPerJob rows of a face of a level
+    struct Job {
+        uint32_t level, face, row_begin;
+    };
+    std::vector<Job> jobs{};
+    for (uint32_t i = 0; i < mip_levels; i++) {
+        for (uint32_t face = 0; face < 6; face++) {
+            for (uint32_t y = 0; y < levels[i].height; y += kRowsPerJob) {
+                jobs.push_back({i, face, y});
+            }
+        }
+    }
+
+    auto& pool = ThreadPool::Instance();
+    pool.ParallelFor((uint32_t)jobs.size(), [&](uint32_t idx) {
+        const Job&   job   = jobs[idx];
+        const Level& level = levels[job.level];
+        uint32_t     size  = level.width;
+        uint32_t     end   = std::min(job.row_begin + kRowsPerJob, size);
+
+        const float(&axes)[3][3] = kCubemapFaceAxes[job.face];
+
+        std::vector<float> row(size * 4);
+        for (uint32_t y = job.row_begin; y < end; y++) {
+            uint8_t* out = dst + level.offset +
+                           ((size_t)job.face * size + y) * size * texel_size;
+
+            // Mirror reflection is the source itself
+            if (job.level == 0) {
+                WriteRow(faces + ((size_t)job.face * size + y) * size * 4,
+                         format, size, out);
+                continue;
+            }
+
+            float t = (y + 0.5f) * 2.0f / size - 1.0f;
+            for (uint32_t x = 0; x < size; x++) {
+                float s = (x + 0.5f) * 2.0f / size - 1.0f;
+                Vec3f n{};
+                for (uint32_t c = 0; c < 3; c++) {
+                    n[c] = axes[0][c] + s * axes[1][c] + t * axes[2][c];
+                }
+                n = n.Normalize();
+
+                // Tangent frame around N
+                Vec3f up = std::fabs(n.z) < 0.999f ? Vec3f::kUnitZ
+                                                   : Vec3f::kUnitX;
+                Vec3f tangent   = Cross(up, n).Normalize();
+                Vec3f bitangent = Cross(n, tangent);
+
+                alignas(16) float sum[4]{};
+                float             total_weight = 0.0f;
+                for (const SpecularSample& sample : samples[job.level]) {
+                    Vec3f l = tangent * sample.l[0] +
+                              bitangent * sample.l[1] + n * sample.l[2];
+                    SampleCubemap(chain, &l.x, sample.level, sample.weight,
+                                  sum);
+                    total_weight += sample.weight;
+                }
+                for (uint32_t c = 0; c < 4; c++) {
+                    row[x * 4 + c] = sum[c] / total_weight;
+                }
+            }
+            WriteRow(row.data(), format, size, out);
+        }
+    });
+}
+
+void IBLBaker::BakeBRDFLut(uint32_t size, uint16_t* dst) {
+    ThreadPool::Instance().ParallelFor(size, [&](uint32_t y) {
+        float roughness = 1.0f - (y + 0.5f) / size;
+        float alpha     = roughness * roughness;
+        float k         = alpha * 0.5f;  // Schlick-GGX for IBL
+
+        for (uint32_t x = 0; x < size; x++) {
+            float n_dot_v = (x + 0.5f) / size;
+            float v[3]    = {std::sqrt(1.0f - n_dot_v * n_dot_v), 0.0f,
+                             n_dot_v};
+
+            float scale = 0.0f, bias = 0.0f;
+            for (uint32_t i = 0; i < kBRDFSampleCount; i++) {
+                float h[3]{};
+                ImportanceSampleGGX(i, kBRDFSampleCount, alpha, h);
+
+                float v_dot_h = v[0] * h[0] + v[2] * h[2];
+                float n_dot_l = 2.0f * v_dot_h * h[2] - v[2];
+                if (n_dot_l <= 0.0f) continue;
+
+                v_dot_h       = std::max(v_dot_h, 0.0f);
+                float g       = n_dot_v / (n_dot_v * (1.0f - k) + k) *
+                                n_dot_l / (n_dot_l * (1.0f - k) + k);
+                float g_vis   = g * v_dot_h / (h[2] * n_dot_v);
+                float fresnel = std::pow(1.0f - v_dot_h, 5.0f);
+                scale += (1.0f - fresnel) * g_vis;
+                bias += fresnel * g_vis;
+            }
+
+            uint16_t* out = dst + ((size_t)y * size + x) * 2;
+            out[0]        = FloatConverter::ToHalf(scale / kBRDFSampleCount);
+            out[1]        = FloatConverter::ToHalf(bias / kBRDFSampleCount);
+        }
+    });
+}
+
+}  // namespace lumi
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "mip_generator.h"
+#include "vulkan/vulkan.h"
+
+namespace lumi {
+
+// Bakes the split sum approximation of specular image based lighting on the
+// CPU, see "Real Shading in Unreal Engine 4" by Brian Karis.
+// Roughness is perceptual, the GGX alpha is its square.
+class IBLBaker {
+public:
+    using Level = MipGenerator::Level;
+
+    // Bumped whenever the baked results change, invalidates disk caches
+    constexpr static uint32_t kVersion = 1;
+
+    // The roughest level is kept at 8x8 or more for a 256^2 cubemap
+    constexpr static uint32_t kMaxSpecularMipLevels = 6;
+    constexpr static uint32_t kSpecularSampleCount  = 64;
+    constexpr static uint32_t kBRDFSampleCount      = 512;
+    constexpr static uint32_t kBRDFLutSize          = 256;
+
+    static uint32_t SpecularMipLevels(uint32_t face_size);
+
+    // Packed mip chain of a cubemap, every level holds its 6 faces back to
+    // back as vkCmdCopyBufferToImage expects. Returns the total size.
+    static size_t ComputeCubemapLayout(uint32_t face_size, uint32_t mip_levels,
+                                       uint32_t texel_size,
+                                       std::vector<Level>& levels);
+
+    // faces holds the radiance in 6 RGBA32F faces of face_size^2 texels.
+    // Level i of dst is prefiltered for roughness i / (levels - 1) with GGX
+    // importance sampling, in R16G16B16A16_SFLOAT or B10G11R11_UFLOAT_PACK32.
+    // Texels of all levels run in parallel.
+    static void PrefilterSpecular(const float* faces, uint32_t face_size,
+                                  VkFormat format,
+                                  const std::vector<Level>& levels,
+                                  uint8_t* dst);
+
+    // Scale and bias to F0 in R16G16_SFLOAT. u is NdotV and v is
+    // 1 - roughness, rows run in parallel.
+    static void BakeBRDFLut(uint32_t size, uint16_t* dst);
+};
+
+}  // namespace lumi
@@ -0,0 +1,190 @@
+#include "ktx2_file.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "block_compressor.h"
+
+namespace lumi {
+
+namespace {
+
+constexpr uint8_t kIdentifier[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A,
+};
+
+// Byte offsets in the file header
+constexpr size_t kFormatOffset           = 12;
+constexpr size_t kPixelWidthOffset       = 20;
+constexpr size_t kPixelHeightOffset      = 24;
+constexpr size_t kPixelDepthOffset       = 28;
+constexpr size_t kLayerCountOffset       = 32;
+constexpr size_t kFaceCountOffset        = 36;
+constexpr size_t kLevelCountOffset       = 40;
+constexpr size_t kSupercompressionOffset = 44;
+constexpr size_t kLevelIndexOffset       = 80;
+constexpr size_t kLevelIndexStride       = 24;
+
+// Bytes of one texel, or of one 4x4 block if is_block is set. Returns 0 for
+// formats that are not supported.
+uint32_t GetFormatBytes(VkFormat format, bool* is_block) {
+    *is_block = false;
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_R8_SRGB:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R8G8_SRGB:
+        case VK_FORMAT_R16_SFLOAT:
+            return 2;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+        case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+            *is_block = true;
+            return 8;
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+        case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            *is_block = true;
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+uint64_t GetLevelSize(uint32_t bytes, bool is_block, uint32_t width,
+                      uint32_t height) {
+    if (is_block) {
+        constexpr uint32_t kDim = BlockCompressor::kBlockDim;
+        width                   = (width + kDim - 1) / kDim;
+        height                  = (height + kDim - 1) / kDim;
+    }
+    return (uint64_t)bytes * width * height;
+}
+
+}  // namespace
+
+bool KTX2File::Load(const fs::path& filepath, KTX2File* file) {
+    auto in = std::ifstream(filepath, std::ios::ate | std::ios::binary);
+    if (!in.is_open()) {
+        LOG_ERROR("Failed to open KTX2 file {}", filepath);
+        return false;
+    }
+    size_t file_size = (size_t)in.tellg();
+    file->data.resize(file_size);
+    in.seekg(0);
+    in.read((char*)file->data.data(), file_size);
+    in.close();
+
+    const uint8_t* data = file->data.data();
+    auto read32 = [data](size_t offset) {
+        uint32_t value{};
+        memcpy(&value, data + offset, sizeof(value));
+        return value;
+    };
+    auto read64 = [data](size_t offset) {
+        uint64_t value{};
+        memcpy(&value, data + offset, sizeof(value));
+        return value;
+    };
+
+    if (file_size < kLevelIndexOffset ||
+        memcmp(data, kIdentifier, sizeof(kIdentifier)) != 0) {
+        LOG_ERROR("Invalid KTX2 file {}", filepath);
+        return false;
+    }
+
+    if (read32(kPixelDepthOffset) != 0 || read32(kLayerCountOffset) > 1 ||
+        read32(kFaceCountOffset) != 1) {
+        LOG_ERROR("Only 2D textures are supported in KTX2 file {}", filepath);
+        return false;
+    }
+    if (read32(kSupercompressionOffset) != 0) {
+        LOG_ERROR("Supercompressed KTX2 file {} is not supported", filepath);
+        return false;
+    }
+
+    file->format = (VkFormat)read32(kFormatOffset);
+    file->width  = read32(kPixelWidthOffset);
+    file->height = std::max(read32(kPixelHeightOffset), 1u);
+    if (file->width == 0) {
+        LOG_ERROR("Zero width in KTX2 file {}", filepath);
+        return false;
+    }
+
+    bool     is_block{};
+    uint32_t format_bytes = GetFormatBytes(file->format, &is_block);
+    if (format_bytes == 0) {
+        LOG_ERROR("Unsupported format {} in KTX2 file {}", file->format,
+                  filepath);
+        return false;
+    }
+
+    // A level count of 0 asks for runtime generation, only the base exists
+    uint32_t level_count = std::max(read32(kLevelCountOffset), 1u);
+    uint32_t max_levels  = 1;
+    while ((std::max(file->width, file->height) >> max_levels) > 0) {
+        max_levels++;
+    }
+    if (level_count > max_levels) {
+        LOG_ERROR("{} levels exceed the mip chain of {} in KTX2 file {}",
+                  level_count, max_levels, filepath);
+        return false;
+    }
+    if (kLevelIndexOffset + level_count * kLevelIndexStride > file_size) {
+        LOG_ERROR("Truncated level index in KTX2 file {}", filepath);
+        return false;
+    }
+
+    file->levels.resize(level_count);
+    for (uint32_t i = 0; i < level_count; i++) {
+        size_t   entry  = kLevelIndexOffset + i * kLevelIndexStride;
+        uint64_t offset = read64(entry);
+        uint64_t length = read64(entry + 8);
+        if (offset > file_size || length > file_size - offset) {
+            LOG_ERROR("Level {} is out of range in KTX2 file {}", i, filepath);
+            return false;
+        }
+
+        file->levels[i].offset = (size_t)offset;
+        file->levels[i].width  = std::max(file->width >> i, 1u);
+        file->levels[i].height = std::max(file->height >> i, 1u);
+
+        // Copies and decoding read the whole level
+        uint64_t level_size =
+            GetLevelSize(format_bytes, is_block, file->levels[i].width,
+                         file->levels[i].height);
+        if (length < level_size) {
+            LOG_ERROR("Level {} has {} bytes instead of {} in KTX2 file {}",
+                      i, length, level_size, filepath);
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace lumi
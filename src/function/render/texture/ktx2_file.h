@@ -0,0 +1,24 @@
+#pragma once
+
+#include "core/json.h"
+#include "mip_generator.h"
+#include "vulkan/vulkan.h"
+
+namespace lumi {
+
+// Reads 2D textures stored in the KTX2 container.
+// Array, cubemap, 3D and supercompressed files are rejected, and so are
+// levels beyond the mip chain or smaller than their format needs.
+struct KTX2File {
+    using Level = MipGenerator::Level;
+
+    VkFormat             format{};
+    uint32_t             width{};
+    uint32_t             height{};
+    std::vector<Level>   levels{};  // Level 0 first, offsets point into data
+    std::vector<uint8_t> data{};    // Content of the whole file
+
+    static bool Load(const fs::path& filepath, KTX2File* file);
+};
+
+}  // namespace lumi
@@ -0,0 +1,190 @@
+#include "mip_generator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "core/thread_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define LUMI_MIPMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace lumi {
+
+namespace {
+
+constexpr uint32_t kRowsPerJob      = 16;
+constexpr uint32_t kEncodeTableSize = 1 << 14;
+
+// Lookup tables between 8-bit sRGB and linear values
+struct SRGBTables {
+    float   to_linear[256]{};
+    uint8_t to_srgb[kEncodeTableSize + 1]{};
+
+    SRGBTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            to_linear[i] = c <= 0.04045f
+                               ? c / 12.92f
+                               : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (uint32_t i = 0; i <= kEncodeTableSize; i++) {
+            float l = (float)i / kEncodeTableSize;
+            float s = l <= 0.0031308f
+                          ? l * 12.92f
+                          : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            to_srgb[i] = (uint8_t)std::min(s * 255.0f + 0.5f, 255.0f);
+        }
+    }
+};
+
+const SRGBTables& GetSRGBTables() {
+    static const SRGBTables tables{};
+    return tables;
+}
+
+}  // namespace
+
+uint32_t MipGenerator::FullMipLevels(uint32_t width, uint32_t height) {
+    uint32_t size   = std::max(width, height);
+    uint32_t levels = 1;
+    while (size > 1) {
+        size >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+size_t MipGenerator::ComputeLayout(uint32_t width, uint32_t height,
+                                   uint32_t channels, uint32_t mip_levels,
+                                   std::vector<Level>& levels) {
+    levels.resize(mip_levels);
+
+    size_t offset = 0;
+    for (uint32_t i = 0; i < mip_levels; i++) {
+        levels[i].offset = offset;
+        levels[i].width  = width;
+        levels[i].height = height;
+
+        offset += (size_t)width * height * channels;
+        offset = (offset + kLevelAlignment - 1) & ~(kLevelAlignment - 1);
+
+        width  = std::max(width >> 1, 1u);
+        height = std::max(height >> 1, 1u);
+    }
+    return offset;
+}
+
+void MipGenerator::Generate(uint8_t* data, const std::vector<Level>& levels,
+                            uint32_t channels, bool is_srgb) {
+    GetSRGBTables();  // build the tables before going wide
+
+    auto& pool = ThreadPool::Instance();
+    for (size_t i = 1; i < levels.size(); i++) {
+        const Level&   src_level = levels[i - 1];
+        const Level&   dst_level = levels[i];
+        const uint8_t* src       = data + src_level.offset;
+        uint8_t*       dst       = data + dst_level.offset;
+
+        uint32_t jobs = (dst_level.height + kRowsPerJob - 1) / kRowsPerJob;
+        pool.ParallelFor(jobs, [&](uint32_t job) {
+            uint32_t begin = job * kRowsPerJob;
+            uint32_t end   = std::min(begin + kRowsPerJob, dst_level.height);
+            DownsampleRows(src, src_level, dst, dst_level, channels, is_srgb,
+                           begin, end);
+        });
+    }
+}
+
+void MipGenerator::DownsampleRows(const uint8_t* src, const Level& src_level,
+                                  uint8_t* dst, const Level& dst_level,
+                                  uint32_t channels, bool is_srgb,
+                                  uint32_t row_begin, uint32_t row_end) {
+    const SRGBTables& tables = GetSRGBTables();
+
+    size_t src_pitch = (size_t)src_level.width * channels;
+    size_t dst_pitch = (size_t)dst_level.width * channels;
+
+    for (uint32_t y = row_begin; y < row_end; y++) {
+        // Clamp for levels that are already 1 pixel high
+        uint32_t       y0   = std::min(y * 2, src_level.height - 1);
+        uint32_t       y1   = std::min(y * 2 + 1, src_level.height - 1);
+        const uint8_t* row0 = src + y0 * src_pitch;
+        const uint8_t* row1 = src + y1 * src_pitch;
+        uint8_t*       out  = dst + y * dst_pitch;
+
+        uint32_t x = 0;
+#ifdef LUMI_MIPMAP_SSE2
+        if (channels == 4 && src_level.width >= 2 && !is_srgb) {
+            // 2 output pixels from 4x2 input pixels per iteration
+            const __m128i zero  = _mm_setzero_si128();
+            const __m128i round = _mm_set1_epi16(2);
+            for (; x + 2 <= dst_level.width; x += 2) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+                __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero),
+                                           _mm_unpacklo_epi8(b, zero));
+                __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero),
+                                           _mm_unpackhi_epi8(b, zero));
+                lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+                __m128i sum = _mm_unpacklo_epi64(lo, hi);
+                sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+                _mm_storel_epi64((__m128i*)(out + x * 4),
+                                 _mm_packus_epi16(sum, zero));
+            }
+        } else if (channels == 4 && src_level.width >= 2) {
+            // Average in linear space, alpha stays in [0, 255]
+            const __m128 scale = _mm_setr_ps(
+                0.25f * kEncodeTableSize, 0.25f * kEncodeTableSize,
+                0.25f * kEncodeTableSize, 0.25f);
+            auto load = [&tables](const uint8_t* p) {
+                return _mm_setr_ps(tables.to_linear[p[0]],
+                                   tables.to_linear[p[1]],
+                                   tables.to_linear[p[2]], (float)p[3]);
+            };
+            alignas(16) int32_t idx[4];
+            for (; x < dst_level.width; x++) {
+                const uint8_t* p0 = row0 + x * 8;
+                const uint8_t* p1 = row1 + x * 8;
+
+                __m128 sum = _mm_add_ps(_mm_add_ps(load(p0), load(p0 + 4)),
+                                        _mm_add_ps(load(p1), load(p1 + 4)));
+                _mm_store_si128((__m128i*)idx,
+                                _mm_cvtps_epi32(_mm_mul_ps(sum, scale)));
+
+                out[x * 4 + 0] = tables.to_srgb[idx[0]];
+                out[x * 4 + 1] = tables.to_srgb[idx[1]];
+                out[x * 4 + 2] = tables.to_srgb[idx[2]];
+                out[x * 4 + 3] = (uint8_t)idx[3];
+            }
+        }
+#endif
+        // Scalar path, also handles the borders of odd sized levels
+        for (; x < dst_level.width; x++) {
+            uint32_t x0 = std::min(x * 2, src_level.width - 1) * channels;
+            uint32_t x1 = std::min(x * 2 + 1, src_level.width - 1) * channels;
+
+            for (uint32_t c = 0; c < channels; c++) {
+                uint8_t p00 = row0[x0 + c], p01 = row0[x1 + c];
+                uint8_t p10 = row1[x0 + c], p11 = row1[x1 + c];
+
+                if (is_srgb && c < 3) {
+                    float l = tables.to_linear[p00] + tables.to_linear[p01] +
+                              tables.to_linear[p10] + tables.to_linear[p11];
+                    uint32_t idx =
+                        (uint32_t)(l * 0.25f * kEncodeTableSize + 0.5f);
+                    out[x * channels + c] = tables.to_srgb[idx];
+                } else {
+                    out[x * channels + c] =
+                        (uint8_t)((p00 + p01 + p10 + p11 + 2) >> 2);
+                }
+            }
+        }
+    }
+}
+
+}  // namespace lumi
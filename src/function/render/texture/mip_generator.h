@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lumi {
+
+// Builds mip chains of 8-bit color textures on the CPU.
+// Each level is a 2x2 box filter of the previous one. Color channels of sRGB
+// textures are averaged in linear space, alpha is always linear.
+class MipGenerator {
+public:
+    // Offsets keep every level aligned for vkCmdCopyBufferToImage
+    constexpr static size_t kLevelAlignment = 16;
+
+    struct Level {
+        size_t   offset{};
+        uint32_t width{};
+        uint32_t height{};
+    };
+
+    static uint32_t FullMipLevels(uint32_t width, uint32_t height);
+
+    // Fills the packed layout of the chain, returns its total size in bytes
+    static size_t ComputeLayout(uint32_t width, uint32_t height,
+                                uint32_t channels, uint32_t mip_levels,
+                                std::vector<Level>& levels);
+
+    // data holds level 0 at offset 0, the other levels are written in place
+    static void Generate(uint8_t* data, const std::vector<Level>& levels,
+                         uint32_t channels, bool is_srgb);
+
+private:
+    static void DownsampleRows(const uint8_t* src, const Level& src_level,
+                               uint8_t* dst, const Level& dst_level,
+                               uint32_t channels, bool is_srgb,
+                               uint32_t row_begin, uint32_t row_end);
+};
+
+}  // namespace lumi
@@ -0,0 +1,226 @@
+#include "spherical_harmonics.h"
+
+#include <cmath>
+#include <vector>
+
+#include "core/json.h"
+#include "cubemap_faces.h"
+#include "float_converter.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define LUMI_SH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace lumi {
+
+namespace {
+
+// Normalization constants of the basis functions
+constexpr float kY0 = 0.282095f;  // 1 / 2 sqrt(1 / pi)
+constexpr float kY1 = 0.488603f;  // sqrt(3 / 4pi)
+constexpr float kY2 = 1.092548f;  // sqrt(15 / 4pi)
+constexpr float kY3 = 0.315392f;  // sqrt(5 / 16pi)
+constexpr float kY4 = 0.546274f;  // sqrt(15 / 16pi)
+
+// Convolution with the clamped cosine divided by pi, per band
+constexpr float kCosineLobe[3] = {1.0f, 2.0f / 3.0f, 1.0f / 4.0f};
+
+template <class T>
+void EvaluateBasis(T x, T y, T z, T* basis) {
+    basis[0] = T(kY0);
+    basis[1] = T(kY1) * y;
+    basis[2] = T(kY1) * z;
+    basis[3] = T(kY1) * x;
+    basis[4] = T(kY2) * x * y;
+    basis[5] = T(kY2) * y * z;
+    basis[6] = T(kY3) * (T(3) * z * z - T(1));
+    basis[7] = T(kY2) * x * z;
+    basis[8] = T(kY4) * (x * x - y * y);
+}
+
+#ifdef LUMI_SH_SSE2
+// Operators for the templated basis
+struct Float4 {
+    __m128 v;
+
+    Float4() = default;
+    Float4(__m128 value) : v(value) {}
+    explicit Float4(float value) : v(_mm_set1_ps(value)) {}
+
+    Float4 operator*(Float4 rhs) const { return _mm_mul_ps(v, rhs.v); }
+    Float4 operator-(Float4 rhs) const { return _mm_sub_ps(v, rhs.v); }
+};
+
+float HorizontalSum(__m128 v) {
+    __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums     = _mm_add_ps(v, shuffled);
+    shuffled        = _mm_movehl_ps(shuffled, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+#endif
+
+}  // namespace
+
+bool SphericalHarmonics::ProjectFace(uint32_t face, VkFormat format,
+                                     const void* texels, uint32_t face_size,
+                                     FaceSums* sums) {
+    *sums = {};
+
+    std::vector<float> row(face_size * 4);
+    for (uint32_t y = 0; y < face_size; y++) {
+        size_t offset = (size_t)y * face_size;
+        switch (format) {
+            case VK_FORMAT_R32G32B32A32_SFLOAT:
+                memcpy(row.data(), (const float*)texels + offset * 4,
+                       row.size() * sizeof(float));
+                break;
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+                FloatConverter::FromHalf((const uint16_t*)texels + offset * 4,
+                                         row.data(), row.size());
+                break;
+            case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+                FloatConverter::FromB10G11R11(
+                    (const uint32_t*)texels + offset, row.data(), face_size);
+                break;
+            default:
+                LOG_ERROR("Unsupported format {} for SH projection", format);
+                return false;
+        }
+        ProjectRow(face, row.data(), face_size, y, sums);
+    }
+    return true;
+}
+
+void SphericalHarmonics::ProjectRow(uint32_t face, const float* rgba,
+                                    uint32_t face_size, uint32_t y,
+                                    FaceSums* sums) {
+    const float(&axes)[3][3] = kCubemapFaceAxes[face];
+
+    float scale = 2.0f / face_size;
+    float t     = (y + 0.5f) * scale - 1.0f;
+
+    // Texel solid angle is proportional to (1 + s^2 + t^2)^(-3/2), the sums
+    // are normalized to 4pi when resolving
+    float    row_coeffs[kCoeffCount][3]{};
+    float    row_weight = 0.0f;
+    uint32_t x          = 0;
+#ifdef LUMI_SH_SSE2
+    __m128 acc[kCoeffCount][3]{};
+    __m128 acc_weight = _mm_setzero_ps();
+    for (; x + 4 <= face_size; x += 4) {
+        __m128 s = _mm_cvtepi32_ps(_mm_setr_epi32(x, x + 1, x + 2, x + 3));
+        s = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(s, _mm_set1_ps(0.5f)),
+                                  _mm_set1_ps(scale)),
+                       _mm_set1_ps(1.0f));
+
+        __m128 dir[3]{};
+        for (uint32_t c = 0; c < 3; c++) {
+            dir[c] = _mm_add_ps(_mm_set1_ps(axes[0][c] + t * axes[2][c]),
+                                _mm_mul_ps(s, _mm_set1_ps(axes[1][c])));
+        }
+        // 1 + s^2 + t^2 is the squared length of the direction
+        __m128 len2 = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(dir[0], dir[0]), _mm_mul_ps(dir[1], dir[1])),
+            _mm_mul_ps(dir[2], dir[2]));
+        __m128 inv_len = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len2));
+        __m128 weight  = _mm_div_ps(inv_len, len2);
+        for (uint32_t c = 0; c < 3; c++) {
+            dir[c] = _mm_mul_ps(dir[c], inv_len);
+        }
+
+        Float4 basis[kCoeffCount];
+        EvaluateBasis(Float4(dir[0]), Float4(dir[1]), Float4(dir[2]), basis);
+
+        // Texels to one register per channel
+        __m128 r = _mm_loadu_ps(rgba + x * 4 + 0);
+        __m128 g = _mm_loadu_ps(rgba + x * 4 + 4);
+        __m128 b = _mm_loadu_ps(rgba + x * 4 + 8);
+        __m128 a = _mm_loadu_ps(rgba + x * 4 + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        __m128 channels[3] = {_mm_mul_ps(r, weight), _mm_mul_ps(g, weight),
+                              _mm_mul_ps(b, weight)};
+        for (uint32_t i = 0; i < kCoeffCount; i++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                acc[i][c] =
+                    _mm_add_ps(acc[i][c], _mm_mul_ps(basis[i].v, channels[c]));
+            }
+        }
+        acc_weight = _mm_add_ps(acc_weight, weight);
+    }
+    for (uint32_t i = 0; i < kCoeffCount; i++) {
+        for (uint32_t c = 0; c < 3; c++) {
+            row_coeffs[i][c] = HorizontalSum(acc[i][c]);
+        }
+    }
+    row_weight = HorizontalSum(acc_weight);
+#endif
+    for (; x < face_size; x++) {
+        float s = (x + 0.5f) * scale - 1.0f;
+        float dir[3]{};
+        for (uint32_t c = 0; c < 3; c++) {
+            dir[c] = axes[0][c] + s * axes[1][c] + t * axes[2][c];
+        }
+        float len2    = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+        float inv_len = 1.0f / std::sqrt(len2);
+        float weight  = inv_len / len2;
+
+        float basis[kCoeffCount]{};
+        EvaluateBasis(dir[0] * inv_len, dir[1] * inv_len, dir[2] * inv_len,
+                      basis);
+        for (uint32_t i = 0; i < kCoeffCount; i++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                row_coeffs[i][c] += basis[i] * rgba[x * 4 + c] * weight;
+            }
+        }
+        row_weight += weight;
+    }
+
+    // Rows are summed in double precision
+    for (uint32_t i = 0; i < kCoeffCount; i++) {
+        for (uint32_t c = 0; c < 3; c++) {
+            sums->coeffs[i][c] += row_coeffs[i][c];
+        }
+    }
+    sums->weight += row_weight;
+}
+
+SphericalHarmonics::Coeffs SphericalHarmonics::ResolveIrradiance(
+    const FaceSums* faces, uint32_t count) {
+    FaceSums total{};
+    for (uint32_t f = 0; f < count; f++) {
+        for (uint32_t i = 0; i < kCoeffCount; i++) {
+            for (uint32_t c = 0; c < 3; c++) {
+                total.coeffs[i][c] += faces[f].coeffs[i][c];
+            }
+        }
+        total.weight += faces[f].weight;
+    }
+
+    Coeffs coeffs{};
+    if (total.weight <= 0.0) return coeffs;
+
+    double normalize = 4.0 * kPi / total.weight;
+    for (uint32_t i = 0; i < kCoeffCount; i++) {
+        // Band of coefficient i is floor(sqrt(i))
+        float lobe = kCosineLobe[i == 0 ? 0 : (i < 4 ? 1 : 2)];
+        for (uint32_t c = 0; c < 3; c++) {
+            coeffs[i][c] = (float)(total.coeffs[i][c] * normalize) * lobe;
+        }
+    }
+    return coeffs;
+}
+
+Vec3f SphericalHarmonics::Evaluate(const Coeffs& coeffs, const Vec3f& dir) {
+    float basis[kCoeffCount]{};
+    EvaluateBasis(dir.x, dir.y, dir.z, basis);
+
+    Vec3f result{};
+    for (uint32_t i = 0; i < kCoeffCount; i++) {
+        result += coeffs[i] * basis[i];
+    }
+    return result;
+}
+
+}  // namespace lumi
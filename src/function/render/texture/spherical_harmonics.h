@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+
+#include "core/math.h"
+#include "vulkan/vulkan.h"
+
+namespace lumi {
+
+// Order 2 (9 coefficients) spherical harmonics of RGB environment lighting,
+// in the real basis over world space directions.
+// See "An Efficient Representation for Irradiance Environment Maps" by
+// Ramamoorthi and Hanrahan.
+class SphericalHarmonics {
+public:
+    constexpr static uint32_t kCoeffCount = 9;
+
+    using Coeffs = std::array<Vec3f, kCoeffCount>;
+
+    // Solid angle weighted sums of one cubemap face
+    struct FaceSums {
+        double coeffs[kCoeffCount][3]{};
+        double weight{};
+    };
+
+    // texels hold one face of face_size^2 texels in R32G32B32A32_SFLOAT,
+    // R16G16B16A16_SFLOAT or B10G11R11_UFLOAT_PACK32
+    static bool ProjectFace(uint32_t face, VkFormat format, const void* texels,
+                            uint32_t face_size, FaceSums* sums);
+
+    // Convolves the projected radiance with the clamped cosine lobe.
+    // The result evaluated at a normal is irradiance / pi, like the value of
+    // a prefiltered irradiance cubemap.
+    static Coeffs ResolveIrradiance(const FaceSums* faces, uint32_t count);
+
+    static Vec3f Evaluate(const Coeffs& coeffs, const Vec3f& dir);
+
+private:
+    static void ProjectRow(uint32_t face, const float* rgba,
+                           uint32_t face_size, uint32_t y, FaceSums* sums);
+};
+
+}  // namespace lumi